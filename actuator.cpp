@@ -0,0 +1,294 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+
+#include <fmt/format.h>
+
+#include "actuator.hpp"
+#include "cpu-quota.hpp"
+#include "log.hpp"
+#include "memory.hpp"
+#include "net-bandwidth.hpp"
+#include "throw-with-trace.hpp"
+
+using fmt::literals::operator""_format;
+
+const char *actuator_kind_name(Actuators::kind_t kind)
+{
+    switch (kind) {
+    case Actuators::cbm_k:
+        return "cbm";
+    case Actuators::mb_k:
+        return "mb";
+    case Actuators::pin_k:
+        return "pin";
+    case Actuators::iotune_k:
+        return "iotune";
+    case Actuators::net_k:
+        return "net";
+    case Actuators::cpu_k:
+        return "cpu";
+    case Actuators::mem_k:
+        return "mem";
+    default:
+        return "unknown";
+    }
+}
+
+// Most restrictive of two limits, 0 meaning unlimited
+static uint64_t min_limit(uint64_t a, uint64_t b)
+{
+    if (a == 0 || b == 0)
+        return std::max(a, b);
+    return std::min(a, b);
+}
+
+void Actuators::submit(kind_t kind, uint32_t id, uint32_t sub,
+                       const std::vector<uint64_t> &value)
+{
+    stats[kind].submitted++;
+    knob_t &knob = knobs[key_t(kind, id, sub)];
+
+    // A newer batch replaces what was pending
+    if (!knob.pending || knob.batch != num_batches) {
+        knob.value = value;
+        knob.pending = true;
+        knob.batch = num_batches;
+        return;
+    }
+    if (knob.value == value)
+        return;
+
+    stats[kind].conflicts++;
+    if (kind == mb_k) {
+        // Limits in different units cannot be merged, the first one stays
+        if (knob.value[1] == value[1])
+            knob.value[0] = std::min(knob.value[0], value[0]);
+    } else if (kind == iotune_k || kind == net_k) {
+        for (size_t i = 0; i < value.size(); i++)
+            knob.value[i] = min_limit(knob.value[i], value[i]);
+    } else if (kind == cpu_k) {
+        // The period of the first one stays
+        knob.value[0] = min_limit(knob.value[0], value[0]);
+    } else if (kind == mem_k) {
+        knob.value[0] = std::min(knob.value[0], value[0]);
+    }
+    LOGDEB("ACT: conflicting {} writes to {}/{}"_format(
+        actuator_kind_name(kind), id, sub));
+}
+
+void Actuators::set_cbm(uint32_t clos, uint64_t mask)
+{
+    submit(cbm_k, clos, 0, {mask});
+}
+
+void Actuators::set_mb(uint32_t clos, unsigned mb, int ctrl)
+{
+    submit(mb_k, clos, 0, {mb, (uint64_t)ctrl});
+}
+
+void Actuators::pin_vcpu(const VMTask &vm, uint32_t vcpu,
+                         const std::vector<uint32_t> &cpus)
+{
+    auto value = std::vector<uint64_t>(cpus.begin(), cpus.end());
+    std::sort(value.begin(), value.end());
+    submit(pin_k, vm.id, vcpu, value);
+}
+
+void Actuators::pin_vcpus(const VMTask &vm, const std::vector<uint32_t> &cpus)
+{
+    for (uint32_t vcpu = 0; vcpu < vm.cpus.size(); vcpu++)
+        pin_vcpu(vm, vcpu, cpus);
+}
+
+void Actuators::set_iotune(const VMTask &vm, unsigned long long bytes_sec,
+                           unsigned long long iops_sec)
+{
+    submit(iotune_k, vm.id, 0, {bytes_sec, iops_sec});
+}
+
+void Actuators::set_net(const VMTask &vm, unsigned long long in_rate,
+                        unsigned long long in_burst,
+                        unsigned long long out_rate,
+                        unsigned long long out_burst)
+{
+    submit(net_k, vm.id, 0, {in_rate, in_burst, out_rate, out_burst});
+}
+
+void Actuators::set_cpu_quota(const Task &task, double cores, uint64_t period)
+{
+    // Quota of the whole task in us every period
+    uint64_t quota = cores > 0 ? std::max<uint64_t>(cores * period, 1) : 0;
+    submit(cpu_k, task.id, 0, {quota, period});
+}
+
+void Actuators::set_balloon(const VMTask &vm, uint64_t mb)
+{
+    submit(mem_k, vm.id, 0, {mb});
+}
+
+void Actuators::write(const key_t &key, const std::vector<uint64_t> &value,
+                      Task *task)
+{
+    uint32_t id = std::get<1>(key);
+    auto vm = dynamic_cast<VMTask *>(task);
+    switch (std::get<0>(key)) {
+    case cbm_k:
+        cat->set_cbm(id, 0, value[0], 0);
+        break;
+    case mb_k: {
+        unsigned actual = cat->set_mb(id, 0, value[1], value[0]);
+        LOGDEB("ACT: CLOS {} MBA limit {} (actual {}) {}"_format(
+            id, value[0], actual, value[1] ? "MBps" : "%"));
+        break;
+    }
+    case pin_k:
+        vm->task_pin_vcpu(std::get<2>(key),
+                          std::vector<uint32_t>(value.begin(), value.end()));
+        break;
+    case iotune_k:
+        vm->diskUtils.set_iotune(vm->dom, value[0], value[1]);
+        break;
+    case net_k:
+        net_setVmLimit(*vm, value[0], value[1], value[2], value[3]);
+        break;
+    case cpu_k:
+        cpu_quota().set_quota(*task, (double)value[0] / value[1], value[1]);
+        break;
+    case mem_k:
+        memory_monitor().set_balloon(*vm, value[0]);
+        break;
+    default:
+        break;
+    }
+}
+
+void Actuators::account(kind_t kind, double latency)
+{
+    stats_t &s = stats[kind];
+    s.writes++;
+    s.latency += latency;
+    s.max_latency = std::max(s.max_latency, latency);
+}
+
+size_t Actuators::commit(const Task::tasklist_t &tasklist)
+{
+    if (!cat)
+        throw_with_trace(std::runtime_error(
+            "The actuators need the RDT interface before the first commit"));
+
+    auto tasks = std::map<uint32_t, Task *>();
+    for (const auto &task_ptr : tasklist)
+        tasks[task_ptr->id] = task_ptr.get();
+
+    size_t result = 0;
+    bool net = false;
+    auto now = clock_t::now();
+    for (auto it = knobs.begin(); it != knobs.end();) {
+        kind_t kind = std::get<0>(it->first);
+        knob_t &knob = it->second;
+        Task *task = nullptr;
+        if (kind != cbm_k && kind != mb_k) {
+            auto t = tasks.find(std::get<1>(it->first));
+            if (t == tasks.end()) {
+                it = knobs.erase(it);
+                continue;
+            }
+            task = t->second;
+        }
+
+        if (!knob.pending) {
+            it++;
+            continue;
+        }
+        if (knob.written && knob.value == knob.applied) {
+            stats[kind].dropped++;
+            knob.pending = false;
+            it++;
+            continue;
+        }
+        if (knob.written &&
+            std::chrono::duration<double>(now - knob.last_write).count() <
+                dwell[kind]) {
+            stats[kind].deferred++;
+            it++;
+            continue;
+        }
+
+        // A failed write is not retried until the value changes
+        auto t0 = clock_t::now();
+        knob.pending = false;
+        try {
+            write(it->first, knob.value, task);
+        } catch (const std::exception &e) {
+            stats[kind].errors++;
+            LOGWAR("ACT: {} write to {}/{} failed: {}"_format(
+                actuator_kind_name(kind), std::get<1>(it->first),
+                std::get<2>(it->first), e.what()));
+            it++;
+            continue;
+        }
+        account(kind, std::chrono::duration<double>(clock_t::now() - t0)
+                          .count());
+        if (settle && kind == cbm_k)
+            settle->watch(SettleMonitor::cbm_k, std::get<1>(it->first),
+                          __builtin_popcountll(knob.value[0]) *
+                              cat->get_l3_way_size() / 1024.0 / 1024,
+                          tasklist);
+        else if (settle && kind == mb_k && knob.value[1] == 1)
+            settle->watch(SettleMonitor::mb_k, std::get<1>(it->first),
+                          knob.value[0], tasklist);
+        knob.applied = knob.value;
+        knob.written = true;
+        knob.last_write = t0;
+        net = net || kind == net_k;
+        result++;
+        it++;
+    }
+
+    // The network rates only take effect with the transaction
+    if (net) {
+        auto t0 = clock_t::now();
+        net_commitLimits();
+        stats[net_k].latency +=
+            std::chrono::duration<double>(clock_t::now() - t0).count();
+    }
+
+    num_batches++;
+    if (result)
+        LOGDEB("ACT: batch {}, {} writes"_format(num_batches, result));
+    return result;
+}
+
+void Actuators::print_stats() const
+{
+    double elapsed =
+        std::chrono::duration<double>(clock_t::now() - start).count();
+    for (int k = 0; k < num_kinds; k++) {
+        const stats_t &s = stats[k];
+        if (s.submitted == 0)
+            continue;
+        LOGINF("ACT: {}: {} submitted, {} writes ({:.2f}/s), {:.3f} ms per "
+               "write (max {:.3f} ms), {} dropped, {} deferred, {} "
+               "conflicts, {} errors"_format(
+                   actuator_kind_name((kind_t)k), s.submitted, s.writes,
+                   elapsed > 0 ? s.writes / elapsed : 0,
+                   s.writes ? s.latency / s.writes * 1000 : 0,
+                   s.max_latency * 1000, s.dropped, s.deferred, s.conflicts,
+                   s.errors));
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "intel-rdt.hpp"
+#include "settle.hpp"
+#include "task.hpp"
+#include "vm-task.hpp"
+
+// Desired states of the knobs of the system (CLOS masks and MBA limits, vCPU
+// pinning, disk iotune, network rates, CPU quotas and balloons), submitted by
+// the policies and written in a batch by commit() once per interval.
+// Submissions to the same knob in a batch are merged: limits take the most
+// restrictive value and masks and pinnings the first one, the others counting
+// as conflicts. Writes that would not change the last state written are
+// dropped, and a knob is not written again before the minimum dwell time of
+// its kind, the change being kept pending until then. The network rates are
+// sent in a single OVSDB transaction per batch.
+class Actuators
+{
+  public:
+    enum kind_t {
+        cbm_k,
+        mb_k,
+        pin_k,
+        iotune_k,
+        net_k,
+        cpu_k,
+        mem_k,
+        num_kinds
+    };
+    typedef std::array<double, num_kinds> dwell_t; // Seconds
+
+  protected:
+    typedef std::chrono::steady_clock clock_t;
+    // Kind, CLOS or task id, and vCPU for the pinnings
+    typedef std::tuple<kind_t, uint32_t, uint32_t> key_t;
+
+    struct knob_t {
+        std::vector<uint64_t> value;   // Desired
+        std::vector<uint64_t> applied; // Last written
+        bool pending = false;
+        bool written = false;
+        uint64_t batch = 0; // Of the last submission
+        clock_t::time_point last_write;
+    };
+    struct stats_t {
+        uint64_t submitted = 0;
+        uint64_t writes = 0;
+        uint64_t dropped = 0;  // Would not change the state
+        uint64_t deferred = 0; // Batches waiting for the dwell time
+        uint64_t conflicts = 0;
+        uint64_t errors = 0;
+        double latency = 0;     // Seconds, all the writes
+        double max_latency = 0; // Seconds
+    };
+
+    std::shared_ptr<IntelRDT> cat;
+    std::shared_ptr<SettleMonitor> settle;
+    dwell_t dwell;
+    std::map<key_t, knob_t> knobs;
+    std::array<stats_t, num_kinds> stats;
+    clock_t::time_point start;
+    uint64_t num_batches = 0;
+
+    void submit(kind_t kind, uint32_t id, uint32_t sub,
+                const std::vector<uint64_t> &value);
+    void write(const key_t &key, const std::vector<uint64_t> &value,
+               Task *task);
+    void account(kind_t kind, double latency);
+
+  public:
+    Actuators(const dwell_t &_dwell) : dwell(_dwell), start(clock_t::now())
+    {
+    }
+
+    void set_cat(std::shared_ptr<IntelRDT> _cat)
+    {
+        cat = _cat;
+    }
+
+    // Follows the mask and MBA (in MBps) changes written until they settle,
+    // if enabled
+    void set_settle(std::shared_ptr<SettleMonitor> _settle)
+    {
+        settle = _settle;
+    }
+    std::shared_ptr<SettleMonitor> get_settle()
+    {
+        return settle;
+    }
+
+    // Limits are in MBps if ctrl is 1, in % if it is 0
+    void set_cbm(uint32_t clos, uint64_t mask);
+    void set_mb(uint32_t clos, unsigned mb, int ctrl = 1);
+    void pin_vcpu(const VMTask &vm, uint32_t vcpu,
+                  const std::vector<uint32_t> &cpus);
+    void pin_vcpus(const VMTask &vm, const std::vector<uint32_t> &cpus);
+    // Bytes and operations per second, 0 removes the limit
+    void set_iotune(const VMTask &vm, unsigned long long bytes_sec,
+                    unsigned long long iops_sec);
+    // Rates in kbps and bursts in kb, 0 disables them
+    void set_net(const VMTask &vm, unsigned long long in_rate,
+                 unsigned long long in_burst, unsigned long long out_rate,
+                 unsigned long long out_burst);
+    // CFS bandwidth of the whole task in cores, 0 removes the limit
+    void set_cpu_quota(const Task &task, double cores,
+                       uint64_t period = 100000);
+    // Balloon size in MB
+    void set_balloon(const VMTask &vm, uint64_t mb);
+
+    // Writes the pending changes that are due, returns how many. The knobs
+    // of the tasks that are not in the list anymore are forgotten.
+    size_t commit(const Task::tasklist_t &tasklist);
+
+    // Write rates, latencies and the rest of the counters of each kind
+    void print_stats() const;
+};
+
+const char *actuator_kind_name(Actuators::kind_t kind);
@@ -281,7 +281,8 @@ void AppTask::task_start_to_execute()
 
 void AppTask::task_restart_or_set_done(std::shared_ptr<IntelRDT> cat,
                                        Perf &perf,
-                                       const std::vector<std::string> &events)
+                                       const std::vector<std::string> &events,
+                                       uint32_t clos)
 {
     const auto statusTask = Task::get_status();
 
@@ -312,15 +313,18 @@ void AppTask::task_restart_or_set_done(std::shared_ptr<IntelRDT> cat,
                 if (cat) {
                     LOGDEB(
                         "Task {}:{} was in CLOS {}, ensure it still is after restart"_format(
-                            pids[num_cpu], name, initial_clos));
-                    assert(initial_clos < cat->get_max_closids() &&
-                           initial_clos >= 0);
+                            pids[num_cpu], name, clos));
+                    assert(clos < cat->get_max_closids());
                     AppTask::task_restart();
 					if (perf.get_perf_type() == "PID") {
-                    	cat->add_task(initial_clos, pids[num_cpu]);
-                    	cat->monitor_setup_pid(pids[num_cpu]);
+                    	cat->add_task(clos, pids[num_cpu]);
+                    	// The old pid left its group above, the new one
+                    	// joins the group of the task or CLOS if any
+                    	cat->monitor_setup_task_pid(
+                    	    pids[num_cpu],
+                    	    std::vector<pid_t>(pids, pids + cpus.size()), clos);
 					} else if (perf.get_perf_type() == "CPU") {
-                    	cat->add_cpu(initial_clos, *it);
+                    	cat->add_cpu(clos, *it);
                     	cat->monitor_setup_core(*it);
 					}
                 } else {
@@ -348,6 +352,7 @@ void AppTask::task_stats_print_headers(std::ostream &out_stream,
     out_stream << "app" << sep;
     out_stream << "CPU" << sep;
     out_stream << "total_CPU%" << sep;
+    out_stream << "L2_mask" << sep;
     out_stream << "compl" << sep;
     out_stream << stats[0].header_to_string(sep);
     out_stream << std::endl;
@@ -360,7 +365,8 @@ void AppTask::task_stats_print_interval(uint64_t interval,
 	    for (uint32_t i = 0; i < cpus.size(); i++) {
         out_stream << interval << sep << std::setfill('0') << std::setw(2);
         out_stream << id << "_" << name << sep << cpus[i] << sep
-                   << Task::total_cpu_util.at(cpus[i]) << sep;
+                   << Task::total_cpu_util.at(cpus[i]) << sep
+                   << "0x{:x}"_format(l2_mask[cpus[i]]) << sep;
 
         double completed_inst =
             max_instr
@@ -416,7 +422,8 @@ void AppTask::task_stats_print_total(uint64_t interval,
     for (auto it = cpus.begin(); it != cpus.end(); ++it) {
         out_stream << interval << sep << std::setfill('0') << std::setw(2);
         out_stream << id << "_" << name << sep << *it << sep
-                   << Task::total_cpu_util.at(*it) << sep;
+                   << Task::total_cpu_util.at(*it) << sep
+                   << "0x{:x}"_format(l2_mask[*it]) << sep;
 
         if (num_cpu < cpus.size()) {
             double completed_inst =
@@ -55,7 +55,8 @@ class AppTask : public Task
     int get_cpu_id(pid_t pid) override;
     void
     task_restart_or_set_done(std::shared_ptr<IntelRDT> cat, Perf &perf,
-                             const std::vector<std::string> &events) override;
+                             const std::vector<std::string> &events,
+                             uint32_t clos) override;
     // Stats
     void task_stats_print_headers(std::ostream &out_stream,
                                   const std::string &sep = ",") override;
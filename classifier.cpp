@@ -0,0 +1,191 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <fmt/format.h>
+
+#include "classifier.hpp"
+#include "log.hpp"
+#include "policy.hpp"
+#include "throw-with-trace.hpp"
+
+namespace acc = boost::accumulators;
+using fmt::literals::operator""_format;
+using cat::policy::cycles_event;
+using cat::policy::inst_event;
+using cat::policy::task_rdt;
+using cat::policy::task_sum;
+
+static const char *vm_categories_map[] = {"Invalid", "CPU/Mem", "CPU/Mem Low",
+                                          "Disk",    "Disk RD", "Disk WR",
+                                          "Network", "Unknown"};
+
+const char *vm_category_name(vm_categories cat)
+{
+    return vm_categories_map[cat];
+}
+
+VmClassifier::VmClassifier(const ClassifierThresholds &_thr,
+                           uint64_t _min_samples, uint64_t _confirm)
+    : thr(_thr), min_samples(_min_samples), confirm(_confirm)
+{
+}
+
+// Fraction of the cycles of the VM spent in the given event
+static double cycles_share(const VMTask &vm, const char *name)
+{
+    double cycles = task_sum(vm, cycles_event(vm));
+    return cycles > 0 && vm.stats[0].has(name) ? task_sum(vm, name) / cycles
+                                               : 0;
+}
+
+static double mpki(const VMTask &vm, const char *name, double inst)
+{
+    return inst > 0 && vm.stats[0].has(name) ? task_sum(vm, name) / inst * 1000
+                                             : 0;
+}
+
+void VmClassifier::accumulate(VMTask &vm, double interval_time)
+{
+    // CPU time of the VM on its cpus, and of the host in guest and idle mode
+    double util = 0, guest = 0, idle = 0;
+    for (auto cpu : vm.cpus) {
+        util += vm.vm_cpu_util.count(cpu) ? vm.vm_cpu_util[cpu] : 0;
+        auto g = vm.total_time_util.find(std::make_pair("guest", cpu));
+        guest += g != vm.total_time_util.end() ? g->second : 0;
+        auto i = vm.total_time_util.find(std::make_pair("idle", cpu));
+        idle += i != vm.total_time_util.end() ? i->second : 0;
+    }
+    size_t ncpus = std::max<size_t>(vm.cpus.size(), 1);
+    vm.acc_cpu(util);
+    vm.acc_mean_cpu(util / ncpus);
+    vm.acc_guest(guest / ncpus);
+    vm.acc_idle(idle / ncpus);
+
+    double inst = task_sum(vm, inst_event(vm));
+    double cycles = task_sum(vm, cycles_event(vm));
+    vm.acc_gips(interval_time > 0 ? inst / interval_time / 1e9 : 0);
+    vm.acc_ipc(cycles > 0 ? inst / cycles : 0);
+    vm.acc_l1mpki(mpki(vm, "mem_load_retired.l1_miss", inst));
+    vm.acc_l2mpki(mpki(vm, "mem_load_retired.l2_miss", inst));
+    vm.acc_l3mpki(mpki(vm, "mem_load_retired.l3_miss", inst));
+
+    // The vCPUs in the same monitoring group report the values of the group
+    vm.acc_membw(task_rdt(vm, *cat, "MBT[MBps]"));
+    vm.acc_llcocc(task_rdt(vm, *cat, "LLC_occup[MB]"));
+
+    double mem = cycles_share(vm, "cycle_activity.stalls_mem_any");
+    double total = cycles_share(vm, "cycle_activity.stalls_total");
+    vm.acc_stallsmem(mem);
+    vm.acc_stallstot(total);
+    vm.acc_stallscore(std::max(total - mem, 0.0));
+    vm.acc_membound(mem);
+    vm.acc_corebound(std::max(total - mem, 0.0));
+
+    // Disk and network of the whole VM
+    double ti = interval_time > 0 ? interval_time : 1;
+    double rd = vm.diskUtils.get_read_bytes_sec_q() / ti / 1024 / 1024;
+    double wr = vm.diskUtils.get_write_bytes_sec_q() / ti / 1024 / 1024;
+    vm.acc_disk(rd);
+    vm.acc_diskbw(rd + wr);
+    vm.acc_net_tx(vm.ovs_bwtx);
+    vm.acc_net_rx(vm.ovs_bwrx);
+    vm.acc_network(vm.ovs_bwtx + vm.ovs_bwrx);
+}
+
+vm_categories VmClassifier::classify(const VMTask &vm) const
+{
+    // KB/s to Kbps
+    double net = acc::rolling_mean(vm.acc_network) * 1024 * 8 / 1000;
+    double disk = acc::rolling_mean(vm.acc_diskbw);
+    double reads = acc::rolling_mean(vm.acc_disk);
+    double cpu = acc::rolling_mean(vm.acc_mean_cpu);
+
+    if (net >= thr.net_kbps)
+        return vm_cat_network;
+    if (disk >= thr.disk_mbps) {
+        if (reads >= thr.rw_ratio * disk)
+            return vm_cat_disk_rd;
+        if (reads <= (1 - thr.rw_ratio) * disk)
+            return vm_cat_disk_wr;
+        return vm_cat_disk;
+    }
+    if (cpu >= thr.cpu_util) {
+        bool memory = acc::rolling_mean(vm.acc_l3mpki) >= thr.l3_mpki ||
+                      acc::rolling_mean(vm.acc_membw) >= thr.membw_mbps;
+        return memory ? vm_cat_cpu_mem : vm_cat_cpu_mem_low;
+    }
+    if (cpu >= thr.idle_util)
+        return vm_cat_cpu_mem_low;
+    return vm_cat_unknown;
+}
+
+void VmClassifier::set_cat(std::shared_ptr<IntelRDT> _cat)
+{
+    cat = _cat;
+}
+
+void VmClassifier::update(uint64_t interval, double interval_time,
+                          const Task::tasklist_t &tasklist)
+{
+    if (!cat)
+        throw_with_trace(std::runtime_error(
+            "The VM classifier needs the cat to read the RDT values"));
+
+    for (const auto &task_ptr : tasklist) {
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        if (!vm)
+            continue;
+
+        accumulate(*vm, interval_time);
+
+        state_t &st = states[vm->id];
+        if (++st.samples < min_samples)
+            continue;
+
+        vm_categories now = classify(*vm);
+        if (now == vm->vm_cat) {
+            st.streak = 0;
+            continue;
+        }
+        if (now != st.candidate) {
+            st.candidate = now;
+            st.streak = 0;
+        }
+        // The first category is taken right away
+        if (++st.streak < confirm && vm->vm_cat != vm_cat_invalid)
+            continue;
+
+        vm_categories from = vm->vm_cat;
+        vm->vm_cat = now;
+        st.streak = 0;
+        num_transitions++;
+        LOGINF("CLASSIFIER: interval {}: VM {} from {} to {}"_format(
+            interval, vm->name, vm_category_name(from),
+            vm_category_name(now)));
+        for (const auto &listener : listeners)
+            listener(*vm, from, now, interval);
+    }
+}
+
+void VmClassifier::subscribe(listener_t listener)
+{
+    listeners.push_back(listener);
+}
+
+uint64_t VmClassifier::get_num_transitions() const
+{
+    return num_transitions;
+}
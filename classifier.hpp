@@ -0,0 +1,83 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "task.hpp"
+#include "vm-task.hpp"
+
+const char *vm_category_name(vm_categories cat);
+
+// Thresholds on the rolling means of the metrics of a VM
+struct ClassifierThresholds {
+    double net_kbps = 10000;  // OVS Rx + Tx (Kbps) to be Network
+    double disk_mbps = 20;    // Disk read + write to be Disk
+    double rw_ratio = 0.7;    // Share of reads (writes) to be Disk RD (WR)
+    double cpu_util = 50;     // Mean vCPU utilization (%) to be CPU/Mem
+    double l3_mpki = 1;       // L3 MPKI to be memory intensive...
+    double membw_mbps = 1000; // ...or memory BW
+    double idle_util = 5;     // Below this the VM is Unknown (idle)
+};
+
+// Classifies the VMs online. Every interval it feeds the accumulators of each
+// VM from its stats (acc_disk holds the read MB/s and acc_diskbw the total
+// MB/s) and classifies it from their rolling means. A VM only changes its
+// category after the new one is seen for some consecutive intervals, and each
+// change is notified to the subscribers.
+class VmClassifier
+{
+  public:
+    typedef std::function<void(const VMTask &vm, vm_categories from,
+                               vm_categories to, uint64_t interval)>
+        listener_t;
+
+  private:
+    ClassifierThresholds thr;
+    uint64_t min_samples; // Intervals before classifying a VM
+    uint64_t confirm;     // Intervals a new category has to last
+
+    // To split the RDT values of the pids sharing a monitoring group
+    std::shared_ptr<IntelRDT> cat;
+
+    struct state_t {
+        uint64_t samples = 0;
+        vm_categories candidate = vm_cat_invalid;
+        uint64_t streak = 0;
+    };
+    std::map<uint32_t, state_t> states;
+    std::vector<listener_t> listeners;
+    uint64_t num_transitions = 0;
+
+    void accumulate(VMTask &vm, double interval_time);
+    vm_categories classify(const VMTask &vm) const;
+
+  public:
+    VmClassifier(const ClassifierThresholds &_thr, uint64_t _min_samples = 5,
+                 uint64_t _confirm = 3);
+
+    void set_cat(std::shared_ptr<IntelRDT> _cat);
+    void update(uint64_t interval, double interval_time,
+                const Task::tasklist_t &tasklist);
+    void subscribe(listener_t listener);
+
+    uint64_t get_num_transitions() const;
+};
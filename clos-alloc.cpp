@@ -0,0 +1,336 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fmt/format.h>
+#include <limits>
+#include <tuple>
+
+#include "clos-alloc.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+using fmt::literals::operator""_format;
+
+// MBA value used for unlimited CLOS when the MBps controller is in use
+static const unsigned mba_unlimited = std::numeric_limits<uint32_t>::max();
+
+ClosAllocator::ClosAllocator(std::shared_ptr<IntelRDT> _cat, bool _by_pid,
+                             uint32_t _num_ways, uint32_t _way_tolerance,
+                             int _mbps_tolerance, uint32_t _num_reserved)
+    : cat(_cat), by_pid(_by_pid), num_ways(_num_ways),
+      way_tolerance(_way_tolerance), mbps_tolerance(_mbps_tolerance)
+{
+    if (!cat)
+        throw_with_trace(std::runtime_error(
+            "The CLOS allocator needs an initialized IntelRDT object"));
+
+    // CLOS 0 is kept as the default class
+    if (cat->get_max_closids() <= _num_reserved + 1)
+        throw_with_trace(std::runtime_error(
+            "Not enough CLOS to reserve {}"_format(_num_reserved)));
+    num_clos = cat->get_max_closids() - 1 - _num_reserved;
+    LOGINF("CLOS allocator: CLOS 1-{} available"_format(num_clos));
+}
+
+double ClosAllocator::distance(const ClosRequest &a, const ClosRequest &b) const
+{
+    double d = std::abs((double)a.ways - (double)b.ways) / num_ways;
+
+    if ((a.mbps < 0) != (b.mbps < 0))
+        d += 1;
+    else if (a.mbps >= 0)
+        d += std::abs(a.mbps - b.mbps) / (double)std::max(a.mbps, b.mbps);
+
+    return d;
+}
+
+bool ClosAllocator::compatible(const ClosRequest &a,
+                               const ClosRequest &b) const
+{
+    uint32_t dways = a.ways > b.ways ? a.ways - b.ways : b.ways - a.ways;
+    if (dways > way_tolerance)
+        return false;
+    if (a.mbps < 0 || b.mbps < 0)
+        return a.mbps == b.mbps;
+    return std::abs(a.mbps - b.mbps) <= mbps_tolerance;
+}
+
+// Groups tasks with the same request, then merges the closest groups while
+// they are compatible or while there are more groups than CLOS. Merged groups
+// get the largest of both allocations, so no task gets less than it asked.
+ClosAllocator::groups_t
+ClosAllocator::cluster(const std::map<uint32_t, ClosRequest> &requests) const
+{
+    groups_t groups;
+
+    for (const auto &req : requests) {
+        auto it = std::find_if(groups.begin(), groups.end(),
+                               [&req](const auto &g) {
+                                   return g.first == req.second;
+                               });
+        if (it == groups.end())
+            groups.push_back({req.second, {req.first}});
+        else
+            it->second.insert(req.first);
+    }
+
+    while (groups.size() > 1) {
+        size_t best_i = 0, best_j = 1;
+        double best_d = std::numeric_limits<double>::max();
+        for (size_t i = 0; i < groups.size(); i++)
+            for (size_t j = i + 1; j < groups.size(); j++) {
+                double d = distance(groups[i].first, groups[j].first);
+                if (d < best_d) {
+                    best_d = d;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+
+        auto &gi = groups[best_i];
+        auto &gj = groups[best_j];
+        if (groups.size() <= num_clos && !compatible(gi.first, gj.first))
+            break;
+
+        gi.first.ways = std::max(gi.first.ways, gj.first.ways);
+        if (gi.first.mbps < 0 || gj.first.mbps < 0)
+            gi.first.mbps = -1;
+        else
+            gi.first.mbps = std::max(gi.first.mbps, gj.first.mbps);
+        gi.second.insert(gj.second.begin(), gj.second.end());
+        groups.erase(groups.begin() + best_j);
+    }
+
+    return groups;
+}
+
+// Gives each group a contiguous set of ways. If the ways requested fit in the
+// cache the groups are isolated, otherwise the masks overlap, all of them
+// aligned to the highest way.
+std::vector<uint64_t> ClosAllocator::layout(const groups_t &groups) const
+{
+    std::vector<uint64_t> masks;
+    uint32_t total = 0;
+    for (const auto &g : groups)
+        total += std::min(std::max(g.first.ways, 1U), num_ways);
+
+    uint32_t first = 0;
+    for (const auto &g : groups) {
+        uint32_t ways = std::min(std::max(g.first.ways, 1U), num_ways);
+        uint64_t mask = (1ULL << ways) - 1;
+        if (total <= num_ways) {
+            masks.push_back(mask << first);
+            first += ways;
+        } else
+            masks.push_back(mask << (num_ways - ways));
+    }
+
+    return masks;
+}
+
+void ClosAllocator::associate(const Task &task, uint32_t clos_id)
+{
+    auto pids = std::vector<pid_t>();
+
+    for (uint32_t i = 0; i < task.cpus.size(); i++) {
+        if (by_pid) {
+            if (task.pids[i] <= 0)
+                continue;
+            cat->add_task(clos_id, task.pids[i]);
+            pids.push_back(task.pids[i]);
+        } else
+            cat->add_cpu(clos_id, task.cpus[i]);
+        num_assoc++;
+    }
+
+    task_clos[task.id] = clos_id;
+    task_pids[task.id] = pids;
+    LOGINF("Task {}:{} mapped to CLOS {}"_format(task.id, task.name, clos_id));
+}
+
+/*
+ * @brief Maps the tasks onto the CLOS according to their requested
+ * allocations. Only the masks, MBA values and associations that change are
+ * written.
+ *
+ * @param [in] tasklist tasks being executed
+ * @param [in] requests allocation requested by each task id. Tasks without
+ * request are not managed by the allocator.
+ */
+void ClosAllocator::apply(const Task::tasklist_t &tasklist,
+                          const std::map<uint32_t, ClosRequest> &requests)
+{
+    const uint64_t assoc_before = num_assoc;
+    const uint64_t config_before = num_config;
+
+    auto groups = cluster(requests);
+
+    // Keep the CLOS id of the group that shares more tasks with the new one
+    auto candidates = std::vector<std::tuple<size_t, size_t, uint32_t>>();
+    for (size_t g = 0; g < groups.size(); g++)
+        for (const auto &c : clos) {
+            size_t common = 0;
+            for (const auto &id : groups[g].second)
+                common += c.second.tasks.count(id);
+            if (common > 0)
+                candidates.push_back(std::make_tuple(common, g, c.first));
+        }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const auto &a, const auto &b) {
+                  return std::get<0>(a) > std::get<0>(b);
+              });
+
+    auto group_clos = std::vector<uint32_t>(groups.size(), 0);
+    auto used = std::set<uint32_t>();
+    for (const auto &cand : candidates) {
+        size_t g = std::get<1>(cand);
+        uint32_t c = std::get<2>(cand);
+        if (group_clos[g] == 0 && !used.count(c)) {
+            group_clos[g] = c;
+            used.insert(c);
+        }
+    }
+
+    // New groups take the free CLOS
+    uint32_t next = 1;
+    for (size_t g = 0; g < groups.size(); g++) {
+        if (group_clos[g] != 0)
+            continue;
+        while (used.count(next))
+            next++;
+        assert(next <= num_clos);
+        group_clos[g] = next;
+        used.insert(next);
+    }
+
+    // Configure masks and MBA of the CLOS that change
+    auto masks = layout(groups);
+    auto new_clos = std::map<uint32_t, clos_t>();
+    for (size_t g = 0; g < groups.size(); g++) {
+        const uint32_t c = group_clos[g];
+        const auto &alloc = groups[g].first;
+        const auto old = clos.find(c);
+
+        if (old == clos.end() || old->second.mask != masks[g]) {
+            cat->set_cbm(c, 0, masks[g], 0);
+            num_config++;
+        }
+
+        bool mb_changed = (old == clos.end())
+                              ? alloc.mbps >= 0
+                              : old->second.alloc.mbps != alloc.mbps;
+        if (mb_changed) {
+            cat->set_mb(c, 0, 1, alloc.mbps >= 0 ? alloc.mbps : mba_unlimited);
+            num_config++;
+        }
+
+        new_clos[c] = {alloc, masks[g], groups[g].second};
+    }
+    clos = new_clos;
+
+    // Associate the tasks whose CLOS or pids have changed
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        if (!requests.count(task.id))
+            continue;
+
+        uint32_t c = 0;
+        for (size_t g = 0; g < groups.size(); g++)
+            if (groups[g].second.count(task.id))
+                c = group_clos[g];
+
+        bool pids_changed = false;
+        if (by_pid) {
+            auto pids = std::vector<pid_t>();
+            for (uint32_t i = 0; i < task.cpus.size(); i++)
+                if (task.pids[i] > 0)
+                    pids.push_back(task.pids[i]);
+            pids_changed = (task_pids[task.id] != pids);
+        }
+
+        auto it = task_clos.find(task.id);
+        if (it == task_clos.end() || it->second != c || pids_changed)
+            associate(task, c);
+    }
+
+    // Forget tasks that are no longer managed
+    for (auto it = task_clos.begin(); it != task_clos.end();) {
+        if (!requests.count(it->first)) {
+            task_pids.erase(it->first);
+            it = task_clos.erase(it);
+        } else
+            ++it;
+    }
+
+    LOGINF("CLOS allocator: {} requests on {} CLOS, {} association and {} "
+           "configuration calls"_format(requests.size(), clos.size(),
+                                        num_assoc - assoc_before,
+                                        num_config - config_before));
+}
+
+void ClosAllocator::adopt(const ClosAllocator &other)
+{
+    clos = other.clos;
+    task_clos = other.task_clos;
+    task_pids = other.task_pids;
+}
+
+bool ClosAllocator::is_by_pid() const
+{
+    return by_pid;
+}
+
+bool ClosAllocator::has_task(uint32_t task_id) const
+{
+    return task_clos.count(task_id) > 0;
+}
+
+uint32_t ClosAllocator::get_clos(uint32_t task_id) const
+{
+    auto it = task_clos.find(task_id);
+    if (it == task_clos.end())
+        throw_with_trace(std::runtime_error(
+            "Task {} is not managed by the CLOS allocator"_format(task_id)));
+    return it->second;
+}
+
+ClosRequest ClosAllocator::get_alloc(uint32_t clos_id) const
+{
+    return clos.at(clos_id).alloc;
+}
+
+uint64_t ClosAllocator::get_mask(uint32_t clos_id) const
+{
+    return clos.at(clos_id).mask;
+}
+
+uint32_t ClosAllocator::get_num_clos() const
+{
+    return num_clos;
+}
+
+uint64_t ClosAllocator::get_num_assoc() const
+{
+    return num_assoc;
+}
+
+uint64_t ClosAllocator::get_num_config() const
+{
+    return num_config;
+}
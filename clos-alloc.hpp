@@ -0,0 +1,96 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "intel-rdt.hpp"
+#include "task.hpp"
+
+// Allocation wanted by a task
+struct ClosRequest {
+    uint32_t ways = 0; // Number of LLC ways
+    int mbps = -1;     // Memory BW in MBps (-1 = unlimited)
+
+    bool operator==(const ClosRequest &o) const
+    {
+        return ways == o.ways && mbps == o.mbps;
+    }
+    bool operator!=(const ClosRequest &o) const
+    {
+        return !(*this == o);
+    }
+};
+
+// Maps the allocations wanted by the tasks onto the hardware CLOS. Tasks with
+// compatible allocations share a CLOS, and when there are more allocations
+// than CLOS the closest ones are merged. CLOS 0 is left as the default class
+// for the rest of the system, the remaining ones are owned by the allocator
+// except for the highest reserved ones (e.g. the MRC profiling CLOS).
+class ClosAllocator
+{
+    struct clos_t {
+        ClosRequest alloc;
+        uint64_t mask = 0;
+        std::set<uint32_t> tasks; // Task ids
+    };
+
+    std::shared_ptr<IntelRDT> cat;
+    bool by_pid;           // Associate pids (PID mode) or cores (CPU mode)
+    uint32_t num_ways;     // Ways of the LLC
+    uint32_t way_tolerance;
+    int mbps_tolerance;
+    uint32_t num_clos = 0; // Usable CLOS, from 1 to num_clos
+
+    std::map<uint32_t, clos_t> clos;                  // CLOS in use
+    std::map<uint32_t, uint32_t> task_clos;           // Task id -> CLOS
+    std::map<uint32_t, std::vector<pid_t>> task_pids; // Associated pids
+    uint64_t num_assoc = 0;  // pqos association calls
+    uint64_t num_config = 0; // pqos mask and MBA calls
+
+    typedef std::vector<std::pair<ClosRequest, std::set<uint32_t>>> groups_t;
+
+    groups_t cluster(const std::map<uint32_t, ClosRequest> &requests) const;
+    std::vector<uint64_t> layout(const groups_t &groups) const;
+    double distance(const ClosRequest &a, const ClosRequest &b) const;
+    bool compatible(const ClosRequest &a, const ClosRequest &b) const;
+    void associate(const Task &task, uint32_t clos_id);
+
+  public:
+    ClosAllocator(std::shared_ptr<IntelRDT> _cat, bool _by_pid,
+                  uint32_t _num_ways, uint32_t _way_tolerance = 1,
+                  int _mbps_tolerance = 500, uint32_t _num_reserved = 0);
+
+    void apply(const Task::tasklist_t &tasklist,
+               const std::map<uint32_t, ClosRequest> &requests);
+    // Takes the CLOS and the placements of the tasks of another allocator
+    // over the same CLOS, whose writes were replayed on the hardware
+    void adopt(const ClosAllocator &other);
+
+    bool is_by_pid() const;
+    bool has_task(uint32_t task_id) const;
+    uint32_t get_clos(uint32_t task_id) const;
+    ClosRequest get_alloc(uint32_t clos_id) const;
+    uint64_t get_mask(uint32_t clos_id) const;
+    uint32_t get_num_clos() const;
+    uint64_t get_num_assoc() const;
+    uint64_t get_num_config() const;
+};
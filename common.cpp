@@ -221,6 +221,30 @@ void pid_get_children_rec(const pid_t pid, std::vector<pid_t> &children)
     }
 }
 
+// SMT siblings of a logical CPU, including itself
+std::vector<uint32_t> cpu_get_siblings(uint32_t cpu)
+{
+    auto siblings = std::vector<uint32_t>();
+    std::ifstream in(
+        "/sys/devices/system/cpu/cpu{}/topology/thread_siblings_list"_format(
+            cpu));
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        // Either "N" or "N-M"
+        size_t dash = range.find('-');
+        uint32_t first = std::stoul(range.substr(0, dash));
+        uint32_t last = dash == std::string::npos
+                            ? first
+                            : std::stoul(range.substr(dash + 1));
+        for (uint32_t c = first; c <= last; c++)
+            siblings.push_back(c);
+    }
+
+    if (siblings.empty())
+        siblings.push_back(cpu);
+    return siblings;
+}
+
 double getTemperatureCPU(uint32_t core)
 {
     uint32_t node;
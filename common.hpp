@@ -59,6 +59,7 @@ int get_self_cpu_id();
 void set_cpu_affinity(std::vector<uint32_t> cpus, pid_t pid = 0);
 void assert_dir_exists(const boost::filesystem::path &dir);
 void pid_get_children_rec(const pid_t pid, std::vector<pid_t> &children);
+std::vector<uint32_t> cpu_get_siblings(uint32_t cpu);
 
 // Get logical CPU utilzation
 double getTemperatureCPU(uint32_t core);
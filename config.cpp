@@ -17,6 +17,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <map>
+#include <set>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <fmt/format.h>
@@ -24,6 +25,8 @@
 
 #include "config.hpp"
 #include "log.hpp"
+#include "policy-async.hpp"
+#include "policy-plugin.hpp"
 
 #ifndef LIBVIRT_HEADERS_H
 #define LIBVIRT_HEADERS_H
@@ -40,6 +43,10 @@ using fmt::literals::operator""_format;
 static std::shared_ptr<cat::policy::Base>
 config_read_cat_policy(const YAML::Node &config);
 static vector<Cos> config_read_cos(const YAML::Node &config);
+static std::shared_ptr<MrcProfiler> config_read_mrc(const YAML::Node &mrc);
+static std::shared_ptr<VmClassifier>
+config_read_classifier(const YAML::Node &node);
+static std::shared_ptr<Actuators> config_read_actuators(const YAML::Node &node);
 static tasklist_t config_read_tasks(const YAML::Node &config);
 static YAML::Node merge(YAML::Node user, YAML::Node def);
 static void config_check_required_fields(const YAML::Node &node,
@@ -81,11 +88,49 @@ static void config_check_fields(const YAML::Node &node,
     }
 }
 
+// Actuators that a control loop of the multi policy can own
+static const std::set<string> actuator_names = {
+    "ways", "mba", "cores", "freq", "net", "disk", "pause", "cpu", "mem"};
+
+// Actuators driven by a policy, none known for the plugins
+static std::set<string> config_policy_actuators(const YAML::Node &policy)
+{
+    string kind = policy["kind"] ? policy["kind"].as<string>() : "plugin";
+    if (kind == "test" || kind == "bandit")
+        return {"ways", "mba"};
+    if (kind == "ucp")
+        return {"ways"};
+    if (kind == "mba")
+        return {"mba"};
+    if (kind == "disk")
+        return {"disk"};
+    if (kind == "power")
+        return {"freq"};
+    if (kind == "vcpu-pin" || kind == "vcpu-scale")
+        return {"cores"};
+    if (kind == "balloon")
+        return {"mem"};
+    if (kind == "slo")
+        return {"ways", "mba", "cores"};
+    if (kind == "joint")
+        return {"ways", "mba", "cores", "net", "disk"};
+    if (kind == "preempt")
+        return {policy["action"] &&
+                        policy["action"].as<string>() == "throttle"
+                    ? "freq"
+                    : "pause"};
+    return {};
+}
+
 static std::shared_ptr<cat::policy::Base>
 config_read_cat_policy(const YAML::Node &config)
 {
     YAML::Node policy = config["policy"];
 
+    // Policies loaded from a shared object only need the path
+    if (policy["path"] && !policy["kind"])
+        policy["kind"] = "plugin";
+
     if (!policy["kind"])
         throw_with_trace(
             std::runtime_error("The partitioning policy needs a 'kind' field"));
@@ -107,11 +152,600 @@ config_read_cat_policy(const YAML::Node &config)
         uint64_t every = policy["every"].as<uint64_t>();
 
         return std::make_shared<cat::policy::Test>(every);
+    } else if (kind == "ucp") {
+        LOGINF("Using UCP partitioning policy");
+
+        // Check that required fields exist
+        for (string field : {"every"}) {
+            if (!policy[field])
+                throw_with_trace(std::runtime_error("The '" + kind +
+                                                    "' policy needs the '" +
+                                                    field + "' field"));
+        }
+        // Read fields
+        uint64_t every = policy["every"].as<uint64_t>();
+        uint32_t min_ways = policy["min_ways"]
+                                ? policy["min_ways"].as<uint32_t>()
+                                : cat::min_num_ways;
+        double hysteresis = policy["hysteresis"]
+                                ? policy["hysteresis"].as<double>()
+                                : 0.05;
+        double alpha = policy["alpha"] ? policy["alpha"].as<double>() : 0.5;
+
+        if (min_ways == 0 || min_ways > cat::max_num_ways)
+            throw_with_trace(std::runtime_error(
+                "The 'min_ways' of the UCP policy must be in [1, {}]"_format(
+                    cat::max_num_ways)));
+
+        return std::make_shared<cat::policy::Ucp>(every, min_ways, hysteresis,
+                                                  alpha);
+    } else if (kind == "mba") {
+        LOGINF("Using MBA feedback policy");
+
+        // Read fields, limits are in MBps unless the controller is disabled
+        int ctrl = policy["ctrl"] ? policy["ctrl"].as<bool>() : 1;
+        unsigned min_mb = policy["min"] ? policy["min"].as<unsigned>()
+                                        : (ctrl ? 500 : 10);
+        unsigned max_mb = policy["max"] ? policy["max"].as<unsigned>()
+                                        : (ctrl ? 20000 : 100);
+        double step = policy["step"] ? policy["step"].as<double>() : 0.2;
+        double share =
+            policy["aggressor_share"] ? policy["aggressor_share"].as<double>()
+                                      : 0.2;
+        double ipc_drop =
+            policy["ipc_drop"] ? policy["ipc_drop"].as<double>() : 0.1;
+        double max_stalls =
+            policy["max_stalls"] ? policy["max_stalls"].as<double>() : 1;
+
+        if (min_mb == 0 || min_mb >= max_mb)
+            throw_with_trace(std::runtime_error(
+                "The 'min' of the MBA policy must be in (0, max)"));
+        if (step <= 0 || step >= 1)
+            throw_with_trace(std::runtime_error(
+                "The 'step' of the MBA policy must be in (0, 1)"));
+
+        return std::make_shared<cat::policy::MbaFeedback>(
+            ctrl, min_mb, max_mb, step, share, ipc_drop, max_stalls);
+    } else if (kind == "disk") {
+        LOGINF("Using disk I/O throttling policy");
+
+        if (!policy["bytes_sec"])
+            throw_with_trace(std::runtime_error(
+                "The 'disk' policy needs the 'bytes_sec' field"));
+
+        // Read fields
+        uint64_t every = policy["every"] ? policy["every"].as<uint64_t>() : 5;
+        double bytes_sec = policy["bytes_sec"].as<double>();
+        double iops_sec =
+            policy["iops_sec"] ? policy["iops_sec"].as<double>() : 0;
+        string mode =
+            policy["mode"] ? policy["mode"].as<string>() : "proportional";
+        double headroom =
+            policy["headroom"] ? policy["headroom"].as<double>() : 0.2;
+        double min_share =
+            policy["min_share"] ? policy["min_share"].as<double>() : 0.05;
+        double hysteresis =
+            policy["hysteresis"] ? policy["hysteresis"].as<double>() : 0.1;
+        double max_latency =
+            policy["max_latency"] ? policy["max_latency"].as<double>() : 0;
+        double step = policy["step"] ? policy["step"].as<double>() : 0.2;
+
+        if (every == 0)
+            throw_with_trace(std::runtime_error(
+                "The 'every' of the disk policy cannot be 0"));
+        if (mode != "proportional" && mode != "priority")
+            throw_with_trace(std::runtime_error(
+                "Unknown disk policy mode '" + mode +
+                "', valid options are 'proportional' and 'priority'"));
+        if (min_share < 0 || min_share > 1)
+            throw_with_trace(std::runtime_error(
+                "The 'min_share' of the disk policy must be in [0, 1]"));
+        if (step <= 0 || step >= 1)
+            throw_with_trace(std::runtime_error(
+                "The 'step' of the disk policy must be in (0, 1)"));
+
+        // The latency is given in ms per operation
+        return std::make_shared<cat::policy::DiskIo>(
+            every, bytes_sec, iops_sec, mode == "priority", headroom,
+            min_share, hysteresis, max_latency * 1000 * 1000, step);
+    } else if (kind == "power") {
+        LOGINF("Using power capping policy");
+
+        if (!policy["budget"])
+            throw_with_trace(std::runtime_error(
+                "The 'power' policy needs the 'budget' field"));
+
+        // Read fields, frequencies in MHz and power in W
+        uint64_t every = policy["every"] ? policy["every"].as<uint64_t>() : 1;
+        double budget = policy["budget"].as<double>();
+        uint64_t step =
+            policy["step"] ? policy["step"].as<uint64_t>() : 100;
+        uint64_t min_freq =
+            policy["min_freq"] ? policy["min_freq"].as<uint64_t>() : 0;
+        double margin =
+            policy["margin"] ? policy["margin"].as<double>() : 0.05;
+        double rapl = policy["rapl"] ? policy["rapl"].as<double>() : 0;
+
+        if (every == 0 || step == 0)
+            throw_with_trace(std::runtime_error(
+                "The 'every' and 'step' of the power policy cannot be 0"));
+        if (budget <= 0)
+            throw_with_trace(std::runtime_error(
+                "The 'budget' of the power policy must be positive"));
+
+        return std::make_shared<cat::policy::PowerCap>(
+            every, budget, step * 1000, min_freq * 1000, margin, rapl);
+    } else if (kind == "vcpu-pin") {
+        LOGINF("Using vCPU pinning policy");
+
+        // Read fields
+        uint64_t every = policy["every"] ? policy["every"].as<uint64_t>() : 1;
+        auto cores = policy["cores"] ? policy["cores"].as<vector<uint32_t>>()
+                                     : vector<uint32_t>();
+        double busy_util =
+            policy["busy_util"] ? policy["busy_util"].as<double>() : 50;
+        double max_stalls =
+            policy["max_stalls"] ? policy["max_stalls"].as<double>() : 0.4;
+        double max_temp =
+            policy["max_temp"] ? policy["max_temp"].as<double>() : 80;
+        uint32_t max_moves =
+            policy["max_moves"] ? policy["max_moves"].as<uint32_t>() : 2;
+        uint64_t cooldown =
+            policy["cooldown"] ? policy["cooldown"].as<uint64_t>() : 10;
+        double budget = policy["budget"] ? policy["budget"].as<double>() : 1;
+
+        if (every == 0)
+            throw_with_trace(std::runtime_error(
+                "The 'every' of the vCPU pinning policy cannot be 0"));
+        if (budget < 0 || budget > 100)
+            throw_with_trace(std::runtime_error(
+                "The 'budget' of the vCPU pinning policy must be in [0, 100]"));
+
+        return std::make_shared<cat::policy::VcpuPin>(
+            every, cores, busy_util, max_stalls, max_temp, max_moves, cooldown,
+            budget / 100);
+    } else if (kind == "slo") {
+        LOGINF("Using tail latency SLO policy");
+
+        // Read fields
+        uint64_t every = policy["every"] ? policy["every"].as<uint64_t>() : 1;
+        double slack = policy["slack"] ? policy["slack"].as<double>() : 0.2;
+        uint32_t lc_ways =
+            policy["lc_ways"] ? policy["lc_ways"].as<uint32_t>() : 2;
+        uint32_t min_ways =
+            policy["min_ways"] ? policy["min_ways"].as<uint32_t>() : 2;
+        uint32_t step_ways =
+            policy["step_ways"] ? policy["step_ways"].as<uint32_t>() : 1;
+        unsigned min_mb =
+            policy["min_mb"] ? policy["min_mb"].as<unsigned>() : 500;
+        unsigned max_mb =
+            policy["max_mb"] ? policy["max_mb"].as<unsigned>() : 20000;
+        double step = policy["step"] ? policy["step"].as<double>() : 0.2;
+        uint32_t min_cores =
+            policy["min_cores"] ? policy["min_cores"].as<uint32_t>() : 1;
+
+        if (every == 0)
+            throw_with_trace(std::runtime_error(
+                "The 'every' of the SLO policy cannot be 0"));
+        if (slack <= 0 || slack >= 1 || step <= 0 || step >= 1)
+            throw_with_trace(std::runtime_error(
+                "The 'slack' and 'step' of the SLO policy must be in (0, 1)"));
+        if (min_ways < 1 || step_ways < 1 || lc_ways < 1 || min_cores < 1)
+            throw_with_trace(std::runtime_error(
+                "The ways and cores of the SLO policy must be at least 1"));
+        if (min_mb > max_mb)
+            throw_with_trace(std::runtime_error(
+                "The 'min_mb' of the SLO policy cannot exceed 'max_mb'"));
+
+        return std::make_shared<cat::policy::SloFeedback>(
+            every, slack, lc_ways, min_ways, step_ways, min_mb, max_mb, step,
+            min_cores);
+    } else if (kind == "joint") {
+        LOGINF("Using joint multi-resource allocation policy");
+        typedef cat::policy::Joint Joint;
+
+        // Read fields, capacities of 0 leave a resource unmanaged
+        uint64_t every =
+            policy["every"] ? policy["every"].as<uint64_t>() : 10;
+        double membw = policy["membw"] ? policy["membw"].as<double>() : 0;
+        double cores = policy["cores"] ? policy["cores"].as<double>() : 0;
+        double net_kbps =
+            policy["net_kbps"] ? policy["net_kbps"].as<double>() : 0;
+        double disk_mbps =
+            policy["disk_mbps"] ? policy["disk_mbps"].as<double>() : 0;
+        double units = policy["units"] ? policy["units"].as<double>() : 20;
+        uint32_t min_ways =
+            policy["min_ways"] ? policy["min_ways"].as<uint32_t>() : 1;
+        double min_mb = policy["min_mb"] ? policy["min_mb"].as<double>() : 500;
+        double min_cores =
+            policy["min_cores"] ? policy["min_cores"].as<double>() : 1;
+        double min_net_kbps =
+            policy["min_net_kbps"] ? policy["min_net_kbps"].as<double>() : 0;
+        double min_disk_mbps =
+            policy["min_disk_mbps"] ? policy["min_disk_mbps"].as<double>()
+                                    : 0;
+        uint32_t lookahead =
+            policy["lookahead"] ? policy["lookahead"].as<uint32_t>() : 4;
+        double budget = policy["budget"] ? policy["budget"].as<double>() : 5;
+        double hysteresis =
+            policy["hysteresis"] ? policy["hysteresis"].as<double>() : 0.05;
+        double headroom =
+            policy["headroom"] ? policy["headroom"].as<double>() : 0.2;
+
+        if (every == 0 || lookahead == 0 || units < 1)
+            throw_with_trace(std::runtime_error(
+                "The 'every', 'lookahead' and 'units' of the joint policy "
+                "must be positive"));
+        if (membw < 0 || cores < 0 || net_kbps < 0 || disk_mbps < 0)
+            throw_with_trace(std::runtime_error(
+                "The capacities of the joint policy cannot be negative"));
+        if (budget <= 0)
+            throw_with_trace(std::runtime_error(
+                "The 'budget' (in ms) of the joint policy must be positive"));
+
+        // Divisible resources are handed out in 'units' blocks
+        Joint::alloc_t capacity = {cat::max_num_ways, membw, cores,
+                                   net_kbps, disk_mbps * 1024 * 1024};
+        Joint::alloc_t unit = {1, membw / units, 1, net_kbps / units,
+                               disk_mbps * 1024 * 1024 / units};
+        Joint::alloc_t min = {(double)min_ways, min_mb, min_cores,
+                              min_net_kbps, min_disk_mbps * 1024 * 1024};
+
+        return std::make_shared<Joint>(every, capacity, unit, min, lookahead,
+                                       budget / 1000, hysteresis, headroom);
+    } else if (kind == "preempt") {
+        LOGINF("Using batch preemption policy");
+
+        // Read fields
+        uint64_t every = policy["every"] ? policy["every"].as<uint64_t>() : 1;
+        string action =
+            policy["action"] ? policy["action"].as<string>() : "pause";
+        double ipc_drop =
+            policy["ipc_drop"] ? policy["ipc_drop"].as<double>() : 0.1;
+        double max_stalls =
+            policy["max_stalls"] ? policy["max_stalls"].as<double>() : 1;
+        double slack = policy["slack"] ? policy["slack"].as<double>() : 0.2;
+        uint64_t resume_after = policy["resume_after"]
+                                    ? policy["resume_after"].as<uint64_t>()
+                                    : 3;
+
+        if (every == 0)
+            throw_with_trace(std::runtime_error(
+                "The 'every' of the preemption policy cannot be 0"));
+        if (action != "pause" && action != "throttle")
+            throw_with_trace(std::runtime_error(
+                "The 'action' of the preemption policy must be 'pause' or "
+                "'throttle'"));
+        if (ipc_drop <= 0 || ipc_drop >= 1 || slack < 0 || slack >= 1)
+            throw_with_trace(std::runtime_error(
+                "The 'ipc_drop' and 'slack' of the preemption policy must be "
+                "in (0, 1)"));
+
+        return std::make_shared<cat::policy::Preempt>(
+            every, action == "throttle", ipc_drop, max_stalls, slack,
+            resume_after);
+    } else if (kind == "bandit") {
+        LOGINF("Using bandit partition explorer policy");
+
+        // Each arm is a list of CLOS with the format of the clos section
+        if (!policy["arms"] || !policy["arms"].IsSequence() ||
+            policy["arms"].size() < 2)
+            throw_with_trace(std::runtime_error(
+                "The bandit policy needs a sequence of at least two 'arms'"));
+        auto arms = vector<cat::policy::Bandit::arm_t>();
+        for (const auto &node : policy["arms"]) {
+            if (!node.IsSequence() || node.size() == 0)
+                throw_with_trace(std::runtime_error(
+                    "Each arm of the bandit policy must be a non-empty list "
+                    "of CLOS"));
+            auto arm = cat::policy::Bandit::arm_t();
+            for (const auto &cos : node) {
+                if (!cos["num"])
+                    throw_with_trace(std::runtime_error(
+                        "Each CLOS of a bandit arm must have a num"));
+                cat::policy::Bandit::clos_t clos;
+                clos.num = cos["num"].as<uint32_t>();
+                clos.mask = cos["schemata"] ? cos["schemata"].as<uint64_t>()
+                                            : 0;
+                clos.mbps = cos["mbps"] ? cos["mbps"].as<int>() : -1;
+                if (clos.mask == 0 && clos.mbps < 0)
+                    LOGWAR("CLOS {} of a bandit arm has neither schemata nor "
+                           "mbps"_format(clos.num));
+                arm.push_back(clos);
+            }
+            arms.push_back(arm);
+        }
+
+        // Read fields
+        uint64_t epoch = policy["epoch"] ? policy["epoch"].as<uint64_t>() : 5;
+        uint64_t warmup =
+            policy["warmup"] ? policy["warmup"].as<uint64_t>() : 1;
+        string algorithm =
+            policy["algorithm"] ? policy["algorithm"].as<string>() : "ucb";
+        string reward =
+            policy["reward"] ? policy["reward"].as<string>() : "ipc";
+        double c = policy["c"] ? policy["c"].as<double>() : 1;
+        double budget = policy["budget"] ? policy["budget"].as<double>() : 0.1;
+        double phase = policy["phase"] ? policy["phase"].as<double>() : 0.2;
+        uint64_t phase_epochs = policy["phase_epochs"]
+                                    ? policy["phase_epochs"].as<uint64_t>()
+                                    : 2;
+
+        if (epoch == 0 || phase_epochs == 0)
+            throw_with_trace(std::runtime_error(
+                "The 'epoch' and 'phase_epochs' of the bandit policy cannot "
+                "be 0"));
+        if (algorithm != "ucb" && algorithm != "thompson")
+            throw_with_trace(std::runtime_error(
+                "The 'algorithm' of the bandit policy must be 'ucb' or "
+                "'thompson'"));
+        if (reward != "ipc" && reward != "speedup")
+            throw_with_trace(std::runtime_error(
+                "The 'reward' of the bandit policy must be 'ipc' or "
+                "'speedup'"));
+        if (budget < 0 || budget >= 1 || phase <= 0 || c < 0)
+            throw_with_trace(std::runtime_error(
+                "The 'budget' of the bandit policy must be in [0, 1), its "
+                "'phase' positive and its 'c' not negative"));
+
+        return std::make_shared<cat::policy::Bandit>(
+            arms, epoch, warmup, algorithm == "thompson", reward == "speedup",
+            c, budget, phase, phase_epochs);
+    } else if (kind == "vcpu-scale") {
+        LOGINF("Using elastic vCPU scaling policy");
+
+        // Read fields
+        uint64_t every = policy["every"] ? policy["every"].as<uint64_t>() : 5;
+        double high = policy["high"] ? policy["high"].as<double>() : 80;
+        double low = policy["low"] ? policy["low"].as<double>() : 30;
+        uint32_t min_vcpus =
+            policy["min_vcpus"] ? policy["min_vcpus"].as<uint32_t>() : 1;
+        uint64_t cooldown =
+            policy["cooldown"] ? policy["cooldown"].as<uint64_t>() : 10;
+
+        if (every == 0)
+            throw_with_trace(std::runtime_error(
+                "The 'every' of the vCPU scaling policy cannot be 0"));
+        if (low < 0 || low >= high || high > 100)
+            throw_with_trace(std::runtime_error(
+                "The utilizations of the vCPU scaling policy must satisfy 0 "
+                "<= low < high <= 100"));
+        if (min_vcpus == 0)
+            throw_with_trace(std::runtime_error(
+                "The 'min_vcpus' of the vCPU scaling policy cannot be 0"));
+
+        return std::make_shared<cat::policy::VcpuScale>(every, high, low,
+                                                        min_vcpus, cooldown);
+    } else if (kind == "balloon") {
+        LOGINF("Using memory balloon policy");
+
+        // Read fields
+        uint64_t every = policy["every"] ? policy["every"].as<uint64_t>() : 5;
+        double low = policy["low"] ? policy["low"].as<double>() : 10;
+        double high = policy["high"] ? policy["high"].as<double>() : 40;
+        double step = policy["step"] ? policy["step"].as<double>() : 10;
+        double min_mb =
+            policy["min_mb"] ? policy["min_mb"].as<double>() : 1024;
+        double reserve =
+            policy["reserve"] ? policy["reserve"].as<double>() : 2048;
+        double max_faults =
+            policy["max_faults"] ? policy["max_faults"].as<double>() : 100;
+        double max_psi =
+            policy["max_psi"] ? policy["max_psi"].as<double>() : 10;
+        uint64_t cooldown =
+            policy["cooldown"] ? policy["cooldown"].as<uint64_t>() : 3;
+
+        if (every == 0)
+            throw_with_trace(std::runtime_error(
+                "The 'every' of the balloon policy cannot be 0"));
+        if (low < 0 || low >= high || high > 100)
+            throw_with_trace(std::runtime_error(
+                "The usable memory of the balloon policy must satisfy 0 <= "
+                "low < high <= 100"));
+        if (step <= 0 || step > 100)
+            throw_with_trace(std::runtime_error(
+                "The 'step' of the balloon policy must be in (0, 100]"));
+        if (min_mb <= 0 || reserve < 0 || max_faults < 0 || max_psi < 0)
+            throw_with_trace(std::runtime_error(
+                "The 'min_mb' of the balloon policy must be positive, and "
+                "'reserve', 'max_faults' and 'max_psi' cannot be negative"));
+
+        return std::make_shared<cat::policy::Balloon>(
+            every, low, high, step, min_mb, reserve, max_faults, max_psi,
+            cooldown);
+    } else if (kind == "multi") {
+        LOGINF("Using multi-timescale control loops");
+
+        if (!policy["loops"] || !policy["loops"].IsSequence() ||
+            policy["loops"].size() == 0)
+            throw_with_trace(std::runtime_error(
+                "The multi policy needs a sequence of 'loops'"));
+
+        auto loops = vector<cat::policy::Multi::loop_t>();
+        auto owners = std::map<string, string>(); // Actuator -> loop
+        for (const auto &node : policy["loops"]) {
+            config_check_fields(node, {"name", "policy", "actuators"},
+                                {"every", "window"});
+            cat::policy::Multi::loop_t loop;
+            loop.name = node["name"].as<string>();
+            loop.every = node["every"] ? node["every"].as<uint64_t>() : 1;
+            loop.window =
+                node["window"] ? node["window"].as<uint64_t>() : loop.every;
+            if (loop.every == 0 || loop.window == 0)
+                throw_with_trace(std::runtime_error(
+                    "The 'every' and 'window' of the loop '{}' cannot be "
+                    "0"_format(loop.name)));
+
+            for (const auto &a : node["actuators"]) {
+                string actuator = a.as<string>();
+                if (!actuator_names.count(actuator))
+                    throw_with_trace(std::runtime_error(
+                        "Unknown actuator '{}' in the loop '{}'"_format(
+                            actuator, loop.name)));
+                if (owners.count(actuator))
+                    throw_with_trace(std::runtime_error(
+                        "The actuator '{}' is owned by the loops '{}' and "
+                        "'{}'"_format(actuator, owners[actuator],
+                                      loop.name)));
+                owners[actuator] = loop.name;
+                loop.actuators.insert(actuator);
+            }
+
+            const auto &sub = node["policy"];
+            if (sub["kind"] && sub["kind"].as<string>() == "multi")
+                throw_with_trace(std::runtime_error(
+                    "The loop '{}' cannot run another multi policy"_format(
+                        loop.name)));
+            for (const auto &actuator : config_policy_actuators(sub))
+                if (!loop.actuators.count(actuator))
+                    throw_with_trace(std::runtime_error(
+                        "The policy of the loop '{}' uses the actuator '{}', "
+                        "which the loop does not own"_format(loop.name,
+                                                             actuator)));
+
+            // The policy of the loop is read as a top level one
+            YAML::Node wrapper;
+            wrapper["policy"] = sub;
+            loop.policy = config_read_cat_policy(wrapper);
+            LOGINF("Loop '{}' every {} intervals, window of {}"_format(
+                loop.name, loop.every, loop.window));
+            loops.push_back(loop);
+        }
+
+        // Both are set on the same CLOS, whose ids change when its tasks move
+        if (owners.count("ways") && owners.count("mba") &&
+            owners["ways"] != owners["mba"])
+            throw_with_trace(std::runtime_error(
+                "The actuators 'ways' and 'mba' have to be owned by the same "
+                "loop"));
+
+        return std::make_shared<cat::policy::Multi>(loops);
+    } else if (kind == "plugin") {
+        if (!policy["path"])
+            throw_with_trace(std::runtime_error(
+                "The 'plugin' policy needs the 'path' field"));
+        string path = policy["path"].as<string>();
+        LOGINF("Using policy plugin '{}'"_format(path));
+
+        // The whole node is passed, the plugin reads its own parameters
+        return std::make_shared<cat::policy::Plugin>(path, policy);
     } else
         throw_with_trace(
             std::runtime_error("Unknown policy: '" + kind + "'"));
 }
 
+static std::shared_ptr<MrcProfiler> config_read_mrc(const YAML::Node &mrc)
+{
+    config_check_fields(mrc, {}, {"every", "budget", "ways", "window"});
+
+    uint64_t every = mrc["every"] ? mrc["every"].as<uint64_t>() : 100;
+    double budget = mrc["budget"] ? mrc["budget"].as<double>() : 1;
+    size_t window = mrc["window"] ? mrc["window"].as<size_t>() : 8;
+    auto ways = mrc["ways"] ? mrc["ways"].as<vector<uint32_t>>()
+                            : vector<uint32_t>{16, 12, 8, 6, 4, 2};
+
+    if (budget <= 0 || budget >= 100)
+        throw_with_trace(std::runtime_error(
+            "The MRC 'budget' is a percentage of throughput in (0, 100)"));
+
+    LOGINF("Using MRC profiler every {} intervals with a budget of {}%"_format(
+        every, budget));
+    return std::make_shared<MrcProfiler>(every, budget / 100, ways, window);
+}
+
+static std::shared_ptr<VmClassifier>
+config_read_classifier(const YAML::Node &node)
+{
+    config_check_fields(node, {},
+                        {"net_kbps", "disk_mbps", "rw_ratio", "cpu_util",
+                         "l3_mpki", "membw_mbps", "idle_util", "min_samples",
+                         "confirm"});
+
+    ClassifierThresholds thr;
+    if (node["net_kbps"])
+        thr.net_kbps = node["net_kbps"].as<double>();
+    if (node["disk_mbps"])
+        thr.disk_mbps = node["disk_mbps"].as<double>();
+    if (node["rw_ratio"])
+        thr.rw_ratio = node["rw_ratio"].as<double>();
+    if (node["cpu_util"])
+        thr.cpu_util = node["cpu_util"].as<double>();
+    if (node["l3_mpki"])
+        thr.l3_mpki = node["l3_mpki"].as<double>();
+    if (node["membw_mbps"])
+        thr.membw_mbps = node["membw_mbps"].as<double>();
+    if (node["idle_util"])
+        thr.idle_util = node["idle_util"].as<double>();
+    uint64_t min_samples =
+        node["min_samples"] ? node["min_samples"].as<uint64_t>() : 5;
+    uint64_t confirm = node["confirm"] ? node["confirm"].as<uint64_t>() : 3;
+
+    if (thr.rw_ratio <= 0.5 || thr.rw_ratio > 1)
+        throw_with_trace(std::runtime_error(
+            "The classifier 'rw_ratio' must be in (0.5, 1]"));
+    if (thr.idle_util > thr.cpu_util)
+        throw_with_trace(std::runtime_error(
+            "The classifier 'idle_util' cannot exceed 'cpu_util'"));
+    if (min_samples < 1 || confirm < 1)
+        throw_with_trace(std::runtime_error(
+            "The classifier 'min_samples' and 'confirm' must be at least 1"));
+
+    LOGINF("Using VM classifier after {} samples, confirming changes in {} "
+           "intervals"_format(min_samples, confirm));
+    return std::make_shared<VmClassifier>(thr, min_samples, confirm);
+}
+
+// Minimum dwell time of each kind of knob, in ms, and settling monitor
+static std::shared_ptr<Actuators> config_read_actuators(const YAML::Node &node)
+{
+    config_check_fields(node, {},
+                        {"cbm", "mb", "pin", "iotune", "net", "cpu", "mem",
+                         "settle"});
+
+    Actuators::dwell_t dwell;
+    for (int k = 0; k < Actuators::num_kinds; k++) {
+        string name = actuator_kind_name((Actuators::kind_t)k);
+        double ms = node[name] ? node[name].as<double>() : 0;
+        if (ms < 0)
+            throw_with_trace(std::runtime_error(
+                "The dwell time of the '{}' actuators cannot be "
+                "negative"_format(name)));
+        dwell[k] = ms / 1000;
+    }
+
+    LOGINF("Using the actuator layer, dwell times of {} ms (cbm), {} ms (mb), "
+           "{} ms (pin), {} ms (iotune), {} ms (net), {} ms (cpu) and {} ms "
+           "(mem)"_format(
+               dwell[Actuators::cbm_k] * 1000, dwell[Actuators::mb_k] * 1000,
+               dwell[Actuators::pin_k] * 1000,
+               dwell[Actuators::iotune_k] * 1000,
+               dwell[Actuators::net_k] * 1000,
+               dwell[Actuators::cpu_k] * 1000,
+               dwell[Actuators::mem_k] * 1000));
+    auto result = std::make_shared<Actuators>(dwell);
+
+    if (node["settle"]) {
+        const auto &settle = node["settle"];
+        config_check_fields(settle, {}, {"tolerance", "stable", "timeout"});
+        double tolerance =
+            settle["tolerance"] ? settle["tolerance"].as<double>() : 0.05;
+        uint64_t stable =
+            settle["stable"] ? settle["stable"].as<uint64_t>() : 3;
+        double timeout =
+            settle["timeout"] ? settle["timeout"].as<double>() : 30;
+        if (tolerance <= 0 || stable < 2 || timeout <= 0)
+            throw_with_trace(std::runtime_error(
+                "The settle 'tolerance' and 'timeout' must be positive, and "
+                "'stable' at least 2"));
+        LOGINF("Following the changes of the masks and MBA limits until they "
+               "settle within {:.0f}% for {} intervals"_format(
+                   tolerance * 100, stable));
+        result->set_settle(
+            std::make_shared<SettleMonitor>(tolerance, stable, timeout));
+    }
+    return result;
+}
+
 static vector<Cos> config_read_cos(const YAML::Node &config)
 {
     YAML::Node cos_section = config["clos"];
@@ -127,6 +761,7 @@ static vector<Cos> config_read_cos(const YAML::Node &config)
         auto num = 0;
         auto mask = 0x7ff;
         uint64_t mbps = -1;
+        uint64_t l2_mask = 0;
         auto cpus = vector<uint32_t>();
 
         // Schematas are mandatory
@@ -142,6 +777,10 @@ static vector<Cos> config_read_cos(const YAML::Node &config)
         if (cos["mbps"])
             mbps = cos["mbps"].as<int>();
 
+        // L2 schematas are only used in processors with L2 CAT
+        if (cos["l2_schemata"])
+            l2_mask = cos["l2_schemata"].as<uint64_t>();
+
         // CPUs are not mandatory, but note that all the CPUs are assigned to CLOS 0 by default
         if (cos["cpus"]) {
             auto cpulist = cos["cpus"];
@@ -151,7 +790,7 @@ static vector<Cos> config_read_cos(const YAML::Node &config)
             }
         }
 
-        result.push_back(Cos(num, mask, mbps, cpus));
+        result.push_back(Cos(num, mask, mbps, cpus, l2_mask));
         num = num + 1;
     }
 
@@ -202,7 +841,13 @@ static tasklist_t config_read_tasks(const YAML::Node &config)
                        "client_num_cpus",
                        "client_cpus",
                        "ceph_vm",
-                       "client_native"};
+                       "client_native",
+                       "ways",
+                       "mbps",
+                       "slo",
+                       "slo_percentile",
+                       "latency_file",
+                       "cpu_quota"};
 
             config_check_fields(tasks[i], required, allowed);
 
@@ -456,10 +1101,26 @@ static tasklist_t config_read_tasks(const YAML::Node &config)
                 netbw_in_avg, netbw_in_peak, netbw_in_burst, netbw_out_avg,
                 netbw_out_peak, netbw_out_burst));
 
+            // Tail latency SLO of the server, given in ms
+            auto vm_ptr = std::static_pointer_cast<VMTask>(result.back());
+            if (tasks[i]["slo"])
+                vm_ptr->slo = tasks[i]["slo"].as<double>() * 1000;
+            if (tasks[i]["slo_percentile"])
+                vm_ptr->slo_percentile =
+                    tasks[i]["slo_percentile"].as<uint32_t>();
+            if (tasks[i]["latency_file"])
+                vm_ptr->latency_file = tasks[i]["latency_file"].as<string>();
+            if (vm_ptr->slo < 0 ||
+                (vm_ptr->slo_percentile != 95 && vm_ptr->slo_percentile != 99))
+                throw_with_trace(std::runtime_error(
+                    "Task {} needs a positive 'slo' on the 95 or 99 "
+                    "'slo_percentile'"_format(name)));
+
         } else if (kind == "app") {
             required = {"app", "kind"};
             allowed = {"max_instr",    "max_restarts", "define",
-                       "initial_clos", "cpus",         "batch"};
+                       "initial_clos", "cpus",         "batch",
+                       "ways",         "mbps",         "cpu_quota"};
             config_check_fields(tasks[i], required, allowed);
 
             /*** PROCESS APPLICATIONS.MAKO ***/
@@ -561,6 +1222,22 @@ static tasklist_t config_read_tasks(const YAML::Node &config)
                 name, cpus, initial_clos, output, input, error, max_restarts,
                 batch, client, cmd, skel, max_instr));
         }
+
+        // Requested allocation, used instead of initial_clos if present
+        const auto &task_ptr = result.back();
+        if (tasks[i]["ways"])
+            task_ptr->req_ways = tasks[i]["ways"].as<uint32_t>();
+        if (tasks[i]["mbps"])
+            task_ptr->req_mbps = tasks[i]["mbps"].as<int>();
+        if (task_ptr->req_mbps >= 0 && !task_ptr->req_ways)
+            throw_with_trace(std::runtime_error(
+                "Task {} requests MBA but not LLC ways"_format(task_ptr->name)));
+        if (tasks[i]["cpu_quota"])
+            task_ptr->req_cpu_quota = tasks[i]["cpu_quota"].as<double>();
+        if (task_ptr->req_cpu_quota < 0)
+            throw_with_trace(std::runtime_error(
+                "Task {} cannot have a negative 'cpu_quota'"_format(
+                    task_ptr->name)));
     }
     return result;
 }
@@ -594,7 +1271,9 @@ static void config_read_cmd_options(const YAML::Node &config,
     vector<string> allowed;
 
     required = {};
-    allowed = {"ti", "mi", "event", "cpu-affinity", "perf"};
+    allowed = {"ti",           "mi",     "event", "cpu-affinity",
+               "perf",         "rmid",   "ovsdb", "latency_addr",
+               "latency_port", "cgroup"};
 
     // Check minimum required fields
     config_check_fields(cmd, required, allowed);
@@ -607,6 +1286,24 @@ static void config_read_cmd_options(const YAML::Node &config,
         cmd_options.event = cmd["event"].as<decltype(cmd_options.event)>();
     if (cmd["perf"])
         cmd_options.perf = cmd["perf"].as<decltype(cmd_options.perf)>();
+    if (cmd["rmid"]) {
+        cmd_options.rmid = cmd["rmid"].as<decltype(cmd_options.rmid)>();
+        if (cmd_options.rmid != "pid" && cmd_options.rmid != "task" &&
+            cmd_options.rmid != "clos")
+            throw_with_trace(std::runtime_error(
+                "Unknown RMID grouping '" + cmd_options.rmid +
+                "', valid options are 'pid', 'task' and 'clos'"));
+    }
+    if (cmd["ovsdb"])
+        cmd_options.ovsdb = cmd["ovsdb"].as<decltype(cmd_options.ovsdb)>();
+    if (cmd["latency_addr"])
+        cmd_options.latency_addr =
+            cmd["latency_addr"].as<decltype(cmd_options.latency_addr)>();
+    if (cmd["latency_port"])
+        cmd_options.latency_port =
+            cmd["latency_port"].as<decltype(cmd_options.latency_port)>();
+    if (cmd["cgroup"])
+        cmd_options.cgroup = cmd["cgroup"].as<decltype(cmd_options.cgroup)>();
     if (cmd["cpu-affinity"])
         cmd_options.cpu_affinity =
             cmd["cpu-affinity"].as<decltype(cmd_options.cpu_affinity)>();
@@ -638,6 +1335,37 @@ void config_read(const string &path, const string &overlay,
     if (config["policy"])
         catpol = config_read_cat_policy(config);
 
+    // Any policy can be evaluated on its own thread
+    if (config["policy"] && config["policy"]["async"]) {
+        const auto &async = config["policy"]["async"];
+        config_check_fields(async, {}, {"deadline"});
+        double deadline =
+            async["deadline"] ? async["deadline"].as<double>() : 100;
+        if (deadline < 0)
+            throw_with_trace(std::runtime_error(
+                "The async 'deadline' (in ms) cannot be negative"));
+        LOGINF("Evaluating the policy asynchronously, deadline {} ms"_format(
+            deadline));
+        if (config["policy"]["actuators"])
+            throw_with_trace(std::runtime_error(
+                "The actuator layer cannot be used with an async policy"));
+        catpol = std::make_shared<cat::policy::Async>(catpol, deadline / 1000);
+    }
+
+    // Read miss-rate curve profiler, available to any policy
+    if (config["policy"] && config["policy"]["mrc"])
+        catpol->set_mrc(config_read_mrc(config["policy"]["mrc"]));
+
+    // Read online VM classifier, available to any policy
+    if (config["policy"] && config["policy"]["classifier"])
+        catpol->set_classifier(
+            config_read_classifier(config["policy"]["classifier"]));
+
+    // Read actuator layer, used by the policies that support it
+    if (config["policy"] && config["policy"]["actuators"])
+        catpol->set_actuators(
+            config_read_actuators(config["policy"]["actuators"]));
+
     LOGINF("Going to read tasks...");
 
     // Read tasks into objects
@@ -655,4 +1383,38 @@ void config_read(const string &path, const string &overlay,
 
     // Read general config
     config_read_cmd_options(config, cmd_options);
+
+    // Kinds of the policies in use, those of its loops for the multi policy
+    auto kinds = vector<string>();
+    if (config["policy"] && config["policy"]["kind"]) {
+        kinds.push_back(config["policy"]["kind"].as<string>());
+        if (kinds[0] == "multi")
+            for (const auto &loop : config["policy"]["loops"])
+                if (loop["policy"]["kind"])
+                    kinds.push_back(loop["policy"]["kind"].as<string>());
+    }
+
+    for (const auto &kind : kinds) {
+        // Moving vCPUs needs the counters to follow the threads, and the
+        // real tasks to pin them
+        if (kind == "vcpu-pin") {
+            if (cmd_options.perf != "PID")
+                throw_with_trace(std::runtime_error(
+                    "The vCPU pinning policy needs 'perf: PID'"));
+            if (config["policy"]["async"])
+                throw_with_trace(std::runtime_error(
+                    "The vCPU pinning policy cannot be evaluated "
+                    "asynchronously"));
+        }
+
+        // These policies act on the real tasks (pinning or pausing them),
+        // or through actuators the async policy does not forward
+        if ((kind == "slo" || kind == "joint" || kind == "preempt" ||
+             kind == "vcpu-scale" || kind == "balloon" || kind == "power" ||
+             kind == "disk") &&
+            config["policy"]["async"])
+            throw_with_trace(std::runtime_error(
+                "The {} policy cannot be evaluated asynchronously"_format(
+                    kind)));
+    }
 }
@@ -34,10 +34,11 @@ struct Cos {
     uint64_t mask;              // Ways assigned mask
     int mbps;                   // Memory BW in MBps
     std::vector<uint32_t> cpus; // Associated CPUs
+    uint64_t l2_mask;           // L2 ways assigned mask (0 = unchanged)
 
     Cos(uint32_t _num, uint64_t _mask, int _mbps,
-        const std::vector<uint32_t> &_cpus = {})
-        : num(_num), mask(_mask), mbps(_mbps), cpus(_cpus)
+        const std::vector<uint32_t> &_cpus = {}, uint64_t _l2_mask = 0)
+        : num(_num), mask(_mask), mbps(_mbps), cpus(_cpus), l2_mask(_l2_mask)
     {
     }
 };
@@ -51,6 +52,11 @@ struct CmdOptions {
                                       "instructions"}; // Events to monitor
     std::vector<uint32_t> cpu_affinity = {}; // CPUs to pin the manager to
     std::string perf = "PID";
+    std::string rmid = "pid"; // RMID per pid, per task or per CLOS
+    std::string ovsdb = "/var/run/openvswitch/db.sock"; // OVSDB server socket
+    std::string latency_addr = "127.0.0.1"; // Address for latency reports
+    uint16_t latency_port = 0; // UDP port for latency reports (0: disabled)
+    std::string cgroup = "/sys/fs/cgroup/stratus"; // Cgroups of the apps
 };
 
 void config_read(const std::string &path, const std::string &overlay,
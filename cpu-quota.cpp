@@ -0,0 +1,256 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+
+#include "cpu-quota.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+#include "vm-task.hpp"
+
+namespace fs = boost::filesystem;
+using fmt::literals::operator""_format;
+
+// Where the cgroup v2 hierarchy is mounted
+static const std::string cgroup_mount = "/sys/fs/cgroup";
+
+// The kernel does not accept quotas under 1 ms
+static const uint64_t min_quota = 1000;
+
+static void cgroup_write(const std::string &path, const std::string &value)
+{
+    std::ofstream out(path);
+    out << value << std::flush;
+    if (!out)
+        throw_with_trace(std::runtime_error(
+            "Could not write '{}' to {}"_format(value, path)));
+}
+
+bool cpu_stat_read(const std::string &path, CpuStat &stat)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    std::string key;
+    uint64_t value;
+    while (in >> key >> value) {
+        if (key == "usage_usec")
+            stat.usage_usec = value;
+        else if (key == "nr_periods")
+            stat.nr_periods = value;
+        else if (key == "nr_throttled")
+            stat.nr_throttled = value;
+        else if (key == "throttled_usec")
+            stat.throttled_usec = value;
+    }
+    return true;
+}
+
+void CpuQuota::set_root(const std::string &_root)
+{
+    root = _root;
+    root_ready = false;
+}
+
+// The cpu controller has to be enabled in the parent of the root and in the
+// root itself, for the cgroups of the tasks
+void CpuQuota::setup_root()
+{
+    if (root_ready)
+        return;
+    fs::path path(root);
+    cgroup_write((path.parent_path() / "cgroup.subtree_control").string(),
+                 "+cpu");
+    fs::create_directories(path);
+    cgroup_write((path / "cgroup.subtree_control").string(), "+cpu");
+    root_ready = true;
+    LOGINF("CPUQ: using the cgroups under {}"_format(root));
+}
+
+// Creates the cgroup of an application if needed and moves its processes
+// there, as a restarted application has new ones
+std::string CpuQuota::app_cgroup(const Task &task)
+{
+    auto it = app_cgroups.find(task.id);
+    if (it == app_cgroups.end()) {
+        setup_root();
+        auto path = (fs::path(root) / "task-{}"_format(task.id)).string();
+        fs::create_directories(path);
+        it = app_cgroups.emplace(task.id, path).first;
+    }
+
+    auto pids = std::vector<pid_t>();
+    for (uint32_t i = 0; i < task.cpus.size(); i++)
+        if (task.pids[i] > 0 &&
+            std::find(pids.begin(), pids.end(), task.pids[i]) == pids.end())
+            pids.push_back(task.pids[i]);
+    for (auto pid : pids)
+        cgroup_write(it->second + "/cgroup.procs", std::to_string(pid));
+    return it->second;
+}
+
+// Cgroups of the pids of a task, the vCPU threads of a VM being each in its
+// own under the cgroup of the VM
+std::set<std::string> CpuQuota::task_cgroups(const Task &task) const
+{
+    auto result = std::set<std::string>();
+    for (uint32_t i = 0; i < task.cpus.size(); i++) {
+        if (task.pids[i] <= 0)
+            continue;
+        std::ifstream in("/proc/{}/cgroup"_format(task.pids[i]));
+        std::string line;
+        while (std::getline(in, line))
+            if (line.compare(0, 3, "0::") == 0)
+                result.insert(cgroup_mount + line.substr(3));
+    }
+    return result;
+}
+
+void CpuQuota::set_quota(Task &task, double cores, uint64_t period)
+{
+    if (period < min_quota)
+        throw_with_trace(std::runtime_error(
+            "The CFS period of task {} must be at least {} us"_format(
+                task.name, min_quota)));
+
+    auto vm = dynamic_cast<VMTask *>(&task);
+    if (vm) {
+        // The quota of libvirt is for each vCPU
+        long long quota = -1;
+        if (cores > 0) {
+            uint32_t vcpus = vm->online_vcpus ? vm->online_vcpus
+                                              : vm->cpus.size();
+            quota = std::max<long long>(min_quota,
+                                        cores * period / vcpus);
+        }
+        vm->task_set_vcpu_quota(quota, period);
+        if (cores > 0)
+            vm_quotas.insert(vm->id);
+        else
+            vm_quotas.erase(vm->id);
+    } else {
+        std::string value = "max {}"_format(period);
+        if (cores > 0)
+            value = "{} {}"_format(
+                std::max<uint64_t>(min_quota, cores * period), period);
+        cgroup_write(app_cgroup(task) + "/cpu.max", value);
+    }
+
+    task.cpu_quota = std::max(cores, 0.0);
+    LOGDEB("CPUQ: task {} limited to {:.2f} cores every {} us"_format(
+        task.name, task.cpu_quota, period));
+}
+
+void CpuQuota::poll(const Task::tasklist_t &tasklist)
+{
+    auto seen = std::map<std::string, CpuStat>();
+
+    for (const auto &task_ptr : tasklist) {
+        Task &task = *task_ptr;
+        if (app_cgroups.count(task.id)) {
+            try {
+                app_cgroup(task);
+            } catch (const std::exception &e) {
+                LOGWAR("CPUQ: could not move the processes of task {} to "
+                       "its cgroup: {}"_format(task.name, e.what()));
+            }
+        }
+
+        CpuStat delta;
+        for (const auto &cgroup : task_cgroups(task)) {
+            CpuStat stat;
+            if (!cpu_stat_read(cgroup + "/cpu.stat", stat))
+                continue;
+            seen[cgroup] = stat;
+
+            // A new cgroup, or one that was recreated, starts counting now
+            auto it = last.find(cgroup);
+            if (it == last.end() ||
+                stat.nr_periods < it->second.nr_periods ||
+                stat.throttled_usec < it->second.throttled_usec)
+                continue;
+            const CpuStat &prev = it->second;
+            delta.nr_periods += stat.nr_periods - prev.nr_periods;
+            delta.nr_throttled += stat.nr_throttled - prev.nr_throttled;
+            delta.throttled_usec += stat.throttled_usec - prev.throttled_usec;
+        }
+
+        task.cpu_nr_periods = delta.nr_periods;
+        task.cpu_nr_throttled = delta.nr_throttled;
+        task.cpu_throttled_us = delta.throttled_usec;
+        if (delta.nr_throttled)
+            LOGDEB("CPUQ: task {} throttled in {} of {} periods, {} us"_format(
+                task.name, delta.nr_throttled, delta.nr_periods,
+                delta.throttled_usec));
+    }
+
+    // Forget the cgroups of the tasks gone
+    last = seen;
+}
+
+void CpuQuota::restore(const Task::tasklist_t &tasklist)
+{
+    for (const auto &task_ptr : tasklist) {
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        if (!vm || !vm_quotas.count(vm->id))
+            continue;
+        try {
+            vm->task_set_vcpu_quota(-1, 100000);
+        } catch (const std::exception &e) {
+            LOGERR("CPUQ: could not remove the quota of VM {}: {}"_format(
+                vm->name, e.what()));
+        }
+    }
+    vm_quotas.clear();
+
+    // The processes go back to the root cgroup, so the ones created can be
+    // removed
+    for (const auto &c : app_cgroups) {
+        std::ifstream in(c.second + "/cgroup.procs");
+        pid_t pid;
+        while (in >> pid) {
+            try {
+                cgroup_write(cgroup_mount + "/cgroup.procs",
+                             std::to_string(pid));
+            } catch (const std::exception &e) {
+                LOGERR("CPUQ: " << e.what());
+            }
+        }
+        boost::system::error_code ec;
+        fs::remove(c.second, ec);
+        if (ec)
+            LOGERR("CPUQ: could not remove {}: {}"_format(c.second,
+                                                        ec.message()));
+    }
+    if (!app_cgroups.empty()) {
+        boost::system::error_code ec;
+        fs::remove(root, ec);
+    }
+    app_cgroups.clear();
+    root_ready = false;
+}
+
+CpuQuota &cpu_quota()
+{
+    static CpuQuota quota;
+    return quota;
+}
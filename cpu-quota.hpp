@@ -0,0 +1,71 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+
+#include "task.hpp"
+
+// Counters of the cpu.stat file of a cgroup v2
+struct CpuStat {
+    uint64_t usage_usec = 0;
+    uint64_t nr_periods = 0;
+    uint64_t nr_throttled = 0;
+    uint64_t throttled_usec = 0;
+};
+
+// CPU bandwidth (CFS quota) of the tasks, to give them a fraction of a core.
+// The VMs get the vcpu_quota and vcpu_period of libvirt, which apply to each
+// of their vCPUs, and the applications the cpu.max of a cgroup v2 created
+// for each of them under the root given. Every interval poll() reads the
+// cpu.stat of the cgroups the pids of the tasks are in, and stores in the
+// tasks the periods and time they were throttled. The quotas are removed,
+// and the cgroups created deleted, by restore().
+class CpuQuota
+{
+    std::string root = "/sys/fs/cgroup/stratus";
+    bool root_ready = false;
+    std::map<uint32_t, std::string> app_cgroups; // Task id -> cgroup
+    std::set<uint32_t> vm_quotas;                // VMs with a quota set
+    std::map<std::string, CpuStat> last;         // Cgroup -> last cpu.stat
+
+    void setup_root();
+    std::string app_cgroup(const Task &task);
+    std::set<std::string> task_cgroups(const Task &task) const;
+
+  public:
+    CpuQuota() = default;
+    CpuQuota(const CpuQuota &) = delete;
+    CpuQuota &operator=(const CpuQuota &) = delete;
+
+    void set_root(const std::string &_root);
+
+    // Cores the whole task can use every period (us), split evenly among the
+    // vCPUs of a VM. No limit if cores is not positive.
+    void set_quota(Task &task, double cores, uint64_t period = 100000);
+    void poll(const Task::tasklist_t &tasklist);
+    void restore(const Task::tasklist_t &tasklist);
+};
+
+// Reads a cpu.stat file, false if it cannot be read
+bool cpu_stat_read(const std::string &path, CpuStat &stat);
+
+// Controller shared by the whole manager
+CpuQuota &cpu_quota();
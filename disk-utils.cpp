@@ -323,6 +323,43 @@ void DiskUtils::set_write_iops_sec(const unsigned long long i)
     write_iops_sec_limit = i;
 }
 
+void DiskUtils::set_iotune(const virDomainPtr dom, unsigned long long bytes_sec,
+                           unsigned long long iops_sec)
+{
+    int nparams = 0;
+    int maxparams = 0;
+    virTypedParameterPtr params = NULL;
+    unsigned int flags = VIR_DOMAIN_AFFECT_CURRENT | VIR_DOMAIN_AFFECT_LIVE;
+
+    const std::pair<const char *, unsigned long long> values[] = {
+        {VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC, bytes_sec},
+        {VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC, iops_sec},
+        {VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC, 0},
+        {VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC, 0},
+        {VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC, 0},
+        {VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC, 0}};
+    for (const auto &v : values) {
+        if (virTypedParamsAddULLong(&params, &nparams, &maxparams, v.first,
+                                    v.second) < 0) {
+            virTypedParamsFree(params, nparams);
+            throw_with_trace(std::runtime_error(
+                "Could not add the block I/O tune parameter {}"_format(
+                    v.first)));
+        }
+    }
+
+    int res = virDomainSetBlockIoTune(dom, "vda", params, nparams, flags);
+    virTypedParamsFree(params, nparams);
+    if (res < 0)
+        throw_with_trace(
+            std::runtime_error("Unable to change the block I/O throttle"));
+
+    total_bytes_sec_limit = bytes_sec;
+    total_iops_sec_limit = iops_sec;
+    read_bytes_sec_limit = write_bytes_sec_limit = 0;
+    read_iops_sec_limit = write_iops_sec_limit = 0;
+}
+
 //Based on static bool cmdBlkdeviotune(vshControl *ctl, const vshCmd *cmd);
 void DiskUtils::apply_disk_util_limits(const virDomainPtr dom)
 {
@@ -110,6 +110,10 @@ class DiskUtils
     void print_disk_stats_quantum(const virDomainPtr dom, int64_t delay);
 
     void apply_disk_util_limits(const virDomainPtr dom);
+    // Sets the total limits in a single call (0 removes them). The read and
+    // write limits are cleared, as libvirt does not allow both kinds.
+    void set_iotune(const virDomainPtr dom, unsigned long long bytes_sec,
+                    unsigned long long iops_sec);
 
     void set_total_bytes_sec(
         const unsigned long long
@@ -164,7 +164,9 @@ Perf::read_counters(pid_t pid, int32_t id, double llc_occup_value,
                     double lmem_bw_value, double tmem_bw_value,
                     double rmem_bw_value, DiskUtils DU,
                     float network_bwtx, float network_bwrx, double ovs_bwtx,
-                    double ovs_bwrx, uint64_t time_interval)
+                    double ovs_bwrx, double lat_p95, double lat_p99,
+                    double lat_qps, const VmMemory &mem, double psi_some,
+                    double psi_full, uint64_t time_interval)
 {
     const char *names[max_num_events];
     double results[max_num_events];
@@ -197,6 +199,23 @@ Perf::read_counters(pid_t pid, int32_t id, double llc_occup_value,
     const auto ovs_rx_bw = "OVS_Rx_netBW[KBps]";
     const auto ovs_tx_bw = "OVS_Tx_netBW[KBps]";
 
+    // Entries for the latency reported by the client
+    const auto lat_p95_us = "Lat_p95[us]";
+    const auto lat_p99_us = "Lat_p99[us]";
+    const auto qps = "QPS";
+
+    // Entries for the memory of the guest and the pressure of the host
+    const auto mem_actual = "Mem_actual[MB]";
+    const auto mem_usable = "Mem_usable[MB]";
+    const auto mem_available = "Mem_available[MB]";
+    const auto mem_rss = "Mem_RSS[MB]";
+    const auto swap_in = "Swap_in[MBps]";
+    const auto swap_out = "Swap_out[MBps]";
+    const auto major_faults = "Major_faults[/s]";
+    const auto minor_faults = "Minor_faults[/s]";
+    const auto psi_mem_some = "PSI_mem_some[%]";
+    const auto psi_mem_full = "PSI_mem_full[%]";
+
     // Entries for time
     const auto time_int = "Time[ns]";
 
@@ -248,6 +267,24 @@ Perf::read_counters(pid_t pid, int32_t id, double llc_occup_value,
             counters.insert({i++, ovs_tx_bw, ovs_bwtx, "", true, 1, 1});
             counters.insert({i++, ovs_rx_bw, ovs_bwrx, "", true, 1, 1});
 
+            counters.insert({i++, lat_p95_us, lat_p95, "", true, 1, 1});
+            counters.insert({i++, lat_p99_us, lat_p99, "", true, 1, 1});
+            counters.insert({i++, qps, lat_qps, "", true, 1, 1});
+
+            counters.insert({i++, mem_actual, mem.actual, "", true, 1, 1});
+            counters.insert({i++, mem_usable, mem.usable, "", true, 1, 1});
+            counters.insert(
+                {i++, mem_available, mem.available, "", true, 1, 1});
+            counters.insert({i++, mem_rss, mem.rss, "", true, 1, 1});
+            counters.insert({i++, swap_in, mem.swap_in, "", true, 1, 1});
+            counters.insert({i++, swap_out, mem.swap_out, "", true, 1, 1});
+            counters.insert(
+                {i++, major_faults, mem.major_faults, "", true, 1, 1});
+            counters.insert(
+                {i++, minor_faults, mem.minor_faults, "", true, 1, 1});
+            counters.insert({i++, psi_mem_some, psi_some, "", true, 1, 1});
+            counters.insert({i++, psi_mem_full, psi_full, "", true, 1, 1});
+
             counters.insert({i++, time_int, time_interval, "", true, 1, 1});
 
             first = false;
@@ -349,6 +386,23 @@ std::vector<std::vector<std::string>> Perf::get_names(int32_t id,
     const auto ovs_rx_bw = "OVS_Rx_netBW[KBps]";
     const auto ovs_tx_bw = "OVS_Tx_netBW[KBps]";
 
+    // Entries for the latency reported by the client
+    const auto lat_p95_us = "Lat_p95[us]";
+    const auto lat_p99_us = "Lat_p99[us]";
+    const auto qps = "QPS";
+
+    // Entries for the memory of the guest and the pressure of the host
+    const auto mem_actual = "Mem_actual[MB]";
+    const auto mem_usable = "Mem_usable[MB]";
+    const auto mem_available = "Mem_available[MB]";
+    const auto mem_rss = "Mem_RSS[MB]";
+    const auto swap_in = "Swap_in[MBps]";
+    const auto swap_out = "Swap_out[MBps]";
+    const auto major_faults = "Major_faults[/s]";
+    const auto minor_faults = "Minor_faults[/s]";
+    const auto psi_mem_some = "PSI_mem_some[%]";
+    const auto psi_mem_full = "PSI_mem_full[%]";
+
     // Entries for time
     const auto time_int = "Time[ns]";
 
@@ -377,6 +431,19 @@ std::vector<std::vector<std::string>> Perf::get_names(int32_t id,
                 v.push_back(rx_bw);
                 v.push_back(ovs_tx_bw);
                 v.push_back(ovs_rx_bw);
+                v.push_back(lat_p95_us);
+                v.push_back(lat_p99_us);
+                v.push_back(qps);
+                v.push_back(mem_actual);
+                v.push_back(mem_usable);
+                v.push_back(mem_available);
+                v.push_back(mem_rss);
+                v.push_back(swap_in);
+                v.push_back(swap_out);
+                v.push_back(major_faults);
+                v.push_back(minor_faults);
+                v.push_back(psi_mem_some);
+                v.push_back(psi_mem_full);
             }
             v.push_back(time_int);
             first = false;
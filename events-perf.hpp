@@ -30,6 +30,7 @@
 #ifndef DISK_UTILS_H
 #define DISK_UTILS_H
 #include "disk-utils.hpp"
+#include "memory.hpp"
 #endif
 
 namespace mi = boost::multi_index;
@@ -116,6 +117,8 @@ class Perf
                   double lmem_bw_value, double tmem_bw_value,
                   double rmem_bw_value, DiskUtils DU, float network_bwtx,
                   float network_bwrx, double ovs_bwtx, double ovs_bwrx,
+                  double lat_p95, double lat_p99, double lat_qps,
+                  const VmMemory &mem, double psi_some, double psi_full,
                   uint64_t time_interval);
     std::vector<counters_t>
     read_counters(pid_t pid, int32_t id, double llc_occup_value,
@@ -14,6 +14,7 @@
    limitations under the License.
 */
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cxx-prettyprint/prettyprint.hpp>
@@ -28,22 +29,6 @@
 
 using fmt::literals::operator""_format;
 
-/**
- * Maintains a table of process id, event, number of events that are selected
- * in config string for monitoring LLC occupancy
- */
-static struct {
-    pid_t pid;
-    struct pqos_mon_data *pgrp;
-    enum pqos_mon_event events;
-} sel_monitor_pid_tab[PQOS_MAX_PIDS];
-
-static struct {
-    uint32_t core;
-    struct pqos_mon_data *pgrp;
-    enum pqos_mon_event events;
-} sel_monitor_core_tab[PQOS_MAX_CORES];
-
 bool IntelRDT::is_initialized() const
 {
     return initialized;
@@ -77,12 +62,44 @@ void IntelRDT::init()
         throw_with_trace(
             std::runtime_error("Could not retrieve CPU socket information"));
 
+    // L2 CAT is optional, it is only present in some processors
+    const struct pqos_capability *cap_l2ca = NULL;
+    if (pqos_cap_get_type(p_cap, PQOS_CAP_TYPE_L2CA, &cap_l2ca) ==
+        PQOS_RETVAL_OK) {
+        p_l2ids = pqos_cpu_get_l2ids(p_cpu, &l2_count);
+        l2_supported = (p_l2ids != NULL);
+    }
+    LOGINF("L2 CAT supported: {}"_format(l2_supported));
+
     // Initialize Perf structures used for OS monitoring interface
     ret = os_mon_init(p_cpu, p_cap);
     if (ret != PQOS_RETVAL_OK)
         throw_with_trace(
             std::runtime_error("Could not initialize Pef OS monitoring"));
 
+    // Events included in every monitoring group: LLC occupancy and MBM
+    const struct pqos_capability *cap_mon = NULL;
+    ret = pqos_cap_get_type(p_cap, PQOS_CAP_TYPE_MON, &cap_mon);
+    if (ret != PQOS_RETVAL_OK)
+        throw_with_trace(
+            std::runtime_error("Could not retrieve monitoring capabilities"));
+
+    for (unsigned i = 0; i < cap_mon->u.mon->num_events; i++) {
+        struct pqos_monitor *mon = &cap_mon->u.mon->events[i];
+        LOGINF("EVENT SUPPORTED: {}"_format(mon->type));
+        // Include only LLC occup and MBM events
+        if (mon->type <= 8) {
+            mon_events = static_cast<pqos_mon_event>(
+                static_cast<int>(mon->type | mon_events));
+            LOGINF("--> EVENT INCLUDED: {}"_format(mon->type));
+        }
+    }
+
+    // RMID 0 belongs to the default group, the rest can be used by us
+    mon_max_groups =
+        cap_mon->u.mon->max_rmid > 0 ? cap_mon->u.mon->max_rmid - 1 : 0;
+    LOGINF("{} RMIDs available for monitoring groups"_format(mon_max_groups));
+
     initialized = true;
     reset();
 }
@@ -196,6 +213,15 @@ uint32_t IntelRDT::get_max_closids() const
     return max_num_cos;
 }
 
+uint64_t IntelRDT::get_l3_way_size() const
+{
+    const struct pqos_capability *cap = NULL;
+    if (pqos_cap_get_type(p_cap, PQOS_CAP_TYPE_L3CA, &cap) != PQOS_RETVAL_OK)
+        throw_with_trace(
+            std::runtime_error("Could not get the L3 CAT capabilities"));
+    return cap->u.l3ca->way_size;
+}
+
 void IntelRDT::reset()
 {
     if (!initialized)
@@ -227,6 +253,10 @@ void IntelRDT::fini()
         throw_with_trace(
             std::runtime_error("Error shutting down OS monitoring library!"));
 
+    free(p_l2ids);
+    p_l2ids = nullptr;
+    l2_supported = false;
+
     ret = pqos_fini();
     if (ret != PQOS_RETVAL_OK)
         throw_with_trace(
@@ -343,6 +373,135 @@ void IntelRDT::print()
 {
 }
 
+bool IntelRDT::is_l2_supported() const
+{
+    return l2_supported;
+}
+
+/**
+ * @brief Set L2 class definitions on a given L2 cluster
+ *
+ * @param clos L2 CLOS ID to set
+ * @param mask class bitmask to set
+ * @param l2id L2 cluster ID
+ * @param cdp indicates if CDP is used
+ * @param scope L2 CAT update scope i.e. CDP Code/Data
+ *
+ * @return Number of classes set
+ * @retval -1 on error
+ */
+int IntelRDT::set_l2_clos(const unsigned clos, const uint64_t mask,
+                          const unsigned l2id, int cdp, const unsigned scope)
+{
+    if (!initialized)
+        throw_with_trace(std::runtime_error(
+            "Could not set L2 mask: init method must be called first"));
+
+    if (!l2_supported || mask == 0) {
+        throw_with_trace(
+            std::runtime_error("Failed to set L2 CAT configuration!"));
+        return -1;
+    }
+
+    // Get previous L2 configuration
+    struct pqos_l2ca l2ca_prev[PQOS_MAX_L2CA_COS];
+    uint32_t num_cos;
+
+    if (pqos_l2ca_get(l2id, PQOS_MAX_L2CA_COS, &num_cos, l2ca_prev) !=
+        PQOS_RETVAL_OK)
+        throw_with_trace(std::runtime_error("Could not get L2 mask for CLOS" +
+                                            std::to_string(clos)));
+
+    assert(l2ca_prev[clos].class_id == clos);
+
+    // Define new L2 configuration
+    struct pqos_l2ca l2ca_cos = {};
+    l2ca_cos.class_id = clos;
+    l2ca_cos.cdp = cdp;
+
+    // Set mask depending on data or code prio
+    if (l2ca_cos.cdp == 1) {
+        if (scope == CAT_UPDATE_SCOPE_CODE) {
+            l2ca_cos.u.s.code_mask = mask;
+            l2ca_cos.u.s.data_mask = l2ca_prev[clos].u.s.data_mask;
+        } else if (scope == CAT_UPDATE_SCOPE_DATA) {
+            l2ca_cos.u.s.data_mask = mask;
+            l2ca_cos.u.s.code_mask = l2ca_prev[clos].u.s.code_mask;
+        } else if (scope == CAT_UPDATE_SCOPE_BOTH) {
+            l2ca_cos.u.s.code_mask = mask;
+            l2ca_cos.u.s.data_mask = mask;
+        }
+    } else
+        l2ca_cos.u.ways_mask = mask;
+
+    int ret = pqos_l2ca_set(l2id, 1, &l2ca_cos);
+    if (ret != PQOS_RETVAL_OK)
+        throw_with_trace(std::runtime_error("Could not set L2 CLOS mask"));
+
+    if (l2ca_cos.cdp)
+        LOGINF("L2ID {} L2CA CLOS {} => DATA 0x{:x},CODE 0x{:x}"_format(
+            l2id, l2ca_cos.class_id, l2ca_cos.u.s.data_mask,
+            l2ca_cos.u.s.code_mask));
+    else
+        LOGINF("L2ID {} L2CA CLOS {} => MASK 0x{:x}"_format(
+            l2id, l2ca_cos.class_id, l2ca_cos.u.ways_mask));
+
+    return 1;
+}
+
+uint64_t IntelRDT::get_l2_cbm(uint32_t clos, uint32_t l2id,
+                              std::string type) const
+{
+    struct pqos_l2ca l2ca[PQOS_MAX_L2CA_COS];
+    uint32_t num_cos;
+    uint64_t mask;
+
+    if (!l2_supported)
+        return 0;
+
+    if (pqos_l2ca_get(l2id, PQOS_MAX_L2CA_COS, &num_cos, l2ca) !=
+        PQOS_RETVAL_OK)
+        throw_with_trace(std::runtime_error("Could not get L2 mask for CLOS" +
+                                            std::to_string(clos)));
+
+    assert(l2ca[clos].class_id == clos);
+
+    if (l2ca[clos].cdp == 1) {
+        if (type.compare("code"))
+            mask = l2ca[clos].u.s.code_mask;
+        else
+            mask = l2ca[clos].u.s.data_mask;
+    } else
+        mask = l2ca[clos].u.ways_mask;
+
+    return mask;
+}
+
+uint32_t IntelRDT::get_l2_max_closids() const
+{
+    uint32_t max_num_cos;
+    if (pqos_l2ca_get_cos_num(p_cap, &max_num_cos) != PQOS_RETVAL_OK)
+        throw_with_trace(
+            std::runtime_error("Could not get the max number of L2 CLOS"));
+    return max_num_cos;
+}
+
+uint32_t IntelRDT::get_l2id(uint32_t cpu) const
+{
+    uint32_t l2id;
+    if (pqos_cpu_get_clusterid(p_cpu, cpu, &l2id) != PQOS_RETVAL_OK)
+        throw_with_trace(std::runtime_error("Could not get L2 cluster of CPU " +
+                                            std::to_string(cpu)));
+    return l2id;
+}
+
+std::vector<unsigned> IntelRDT::get_l2ids() const
+{
+    if (!l2_supported)
+        return {};
+    return std::vector<unsigned>(p_l2ids, p_l2ids + l2_count);
+}
+
 /**
  * @brief Set MBA class definitions on given socket
  *
@@ -390,8 +549,10 @@ int IntelRDT::set_mba_clos(const unsigned clos, const uint64_t mb,
  * @param [in] socket CPU socket id
  * @param [in] ctrl Flag indicating a use of MBA controller in MBps
  * @param [in] mb amount of memory bandwidth to be set
+ *
+ * @return memory bandwidth actually set, as the hardware rounds the value
  */
-void IntelRDT::set_mb(uint32_t clos, uint32_t socket, int ctrl, unsigned mb)
+unsigned IntelRDT::set_mb(uint32_t clos, uint32_t socket, int ctrl, unsigned mb)
 {
     if (!initialized)
         throw_with_trace(std::runtime_error(
@@ -413,8 +574,11 @@ void IntelRDT::set_mb(uint32_t clos, uint32_t socket, int ctrl, unsigned mb)
     if (ret != PQOS_RETVAL_OK)
         throw_with_trace(std::runtime_error("Method pqos_mba_set FAILED!"));
 
-    LOGINF("SOCKET {} MBA CLOS {} => {} MBps"_format(socket, actual.class_id,
-                                                     actual.mb_max));
+    LOGINF("SOCKET {} MBA CLOS {} => requested {}, actual {} {}"_format(
+        socket, actual.class_id, requested.mb_max, actual.mb_max,
+        ctrl ? "MBps" : "%"));
+
+    return actual.mb_max;
 }
 
 /*
@@ -457,6 +621,81 @@ uint64_t IntelRDT::get_mb(uint32_t clos, uint32_t socket)
     return tab[clos].mb_max;
 }
 
+/**
+ * @brief Takes a slot for a new monitoring group, reusing released ones
+ *
+ * @return Index of the slot in the monitoring group table
+ */
+unsigned IntelRDT::monitor_alloc_group()
+{
+    if (mon_max_groups > 0 && monitor_num_groups() >= mon_max_groups)
+        throw_with_trace(std::runtime_error(
+            "No RMIDs left: {} monitoring groups already in use"_format(
+                monitor_num_groups())));
+
+    unsigned slot;
+    if (!mon_free.empty()) {
+        slot = mon_free.back();
+        mon_free.pop_back();
+    } else {
+        slot = mon_grps.size();
+        mon_grps.emplace_back();
+    }
+
+    mon_grps[slot].data = (pqos_mon_data *)calloc(1, sizeof(pqos_mon_data));
+    if (mon_grps[slot].data == NULL) {
+        mon_free.push_back(slot);
+        throw_with_trace(
+            std::runtime_error("Could not allocate monitoring group"));
+    }
+
+    return slot;
+}
+
+/**
+ * @brief Releases a monitoring group slot and its lookup entries
+ *
+ * @param [in] slot: index of the slot in the monitoring group table
+ */
+void IntelRDT::monitor_free_group(unsigned slot)
+{
+    auto &grp = mon_grps[slot];
+
+    for (const auto &pid : grp.pids)
+        mon_pid_slot.erase(pid);
+    for (const auto &core : grp.cores)
+        mon_core_slot.erase(core);
+    for (auto it = mon_clos_slot.begin(); it != mon_clos_slot.end();) {
+        if (it->second == slot)
+            it = mon_clos_slot.erase(it);
+        else
+            ++it;
+    }
+
+    free(grp.data);
+    grp = mon_group_t();
+    mon_free.push_back(slot);
+}
+
+/**
+ * @brief Converts the last polled values of a group to MB and MBps
+ */
+void IntelRDT::monitor_values(unsigned slot, double *llc_occup,
+                              double *lmem_bw, double *tmem_bw,
+                              double *rmem_bw) const
+{
+    const struct pqos_event_values *pv = &mon_grps[slot].data->values;
+
+    *llc_occup = pv->llc / (1024.0 * 1024.0);
+    *lmem_bw = pv->mbm_local / (1024.0 * 1024.0);
+    *tmem_bw = pv->mbm_total / (1024.0 * 1024.0);
+
+    if (pv->mbm_total > pv->mbm_local)
+        *rmem_bw = (pv->mbm_total - pv->mbm_local) / (1024.0 * 1024.0);
+    else
+        *rmem_bw = 0;
+}
+
 /**
  * @brief Starts monitoring LLC occupancy and memory BWs. of a given pid
  *
@@ -468,108 +707,176 @@ uint64_t IntelRDT::get_mb(uint32_t clos, uint32_t socket)
  */
 int IntelRDT::monitor_setup_pid(pid_t pid)
 {
-    unsigned i;
-    int ret;
-    const struct pqos_capability *cap_mon = NULL;
-    void *context = NULL;
-    enum pqos_mon_event all_evts = (enum pqos_mon_event)0;
+    return monitor_setup_pids({pid});
+}
 
-    // Get monitoring capabilities:
-    ret = pqos_cap_get_type(p_cap, PQOS_CAP_TYPE_MON, &cap_mon);
-    if (ret == PQOS_RETVAL_PARAM)
-        printf("Error retrieving monitoring capabilities!\n");
+/**
+ * @brief Starts monitoring a set of pids as a single group (one RMID), e.g.
+ * all the vCPU threads of a VM
+ *
+ * @param [in] pids: PIDs of the processes to be monitored together
+ *
+ * @return Operation status
+ * @retval 0 OK
+ * @retval -1 error
+ */
+int IntelRDT::monitor_setup_pids(const std::vector<pid_t> &pids)
+{
+    if (!initialized)
+        throw_with_trace(std::runtime_error(
+            "Could not start monitoring: init method must be called first"));
 
-    // Get all available events on this platform
-    for (i = 0; i < cap_mon->u.mon->num_events; i++) {
-        struct pqos_monitor *mon = &cap_mon->u.mon->events[i];
-        LOGINF("EVENT SUPPORTED: {}"_format(mon->type));
-        // Include only LLC occup and MBM events
-        if (mon->type <= 8) {
-            all_evts = static_cast<pqos_mon_event>(
-                static_cast<int>(mon->type | all_evts));
-            LOGINF("--> EVENT INCLUDED: {}"_format(mon->type));
-        }
-    }
+    if (pids.empty())
+        throw_with_trace(std::runtime_error("No PIDs to monitor"));
 
-    unsigned index = num_pids;
-    if (free_pids) {
-        index = free_pids_index;
-        LOGINF("Free_pids true! index {}"_format(index));
-    }
-    m_mon_grps[index] = (pqos_mon_data *)malloc(sizeof(**m_mon_grps));
-    sel_monitor_pid_tab[index].pgrp = m_mon_grps[index];
-    sel_monitor_pid_tab[index].pid = pid;
+    for (const auto &pid : pids)
+        if (mon_pid_slot.count(pid))
+            throw_with_trace(std::runtime_error(
+                "PID {} is already being monitored"_format(pid)));
 
-    LOGINF("os_mon_start_pids...");
-    ret = pqos_mon_start_pids(1, &pid, all_evts, context,
-                              sel_monitor_pid_tab[index].pgrp);
-    LOGINF("os_mon_start_pids DONE");
+    unsigned slot = monitor_alloc_group();
+    auto &grp = mon_grps[slot];
+
+    int ret = pqos_mon_start_pids(pids.size(), pids.data(), mon_events, NULL,
+                                  grp.data);
 
     //Any problem with monitoring the process?
     if (ret != PQOS_RETVAL_OK) {
-        LOGINF("PID {} monitoring start error, status {}"_format(pid, ret));
+        LOGINF("PIDs {} monitoring start error, status {}"_format(
+            iterable_to_string(pids.begin(), pids.end(),
+                               [](const auto &p) { return "{}"_format(p); },
+                               ","),
+            ret));
+        monitor_free_group(slot);
         throw_with_trace(
-            std::runtime_error("Method os_mon_start_pids FAILED!!"));
+            std::runtime_error("Method pqos_mon_start_pids FAILED!!"));
         return -1;
     }
 
-    if (!free_pids) {
-        num_pids++;
-        LOGINF("Free_pids {} so update num_pids"_format(free_pids));
-    } else {
-        free_pids = false;
-    }
-
-    LOGINF("num_pids: {}"_format(num_pids));
+    grp.pids = pids;
+    for (const auto &pid : pids)
+        mon_pid_slot[pid] = slot;
 
-    LOGINF("PQOS EVENTS SUCCESSFULLY SETUP");
+    LOGINF("Monitoring group {} started for PIDs {} ({} RMIDs in use)"_format(
+        slot,
+        iterable_to_string(pids.begin(), pids.end(),
+                           [](const auto &p) { return "{}"_format(p); }, ","),
+        monitor_num_groups()));
     return 0;
 }
 
 /**
- * @brief Returns value of a given counter for a given pid
+ * @brief Adds a set of pids to the monitoring group of a CLOS, starting the
+ * group if it does not exist yet. The group keeps the CLOS it was created
+ * for, even if the tasks are later moved to another CLOS.
  *
- * @param [in] pid: PID of process to be monitored
- * @param [in] event: value of counter to return
+ * @param [in] clos: CLOS whose group will contain the pids
+ * @param [in] pids: PIDs of the processes to be monitored
  *
- * @return counter reading
+ * @return Operation status
+ * @retval 0 OK
+ * @retval -1 error
  */
-void IntelRDT::monitor_get_values_pid(pid_t pid, double *llc_occup,
-                                      double *lmem_bw, double *tmem_bw,
-                                      double *rmem_bw)
+int IntelRDT::monitor_setup_clos(uint32_t clos, const std::vector<pid_t> &pids)
 {
-    unsigned i, i_pid;
-    int ret;
-    double val = 0;
+    auto it = mon_clos_slot.find(clos);
+    if (it == mon_clos_slot.end()) {
+        monitor_setup_pids(pids);
+        mon_clos_slot[clos] = mon_pid_slot.at(pids[0]);
+        return 0;
+    }
 
-    // Poll all groups
-    ret = os_mon_poll(m_mon_grps, (unsigned)num_pids);
-    if (ret != PQOS_RETVAL_OK)
-        throw_with_trace(std::runtime_error("Method os_mon_poll FAILED!!"));
+    return monitor_add_pids(it->second, pids);
+}
 
-    // Get group for wanted PID
-    for (i = 0; i < num_pids; i++) {
-        if (m_mon_grps[i]->pids[0] == pid) {
-            i_pid = i;
-            break;
-        }
+/**
+ * @brief Adds a set of pids to an active monitoring group
+ *
+ * @param [in] slot: monitoring group
+ * @param [in] pids: PIDs of the processes to be monitored
+ *
+ * @return Operation status
+ * @retval 0 OK
+ * @retval -1 error
+ */
+int IntelRDT::monitor_add_pids(unsigned slot, const std::vector<pid_t> &pids)
+{
+    for (const auto &pid : pids)
+        if (mon_pid_slot.count(pid))
+            throw_with_trace(std::runtime_error(
+                "PID {} is already being monitored"_format(pid)));
+
+    auto &grp = mon_grps[slot];
+
+    int ret = pqos_mon_add_pids(pids.size(), pids.data(), grp.data);
+    if (ret != PQOS_RETVAL_OK) {
+        LOGINF("Monitoring group {} add error, status {}"_format(slot, ret));
+        throw_with_trace(
+            std::runtime_error("Method pqos_mon_add_pids FAILED!!"));
+        return -1;
     }
 
-    // Get value of the event passed as parameter
-    struct pqos_event_values *pv = &m_mon_grps[i_pid]->values;
+    for (const auto &pid : pids) {
+        grp.pids.push_back(pid);
+        mon_pid_slot[pid] = slot;
+    }
 
-    *llc_occup = pv->llc / (1024.0 * 1024.0);
-    *lmem_bw = pv->mbm_local / (1024.0 * 1024.0);
-    *tmem_bw = pv->mbm_total / (1024.0 * 1024.0);
+    LOGINF("Monitoring group {} now has {} PIDs"_format(slot,
+                                                        grp.pids.size()));
+    return 0;
+}
 
-    if (pv->mbm_total > pv->mbm_local)
-        *rmem_bw = (pv->mbm_total - pv->mbm_local) / (1024.0 * 1024.0);
-    else
-        *rmem_bw = 0;
+/**
+ * @brief Starts monitoring a new pid of a task (e.g. a restarted process),
+ * in the group of the task or of its CLOS if the RMIDs are grouped
+ *
+ * @param [in] pid: PID of the new process
+ * @param [in] task_pids: PIDs of the task, the group of the first one still
+ * monitored is used
+ * @param [in] clos: CLOS the task is mapped to
+ *
+ * @return Operation status
+ * @retval 0 OK
+ * @retval -1 error
+ */
+int IntelRDT::monitor_setup_task_pid(pid_t pid,
+                                     const std::vector<pid_t> &task_pids,
+                                     uint32_t clos)
+{
+    if (mon_grouping == "clos")
+        return monitor_setup_clos(clos, {pid});
+
+    if (mon_grouping == "task") {
+        for (const auto &p : task_pids) {
+            auto it = mon_pid_slot.find(p);
+            if (p != pid && it != mon_pid_slot.end())
+                return monitor_add_pids(it->second, {pid});
+        }
+    }
+    return monitor_setup_pid(pid);
+}
+
+/**
+ * @brief Returns the values of the group that monitors a given pid. If the
+ * group covers several pids, the values are those of the whole group.
+ *
+ * @param [in] pid: PID of process to be monitored
+ */
+void IntelRDT::monitor_get_values_pid(pid_t pid, double *llc_occup,
+                                      double *lmem_bw, double *tmem_bw,
+                                      double *rmem_bw)
+{
+    auto it = mon_pid_slot.find(pid);
+    if (it == mon_pid_slot.end())
+        throw_with_trace(std::runtime_error(
+            "PID {} is not being monitored"_format(pid)));
+
+    monitor_values(it->second, llc_occup, lmem_bw, tmem_bw, rmem_bw);
 }
 
 /**
- * @brief Stops monitoring LLC occupancy and memory BWs. of a given pid
+ * @brief Stops monitoring LLC occupancy and memory BWs. of a given pid. The
+ * RMID is released once its group has no pids left.
  *
  * @param [in] pid: PID of process to stop monitoring
  *
@@ -579,27 +886,70 @@ void IntelRDT::monitor_get_values_pid(pid_t pid, double *llc_occup,
  */
 int IntelRDT::monitor_stop_pid(pid_t pid)
 {
-    // Get group for wanted PID
-    for (uint32_t i = 0; i < num_pids; i++) {
-        if (m_mon_grps[i]->pids[0] == pid) {
-            free_pids_index = i;
-            free_pids = true;
-
-            int ret = pqos_mon_stop(m_mon_grps[i]);
+    auto it = mon_pid_slot.find(pid);
+    if (it == mon_pid_slot.end())
+        return 0;
+
+    unsigned slot = it->second;
+    auto &grp = mon_grps[slot];
+
+    if (grp.pids.size() > 1) {
+        // The process may be gone already, so this is not fatal
+        int ret = pqos_mon_remove_pids(1, &pid, grp.data);
+        if (ret != PQOS_RETVAL_OK)
+            LOGWAR("Could not remove PID {} from monitoring group {}"_format(
+                pid, slot));
+
+        grp.pids.erase(std::remove(grp.pids.begin(), grp.pids.end(), pid),
+                       grp.pids.end());
+        mon_pid_slot.erase(it);
+        LOGINF("Stop PQOS monitoring for task {}"_format(pid));
+        return 0;
+    }
 
-            if (ret != PQOS_RETVAL_OK) {
-                throw_with_trace(std::runtime_error("Monitoring stop error!"));
-                return -1;
-            }
+    int ret = pqos_mon_stop(grp.data);
+    monitor_free_group(slot);
 
-            free(m_mon_grps[i]);
-            LOGINF("Stop PQOS monitoring for task {}"_format(pid));
-            break;
-        }
+    if (ret != PQOS_RETVAL_OK) {
+        throw_with_trace(std::runtime_error("Monitoring stop error!"));
+        return -1;
     }
+
+    LOGINF("Stop PQOS monitoring for task {} ({} RMIDs in use)"_format(
+        pid, monitor_num_groups()));
     return 0;
 }
 
+/**
+ * @brief Returns the number of pids that share the monitoring group of a pid,
+ * so the values of a group can be split among its members
+ *
+ * @param [in] pid: PID of a monitored process
+ *
+ * @return Number of pids in the group, 0 if the pid is not monitored
+ */
+unsigned IntelRDT::monitor_group_size_pid(pid_t pid) const
+{
+    auto it = mon_pid_slot.find(pid);
+    if (it == mon_pid_slot.end())
+        return 0;
+    return mon_grps[it->second].pids.size();
+}
+
+/**
+ * @brief Sets how the pids are grouped in RMIDs ("pid", "task" or "clos"),
+ * used to monitor the new pids of the tasks
+ */
+void IntelRDT::set_monitor_grouping(const std::string &grouping)
+{
+    mon_grouping = grouping;
+}
+
+const std::string &IntelRDT::get_monitor_grouping() const
+{
+    return mon_grouping;
+}
+
 /**
  * @brief Starts monitoring LLC occupancy and memory BWs. of a given core
  *
@@ -611,104 +961,50 @@ int IntelRDT::monitor_stop_pid(pid_t pid)
  */
 int IntelRDT::monitor_setup_core(uint32_t core)
 {
-    unsigned i;
-    int ret;
-    const struct pqos_capability *cap_mon = NULL;
-    void *context = NULL;
-    enum pqos_mon_event all_evts = (enum pqos_mon_event)0;
-
-    // Get monitoring capabilities:
-    ret = pqos_cap_get_type(p_cap, PQOS_CAP_TYPE_MON, &cap_mon);
-    if (ret == PQOS_RETVAL_PARAM)
-        printf("Error retrieving monitoring capabilities!\n");
-
-    // Get all available events on this platform
-    for (i = 0; i < cap_mon->u.mon->num_events; i++) {
-        struct pqos_monitor *mon = &cap_mon->u.mon->events[i];
-        LOGINF("EVENT SUPPORTED: {}"_format(mon->type));
-        // Include only LLC occup and MBM events
-        if (mon->type <= 8) {
-            all_evts = static_cast<pqos_mon_event>(
-                static_cast<int>(mon->type | all_evts));
-            LOGINF("--> EVENT INCLUDED: {}"_format(mon->type));
-        }
-    }
+    if (!initialized)
+        throw_with_trace(std::runtime_error(
+            "Could not start monitoring: init method must be called first"));
 
-    unsigned index = num_cores;
-    if (free_cores) {
-        index = free_cores_index;
-        LOGINF("Free_cores true! index {}"_format(index));
-    }
+    if (mon_core_slot.count(core))
+        throw_with_trace(std::runtime_error(
+            "Core {} is already being monitored"_format(core)));
 
-    m_mon_grps[index] = (pqos_mon_data *)malloc(sizeof(**m_mon_grps));
-    sel_monitor_core_tab[index].pgrp = m_mon_grps[index];
-    sel_monitor_core_tab[index].core = core;
+    unsigned slot = monitor_alloc_group();
+    auto &grp = mon_grps[slot];
 
-    LOGINF("os_mon_start...");
-    ret = pqos_mon_start(1, &core, all_evts, context,
-                         sel_monitor_core_tab[index].pgrp);
-    LOGINF("os_mon_start DONE");
+    int ret = pqos_mon_start(1, &core, mon_events, NULL, grp.data);
 
-    //Any problem with monitoring the process?
+    //Any problem with monitoring the core?
     if (ret != PQOS_RETVAL_OK) {
         LOGINF("Core {} monitoring start error, status {}"_format(core, ret));
+        monitor_free_group(slot);
         throw_with_trace(std::runtime_error("Method os_mon_start FAILED!!"));
         return -1;
     }
 
-    if (!free_cores) {
-        num_cores++;
-        LOGINF("Free_cores {} so update num_pids"_format(free_cores));
-    } else {
-        free_cores = false;
-    }
-
-    LOGINF("num_cores: {}"_format(num_cores));
+    grp.cores.push_back(core);
+    mon_core_slot[core] = slot;
 
-    LOGINF("PQOS EVENTS SUCCESSFULLY SETUP");
+    LOGINF("Monitoring group {} started for core {} ({} RMIDs in use)"_format(
+        slot, core, monitor_num_groups()));
     return 0;
 }
 
 /**
- * @brief Returns value of a given counter for a given core
+ * @brief Returns the values of the group that monitors a given core
  *
  * @param [in] core: core number to be monitored
- * @param [in] event: value of counter to return
- *
- * @return counter reading
  */
 void IntelRDT::monitor_get_values_core(uint32_t core, double *llc_occup,
                                        double *lmem_bw, double *tmem_bw,
                                        double *rmem_bw)
 {
-    unsigned i, i_core;
-    int ret;
-    double val = 0;
-
-    // Poll all groups
-    ret = os_mon_poll(m_mon_grps, (unsigned)num_cores);
-    if (ret != PQOS_RETVAL_OK)
-        throw_with_trace(std::runtime_error("Method os_mon_poll FAILED!!"));
-
-    // Get group for wanted core
-    for (i = 0; i < num_cores; i++) {
-        if (m_mon_grps[i]->cores[0] == core) {
-            i_core = i;
-            break;
-        }
-    }
-
-    // Get value of the event passed as parameter
-    struct pqos_event_values *pv = &m_mon_grps[i_core]->values;
-
-    *llc_occup = pv->llc / (1024.0 * 1024.0);
-    *lmem_bw = pv->mbm_local / (1024.0 * 1024.0);
-    *tmem_bw = pv->mbm_total / (1024.0 * 1024.0);
+    auto it = mon_core_slot.find(core);
+    if (it == mon_core_slot.end())
+        throw_with_trace(std::runtime_error(
+            "Core {} is not being monitored"_format(core)));
 
-    if (pv->mbm_total > pv->mbm_local)
-        *rmem_bw = (pv->mbm_total - pv->mbm_local) / (1024.0 * 1024.0);
-    else
-        *rmem_bw = 0;
+    monitor_values(it->second, llc_occup, lmem_bw, tmem_bw, rmem_bw);
 }
 
 /**
@@ -722,24 +1018,48 @@ void IntelRDT::monitor_get_values_core(uint32_t core, double *llc_occup,
  */
 int IntelRDT::monitor_stop_core(uint32_t core)
 {
-    // Get group for wanted core
-    for (uint32_t i = 0; i < num_cores; i++) {
-        if (m_mon_grps[i]->cores[0] == core) {
-            free_cores_index = i;
-            free_cores = true;
-
-            int ret = pqos_mon_stop(m_mon_grps[i]);
+    auto it = mon_core_slot.find(core);
+    if (it == mon_core_slot.end())
+        return 0;
 
-            if (ret != PQOS_RETVAL_OK) {
-                throw_with_trace(std::runtime_error("Monitoring stop error!"));
-                return -1;
-            }
+    unsigned slot = it->second;
+    int ret = pqos_mon_stop(mon_grps[slot].data);
+    monitor_free_group(slot);
 
-            free(m_mon_grps[i]);
-            LOGINF("Stop PQOS monitoring for core {}"_format(core));
-            break;
-        }
+    if (ret != PQOS_RETVAL_OK) {
+        throw_with_trace(std::runtime_error("Monitoring stop error!"));
+        return -1;
     }
 
+    LOGINF("Stop PQOS monitoring for core {}"_format(core));
     return 0;
 }
+
+/**
+ * @brief Polls all the active monitoring groups. Must be called once per
+ * interval, before reading the values of any pid or core.
+ */
+void IntelRDT::monitor_poll()
+{
+    std::vector<struct pqos_mon_data *> active;
+    for (const auto &grp : mon_grps)
+        if (grp.data != nullptr)
+            active.push_back(grp.data);
+
+    if (active.empty())
+        return;
+
+    int ret = os_mon_poll(active.data(), (unsigned)active.size());
+    if (ret != PQOS_RETVAL_OK)
+        throw_with_trace(std::runtime_error("Method os_mon_poll FAILED!!"));
+}
+
+unsigned IntelRDT::monitor_num_groups() const
+{
+    return mon_grps.size() - mon_free.size();
+}
+
+unsigned IntelRDT::monitor_max_groups() const
+{
+    return mon_max_groups;
+}
@@ -48,62 +48,107 @@ class IntelRDT
     const struct pqos_cap *p_cap;
     unsigned *p_sockets;
     unsigned sock_count;
-
-    //struct pqos_mon_data *m_mon_grps[PQOS_MAX_PIDS];
-    struct pqos_mon_data *m_mon_grps[PQOS_MAX_CORES];
-    unsigned num_pids = 0;
-    unsigned num_cores = 0;
-
-	bool free_pids = false;
-	unsigned free_pids_index = 0;
-
-	bool free_cores = false;
-	unsigned free_cores_index = 0;
+    unsigned *p_l2ids = nullptr;
+    unsigned l2_count = 0;
+    bool l2_supported = false;
+
+    // Monitoring groups. Every active group holds one RMID, which is a scarce
+    // resource, so released slots are recycled through a free-list.
+    struct mon_group_t {
+        struct pqos_mon_data *data = nullptr;
+        std::vector<pid_t> pids;
+        std::vector<uint32_t> cores;
+    };
+    std::vector<mon_group_t> mon_grps;
+    std::vector<unsigned> mon_free;              // Free slots in mon_grps
+    std::map<pid_t, unsigned> mon_pid_slot;      // PID -> monitoring group
+    std::map<uint32_t, unsigned> mon_core_slot;  // Core -> monitoring group
+    std::map<uint32_t, unsigned> mon_clos_slot;  // CLOS -> monitoring group
+    std::string mon_grouping = "pid";            // RMID per pid, task or CLOS
+    enum pqos_mon_event mon_events = (enum pqos_mon_event)0;
+    unsigned mon_max_groups = 0;
+
+    unsigned monitor_alloc_group();
+    void monitor_free_group(unsigned slot);
+    int monitor_add_pids(unsigned slot, const std::vector<pid_t> &pids);
+    void monitor_values(unsigned slot, double *llc_occup, double *lmem_bw,
+                        double *tmem_bw, double *rmem_bw) const;
 
   public:
+    // Methods are virtual so that the policies can also drive an in-memory
+    // implementation (see ShadowRDT)
     IntelRDT() = default;
-    ~IntelRDT() = default;
+    virtual ~IntelRDT() = default;
 
-    bool is_initialized() const;
-    void init();
-    void reset();
-    void fini();
+    virtual bool is_initialized() const;
+    virtual void init();
+    virtual void reset();
+    virtual void fini();
 
-    void set_cbm(uint32_t clos, uint32_t socket, uint64_t cbm, uint32_t cdp,
-                 std::string type = "code");
-    void add_cpu(uint32_t clos, uint32_t cpu);
-    void set_config(const enum pqos_cdp_config l3_cdp_cfg,
-                    const enum pqos_mba_config mba_cfg);
+    virtual void set_cbm(uint32_t clos, uint32_t socket, uint64_t cbm,
+                         uint32_t cdp, std::string type = "code");
+    virtual void add_cpu(uint32_t clos, uint32_t cpu);
+    virtual void set_config(const enum pqos_cdp_config l3_cdp_cfg,
+                            const enum pqos_mba_config mba_cfg);
 
-    uint32_t get_clos(uint32_t cpu) const;
-    uint64_t get_cbm(uint32_t clos, uint32_t socket,
-                     std::string type = "code") const;
-    uint32_t get_max_closids() const;
+    virtual uint32_t get_clos(uint32_t cpu) const;
+    virtual uint64_t get_cbm(uint32_t clos, uint32_t socket,
+                             std::string type = "code") const;
+    virtual uint32_t get_max_closids() const;
+    virtual uint64_t get_l3_way_size() const;
 
     /* CAT Intel API */
-    int set_l3_clos(const unsigned clos, const uint64_t mask,
-                    const unsigned socket, int cdp, const unsigned scope);
-    void add_task(uint32_t clos, pid_t pid);
-    uint32_t get_clos_of_task(pid_t pid) const;
+    virtual int set_l3_clos(const unsigned clos, const uint64_t mask,
+                            const unsigned socket, int cdp,
+                            const unsigned scope);
+    virtual void add_task(uint32_t clos, pid_t pid);
+    virtual uint32_t get_clos_of_task(pid_t pid) const;
+
+    /* L2 CAT Intel API */
+    virtual bool is_l2_supported() const;
+    virtual int set_l2_clos(const unsigned clos, const uint64_t mask,
+                            const unsigned l2id, int cdp,
+                            const unsigned scope);
+    virtual uint64_t get_l2_cbm(uint32_t clos, uint32_t l2id,
+                                std::string type = "code") const;
+    virtual uint32_t get_l2_max_closids() const;
+    virtual uint32_t get_l2id(uint32_t cpu) const;
+    virtual std::vector<unsigned> get_l2ids() const;
 
     /*MBA Intel API*/
-    int set_mba_clos(const unsigned clos, const uint64_t mb,
-                     const unsigned socket, int ctrl);
-    void set_mb(uint32_t clos, uint32_t socket, int ctrl, unsigned mb);
-    uint64_t get_mb(uint32_t clos, uint32_t socket);
+    virtual int set_mba_clos(const unsigned clos, const uint64_t mb,
+                             const unsigned socket, int ctrl);
+    virtual unsigned set_mb(uint32_t clos, uint32_t socket, int ctrl,
+                            unsigned mb);
+    virtual uint64_t get_mb(uint32_t clos, uint32_t socket);
 
     /*Monitoring PID*/
-    int monitor_setup_pid(pid_t pid);
-    void monitor_get_values_pid(pid_t pid, double *llc_occup, double *lmem_bw,
-                                double *tmem_bw, double *rmem_bw);
-    int monitor_stop_pid(pid_t pid);
+    virtual int monitor_setup_pid(pid_t pid);
+    virtual int monitor_setup_pids(const std::vector<pid_t> &pids);
+    virtual int monitor_setup_clos(uint32_t clos,
+                                   const std::vector<pid_t> &pids);
+    virtual void monitor_get_values_pid(pid_t pid, double *llc_occup,
+                                        double *lmem_bw, double *tmem_bw,
+                                        double *rmem_bw);
+    virtual int monitor_setup_task_pid(pid_t pid,
+                                       const std::vector<pid_t> &task_pids,
+                                       uint32_t clos);
+    virtual int monitor_stop_pid(pid_t pid);
+    virtual unsigned monitor_group_size_pid(pid_t pid) const;
+    void set_monitor_grouping(const std::string &grouping);
+    const std::string &get_monitor_grouping() const;
 
     /*Monitoring core*/
-    int monitor_setup_core(uint32_t core);
-    void monitor_get_values_core(uint32_t core, double *llc_occup,
-                                 double *lmem_bw, double *tmem_bw,
-                                 double *rmem_bw);
-    int monitor_stop_core(uint32_t core);
-
-    void print();
+    virtual int monitor_setup_core(uint32_t core);
+    virtual void monitor_get_values_core(uint32_t core, double *llc_occup,
+                                         double *lmem_bw, double *tmem_bw,
+                                         double *rmem_bw);
+    virtual int monitor_stop_core(uint32_t core);
+
+    /*Monitoring groups*/
+    virtual void monitor_poll();
+    virtual unsigned monitor_num_groups() const;
+    virtual unsigned monitor_max_groups() const;
+
+    virtual void print();
 };
@@ -17,6 +17,7 @@
 #include <algorithm>
 #include <array>
 #include <clocale>
+#include <cmath>
 #include <csignal>
 #include <iostream>
 #include <thread>
@@ -35,10 +36,15 @@
 #include "policy.hpp"
 #include "common.hpp"
 #include "config.hpp"
+#include "cpu-quota.hpp"
 #include "events-perf.hpp"
 #include "intel-rdt.hpp"
 #include "log.hpp"
+#include "memory.hpp"
 #include "net-bandwidth.hpp"
+#include "ovsdb.hpp"
+#include "power.hpp"
+#include "slo.hpp"
 #include "stats.hpp"
 #include "vm-task.hpp"
 
@@ -65,8 +71,10 @@ void loop(tasklist_t &tasklist, std::shared_ptr<cat::policy::Base> catpol,
           Perf &perf, const vector<string> &events, uint64_t time_int_us,
           uint32_t max_int, std::ostream &out, std::ostream &ucompl_out,
           std::ostream &total_out);
-void clean(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf);
-[[noreturn]] void clean_and_die(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf,
+void clean(tasklist_t &tasklist, CAT_ptr_t cat,
+           std::shared_ptr<PowerCtl> power, Perf &perf);
+[[noreturn]] void clean_and_die(tasklist_t &tasklist, CAT_ptr_t cat,
+                                std::shared_ptr<PowerCtl> power, Perf &perf,
                                 bool monitor_only);
 std::string program_options_to_string(const std::vector<po::option> &raw);
 void adjust_time(const time_point_t &start_int, const time_point_t &start_glob,
@@ -106,6 +114,17 @@ CAT_ptr_t cat_setup(const vector<Cos> &coslist)
             cat->set_mba_clos(cos.num, cos.mbps, 1, 1);
         }
 
+        // Set initial L2 ways in every L2 cluster (if required)
+        if (cos.l2_mask) {
+            if (!cat->is_l2_supported())
+                throw_with_trace(std::runtime_error(
+                    "CLOS {} has an l2_schemata but L2 CAT is not supported"_format(
+                        cos.num)));
+            for (const auto &l2id : cat->get_l2ids())
+                cat->set_l2_clos(cos.num, cos.l2_mask, l2id, 0,
+                                 CAT_UPDATE_SCOPE_BOTH);
+        }
+
         for (const auto &cpu : cos.cpus)
             cat->add_cpu(cos.num, cpu);
     }
@@ -209,13 +228,14 @@ void simple_loop(tasklist_t &tasklist,
                             vm_ptr->pids[num_cpu], (int)vm_ptr->pids[num_cpu],
                             task_ptr->llc_occup, task_ptr->lmem_bw,
                             task_ptr->tmem_bw, task_ptr->rmem_bw,
-                            vm_ptr->diskUtils, 0, 0, 0, 0, 0)[0];
+                            vm_ptr->diskUtils, 0, 0, 0, 0, 0, 0, 0,
+                            VmMemory(), 0, 0, 0)[0];
                     else if (perf.get_perf_type() == "CPU")
                         counters = perf.read_counters(
                             vm_ptr->pids[num_cpu], *it, task_ptr->llc_occup,
                             task_ptr->lmem_bw, task_ptr->tmem_bw,
                             task_ptr->rmem_bw, vm_ptr->diskUtils, 0, 0, 0, 0,
-                            0)[0];
+                            0, 0, 0, VmMemory(), 0, 0, 0)[0];
 
                 } else if (std::dynamic_pointer_cast<AppTask>(task_ptr) !=
                            nullptr) {
@@ -256,9 +276,10 @@ void simple_loop(tasklist_t &tasklist,
             VMTask &task = *vm_ptr;
             net_setBwLimit(task, task.netbw_in_avg, task.netbw_in_peak,
                            task.netbw_in_burst, task.netbw_out_avg,
-                           task.netbw_out_peak, task.netbw_out_burst);
+                           task.netbw_out_peak, task.netbw_out_burst, false);
         }
     }
+    net_commitLimits();
 
     /**** LOOP UNTIL END OF EXECUTION ****/
     uint32_t interval;
@@ -368,6 +389,18 @@ void simple_loop(tasklist_t &tasklist,
                     new_task_completion);
 
         //----> 3. Post-sleep calculations
+        // Poll every RDT monitoring group once per interval
+        catpol->get_cat()->monitor_poll();
+
+        // Latency reported by the clients in this interval
+        slo_monitor().poll(interval, runlist);
+
+        // CFS throttling of each task in this interval
+        cpu_quota().poll(runlist);
+
+        // Memory of the VMs and memory pressure of the host
+        memory_monitor().poll(interval_ti, runlist);
+
         bool all_started = true;
         for (const auto &task_ptr : runlist) {
             //if (task_ptr->name == "stress_ng_VM")
@@ -455,6 +488,9 @@ void simple_loop(tasklist_t &tasklist,
                     (tx - task.ovs_bwtx) / ((double)interval_ti) / 1024;
                 //LOGINF("OVS_BW VM {}:\tRx:{}KB/s\tTx:{}KB/s\tRxTx:{}KB/s"_format(task.domain_name, task.ovs_bwrx, task.ovs_bwtx,(task.ovs_bwtx + task.ovs_bwrx)));
 
+                // Drops of the per-VM policers
+                net_pollQosStats(task, interval_ti);
+
                 if (!task.task_exited(monitor_only)) {
                     // Read disk utilization should precede perf_read_counters
                     // to add disk stats correctly to the csv
@@ -483,6 +519,17 @@ void simple_loop(tasklist_t &tasklist,
                         *it, &task_ptr->llc_occup, &task_ptr->lmem_bw,
                         &task_ptr->tmem_bw, &task_ptr->rmem_bw);
 
+                // Get L2 mask of the CLOS the task or core is mapped to
+                if (catpol->get_cat()->is_l2_supported()) {
+                    const auto &cat = catpol->get_cat();
+                    uint32_t clos =
+                        (perf.get_perf_type() == "PID")
+                            ? cat->get_clos_of_task(task_ptr->pids[num_cpu])
+                            : cat->get_clos(*it);
+                    task_ptr->l2_mask[*it] =
+                        cat->get_l2_cbm(clos, cat->get_l2id(*it));
+                }
+
                 // Get CPU utilzation of each core
                 float util_core = get_cpu_utilization(entries1, entries2, *it);
                 task_ptr->total_cpu_util[*it] = util_core;
@@ -515,14 +562,18 @@ void simple_loop(tasklist_t &tasklist,
                             task.llc_occup, task.lmem_bw, task.tmem_bw,
                             task.rmem_bw, task.diskUtils, task.network_bwtx,
                             task.network_bwrx, task.ovs_bwtx, task.ovs_bwrx,
-                            current_time)[0];
+                            task.lat_p95, task.lat_p99, task.lat_qps,
+                            task.mem, memory_monitor().get_psi_some(),
+                            memory_monitor().get_psi_full(), current_time)[0];
                     else if (perf.get_perf_type() == "CPU")
                         counters = perf.read_counters(
                             task.pids[num_cpu], *it, task.llc_occup,
                             task.lmem_bw, task.tmem_bw, task.rmem_bw,
                             task.diskUtils, task.network_bwtx,
                             task.network_bwrx, task.ovs_bwtx, task.ovs_bwrx,
-                            current_time)[0];
+                            task.lat_p95, task.lat_p99, task.lat_qps,
+                            task.mem, memory_monitor().get_psi_some(),
+                            memory_monitor().get_psi_full(), current_time)[0];
                     task.stats[num_cpu].accum(counters, (double)time_int_us /
                                                             1000 / 1000);
                 } else {
@@ -633,10 +684,15 @@ void simple_loop(tasklist_t &tasklist,
             if (task_ptr->get_status() == Task::Status::exited) {
                 LOGINF("Task {} has status EXITED"_format(task_ptr->name));
 
-                // Deal with apps that finish or reach the limit
+                // Deal with apps that finish or reach the limit, keeping the
+                // CLOS given by the allocator if any
+                const auto &clos_alloc = catpol->get_clos_alloc();
+                uint32_t clos = task_ptr->initial_clos;
+                if (clos_alloc && clos_alloc->has_task(task_ptr->id))
+                    clos = clos_alloc->get_clos(task_ptr->id);
                 task_ptr->task_restart_or_set_done(
-                    catpol->get_cat(), perf,
-                    events); // Status can change from (exited | limit_reached) -> done
+                    catpol->get_cat(), perf, events,
+                    clos); // Status can change from (exited | limit_reached) -> done
                 /*for (const auto &task_ptr_aux : runlist) {
                                 if (task_ptr->id != task_ptr_aux->id) {
                                                 LOGINF("Pause task {}:{}"_format(task_ptr_aux->id, task_ptr_aux->name));
@@ -670,11 +726,27 @@ void simple_loop(tasklist_t &tasklist,
                       runlist.end());
         assert(!runlist.empty());
 
+        // Follow the last CAT and MBA changes until they settle
+        if (catpol->get_actuators() && catpol->get_actuators()->get_settle())
+            catpol->get_actuators()->get_settle()->update(interval_ti, runlist);
+
+        // Classify the VMs with the stats of this interval
+        if (catpol->get_classifier())
+            catpol->get_classifier()->update(interval, interval_ti, runlist);
+
+        // Refresh the miss-rate curves before the policy uses them
+        if (catpol->get_mrc())
+            catpol->get_mrc()->update(interval, runlist);
+
         // Adjust CAT according to the selected policy
         //LOGINF("Applying CAT Policy in interval {} with interval_time {}"_format(interval, (double)(adj_delay_us) / 1000000));
         catpol->apply(interval, (double)time_int_us / 1000 / 1000, interval_ti,
                       runlist);
 
+        // Write what the policy submitted to the actuator layer
+        if (catpol->get_actuators())
+            catpol->get_actuators()->commit(runlist);
+
         //auto end_int = std::chrono::system_clock::now();
         //LOGINF("---> Interval {} duration - {} us"_format(interval,chr::duration_cast<chr::microseconds>(end_int - start_int).count()));
     }
@@ -737,13 +809,24 @@ void adjust_time(const time_point_t &start_int, const time_point_t &start_glob,
 }
 
 // Leave the machine in a consistent state
-void clean(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf)
+void clean(tasklist_t &tasklist, CAT_ptr_t cat,
+           std::shared_ptr<PowerCtl> power, Perf &perf)
 {
     LOGINF("Resetting CAT and performance counters...");
     cat->reset();
     cat->fini();
     perf.clean();
 
+    LOGINF("Restoring power limits and frequencies...");
+    if (power)
+        power->restore();
+
+    LOGINF("Removing CPU quotas...");
+    cpu_quota().restore(tasklist);
+
+    LOGINF("Restoring the memory of the VMs...");
+    memory_monitor().restore(tasklist);
+
     // Try to drop privileges before killing anything
     LOGINF("Dropping privileges...");
     drop_privileges();
@@ -769,7 +852,8 @@ void clean(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf)
     herod_the_great();
 }
 
-void clean_and_die(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf,
+void clean_and_die(tasklist_t &tasklist, CAT_ptr_t cat,
+                   std::shared_ptr<PowerCtl> power, Perf &perf,
                    bool monitor_only)
 {
     LOGERR("--- PANIC, TRYING TO CLEAN ---");
@@ -788,6 +872,17 @@ void clean_and_die(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf,
         LOGERR("Could not clean the performance counters: " << e.what());
     }
 
+    if (power)
+        power->restore();
+
+    try {
+        cpu_quota().restore(tasklist);
+    } catch (const std::exception &e) {
+        LOGERR("Could not remove the CPU quotas: " << e.what());
+    }
+
+    memory_monitor().restore(tasklist);
+
     // If the task is client-server, try to shutdown the client VM
     if (!monitor_only) {
         for (const auto &task_ptr : tasklist) {
@@ -1063,13 +1158,41 @@ int main(int argc, char *argv[])
     // Set Perf type
     perf.set_perf_type(options.perf);
 
+    // Network limits are set through the local OVSDB server
+    ovsdb_set_path(options.ovsdb);
+
+    // CPU quotas of the applications are set through cgroups under this one
+    cpu_quota().set_root(options.cgroup);
+
+    // The guests update their memory stats once per interval
+    memory_monitor().set_period(std::ceil(options.ti));
+
     // Set CPU affinity for not interfering with the executed workloads
     set_cpu_affinity(options.cpu_affinity);
 
     try {
         // Initial CAT configuration. It may be modified by the CAT policy.
         cat = cat_setup(coslist);
+        cat->set_monitor_grouping(options.rmid);
         catpol->set_cat(cat);
+        if (catpol->get_mrc())
+            catpol->get_mrc()->set_cat(cat, options.perf == "PID");
+        if (catpol->get_actuators())
+            catpol->get_actuators()->set_cat(cat);
+        if (catpol->get_classifier())
+            catpol->get_classifier()->set_cat(cat);
+        if (catpol->get_actuators() && catpol->get_actuators()->get_settle()) {
+            const cat::policy::Base *pol = catpol.get();
+            catpol->get_actuators()->get_settle()->set_clos_of(
+                [pol](const Task &task) { return pol->task_clos(task); });
+            catpol->get_actuators()->get_settle()->set_cat(cat);
+        }
+        catpol->set_clos_alloc(std::make_shared<ClosAllocator>(
+            cat, options.perf == "PID", cat::max_num_ways, 1, 500,
+            catpol->get_mrc() ? 1 : 0));
+        catpol->set_power(std::make_shared<PowerCtl>());
+        if (options.latency_port)
+            slo_monitor().listen(options.latency_addr, options.latency_port);
     } catch (const std::exception &e) {
         const auto st = boost::get_error_info<traced>(e);
         if (st)
@@ -1094,7 +1217,7 @@ int main(int argc, char *argv[])
             }
 
             // Map task to initial CLOS if specified
-            if (task_ptr->initial_clos) {
+            if (task_ptr->initial_clos && !task_ptr->req_ways) {
                 for (uint32_t i = 0; i < task_ptr->cpus.size(); i++) {
 					if (options.perf == "PID") {
 						cat->add_task(task_ptr->initial_clos, task_ptr->pids[i]);
@@ -1109,11 +1232,35 @@ int main(int argc, char *argv[])
             }
         }
 
+        // Tasks that request an allocation are mapped by the CLOS allocator
+        auto requests = std::map<uint32_t, ClosRequest>();
+        for (const auto &task_ptr : tasklist) {
+            if (!task_ptr->req_ways)
+                continue;
+            if (task_ptr->initial_clos)
+                LOGWAR("Task {} requests an allocation, initial_clos {} "
+                       "ignored"_format(task_ptr->name,
+                                        task_ptr->initial_clos));
+            requests[task_ptr->id] = {task_ptr->req_ways, task_ptr->req_mbps};
+        }
+        if (!requests.empty()) {
+            if (!coslist.empty())
+                LOGWAR("The CLOS allocator may reconfigure the CLOS defined "
+                       "in the config file");
+            catpol->get_clos_alloc()->apply(tasklist, requests);
+        }
+
+        // CPU bandwidth requested, the policies can change it later
+        for (const auto &task_ptr : tasklist)
+            if (task_ptr->req_cpu_quota > 0)
+                cpu_quota().set_quota(*task_ptr, task_ptr->req_cpu_quota);
+
         LOGINF("***** TASKS READY TO START *****");
         for (const auto &task_ptr : tasklist) {
             std::shared_ptr<VMTask> vm_ptr =
                 std::dynamic_pointer_cast<VMTask>(task_ptr);
 
+            std::vector<pid_t> group_pids;
             int num_cpu = 0;
             for (auto it = task_ptr->cpus.begin(); it != task_ptr->cpus.end();
                  ++it, ++num_cpu) {
@@ -1131,11 +1278,27 @@ int main(int argc, char *argv[])
                     } else if (options.perf == "PID") {
                         perf.setup_events(task_ptr->pids[num_cpu],
                                           options.event);
-                        cat->monitor_setup_pid(task_ptr->pids[num_cpu]);
+                        if (options.rmid == "pid")
+                            cat->monitor_setup_pid(task_ptr->pids[num_cpu]);
+                        else
+                            group_pids.push_back(task_ptr->pids[num_cpu]);
                     }
                 }
             }
 
+            // One RMID for the whole task or for all the tasks of its CLOS,
+            // the one given by the allocator if it requested an allocation
+            if (!group_pids.empty()) {
+                const auto &clos_alloc = catpol->get_clos_alloc();
+                uint32_t clos = task_ptr->initial_clos;
+                if (clos_alloc && clos_alloc->has_task(task_ptr->id))
+                    clos = clos_alloc->get_clos(task_ptr->id);
+                if (options.rmid == "task")
+                    cat->monitor_setup_pids(group_pids);
+                else if (options.rmid == "clos")
+                    cat->monitor_setup_clos(clos, group_pids);
+            }
+
             if (std::dynamic_pointer_cast<VMTask>(task_ptr) != nullptr) {
                 // Set disk I/O limits
                 vm_ptr->diskUtils.apply_disk_util_limits(vm_ptr->dom);
@@ -1167,7 +1330,8 @@ int main(int argc, char *argv[])
                         options.ti * 1000 * 1000, options.mi, *int_out,
                         *ucompl_out, *total_out, *times_out, monitor_only);
         else
-            clean_and_die(tasklist, catpol->get_cat(), perf, monitor_only);
+            clean_and_die(tasklist, catpol->get_cat(), catpol->get_power(),
+                          perf, monitor_only);
         // Leaving consistent state after throwing signal
         //int val = setjmp (return_to_top_level);
         //LOGWAR("val = {}"_format(val));
@@ -1175,9 +1339,13 @@ int main(int argc, char *argv[])
         //	clean_and_die(tasklist, catpol->get_cat(), perf);
 
         LOGINF("^^^^^ LOOP FINISHED ^^^^^^");
+        if (catpol->get_actuators())
+            catpol->get_actuators()->print_stats();
+        if (catpol->get_actuators() && catpol->get_actuators()->get_settle())
+            catpol->get_actuators()->get_settle()->print_stats();
 
         // Kill tasks, reset CAT, performance monitors, etc...
-        clean(tasklist, catpol->get_cat(), perf);
+        clean(tasklist, catpol->get_cat(), catpol->get_power(), perf);
 
         // If no --fin-output argument, then the final stats are buffered in a stringstream and then outputted to stdout.
         // If we don't do this and the normal output also goes to stdout, they would mix.
@@ -1196,6 +1364,7 @@ int main(int argc, char *argv[])
             LOGERR(e.what() << std::endl << *st);
         else
             LOGERR(e.what());
-        clean_and_die(tasklist, catpol->get_cat(), perf, monitor_only);
+        clean_and_die(tasklist, catpol->get_cat(), catpol->get_power(), perf,
+                      monitor_only);
     }
 }
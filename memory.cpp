@@ -0,0 +1,252 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "memory.hpp"
+#include "throw-with-trace.hpp"
+#include "vm-task.hpp"
+
+using fmt::literals::operator""_format;
+
+bool psi_read(const std::string &path, Psi &psi)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    // Lines "some|full avg10=0.00 avg60=0.00 avg300=0.00 total=0"
+    bool found = false;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        std::string kind, field;
+        ss >> kind;
+        if (kind != "some" && kind != "full")
+            continue;
+        while (ss >> field) {
+            size_t eq = field.find('=');
+            if (eq == std::string::npos)
+                continue;
+            std::string key = field.substr(0, eq);
+            std::string value = field.substr(eq + 1);
+            if (key == "avg10")
+                (kind == "some" ? psi.some_avg10 : psi.full_avg10) =
+                    std::stod(value);
+            else if (key == "total")
+                (kind == "some" ? psi.some_total : psi.full_total) =
+                    std::stoull(value);
+        }
+        found = true;
+    }
+    return found;
+}
+
+// MemAvailable in /proc/meminfo, in MB
+static double host_mem_available()
+{
+    std::ifstream in("/proc/meminfo");
+    std::string key;
+    uint64_t kb;
+    std::string unit;
+    while (in >> key >> kb) {
+        std::getline(in, unit);
+        if (key == "MemAvailable:")
+            return kb / 1024.0;
+    }
+    return 0;
+}
+
+void MemoryMonitor::set_period(int _period)
+{
+    period = std::max(_period, 1);
+}
+
+// Size of the VM when first seen, and stats period of its guest, which only
+// updates the stats if it has one
+void MemoryMonitor::init_vm(VMTask &vm)
+{
+    if (initial.count(vm.id))
+        return;
+
+    virDomainInfo info;
+    if (virDomainGetInfo(vm.dom, &info) < 0)
+        throw_with_trace(std::runtime_error(
+            "ERROR! Unable to get domain info of VM {}."_format(
+                vm.domain_name)));
+    initial[vm.id] = info.memory;
+    vm.mem.max = info.maxMem / 1024.0;
+    vm.mem.actual = info.memory / 1024.0;
+    if (virDomainSetMemoryStatsPeriod(vm.dom, period,
+                                      VIR_DOMAIN_AFFECT_LIVE) < 0)
+        LOGWAR("MEM: could not set the stats period of VM {}, the guest "
+               "stats may not be updated"_format(vm.name));
+}
+
+void MemoryMonitor::poll_vm(VMTask &vm, double interval_time)
+{
+    init_vm(vm);
+
+    virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
+    int n = virDomainMemoryStats(vm.dom, stats, VIR_DOMAIN_MEMORY_STAT_NR, 0);
+    if (n < 0) {
+        if (no_stats.insert(vm.id).second)
+            LOGWAR("MEM: no memory stats for VM {}"_format(vm.name));
+        return;
+    }
+
+    raw_t raw;
+    for (int i = 0; i < n; i++) {
+        double value = stats[i].val;
+        switch (stats[i].tag) {
+        case VIR_DOMAIN_MEMORY_STAT_SWAP_IN:
+            raw.swap_in = value;
+            break;
+        case VIR_DOMAIN_MEMORY_STAT_SWAP_OUT:
+            raw.swap_out = value;
+            break;
+        case VIR_DOMAIN_MEMORY_STAT_MAJOR_FAULT:
+            raw.major_faults = value;
+            break;
+        case VIR_DOMAIN_MEMORY_STAT_MINOR_FAULT:
+            raw.minor_faults = value;
+            break;
+        case VIR_DOMAIN_MEMORY_STAT_UNUSED:
+            vm.mem.unused = value / 1024;
+            break;
+        case VIR_DOMAIN_MEMORY_STAT_AVAILABLE:
+            vm.mem.available = value / 1024;
+            break;
+        case VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON:
+            vm.mem.actual = value / 1024;
+            break;
+        case VIR_DOMAIN_MEMORY_STAT_RSS:
+            vm.mem.rss = value / 1024;
+            break;
+        case VIR_DOMAIN_MEMORY_STAT_USABLE:
+            vm.mem.usable = value / 1024;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // The counters restart with the guest
+    auto it = last.find(vm.id);
+    if (it != last.end() && interval_time > 0) {
+        const raw_t &prev = it->second;
+        auto rate = [interval_time](double curr, double prev_value) {
+            return std::max(curr - prev_value, 0.0) / interval_time;
+        };
+        vm.mem.swap_in = rate(raw.swap_in, prev.swap_in) / 1024;
+        vm.mem.swap_out = rate(raw.swap_out, prev.swap_out) / 1024;
+        vm.mem.major_faults = rate(raw.major_faults, prev.major_faults);
+        vm.mem.minor_faults = rate(raw.minor_faults, prev.minor_faults);
+    }
+    last[vm.id] = raw;
+
+    LOGDEB("MEM: VM {} balloon {:.0f}/{:.0f} MB, usable {:.0f} MB, RSS "
+           "{:.0f} MB, swap in {:.2f} MBps, {:.0f} major faults/s"_format(
+               vm.name, vm.mem.actual, vm.mem.max, vm.mem.usable, vm.mem.rss,
+               vm.mem.swap_in, vm.mem.major_faults));
+}
+
+void MemoryMonitor::poll(double interval_time,
+                         const std::vector<std::shared_ptr<Task>> &tasklist)
+{
+    Psi psi;
+    if (psi_read("/proc/pressure/memory", psi)) {
+        if (psi_valid && interval_time > 0) {
+            double us = interval_time * 1000000 / 100;
+            psi_some = std::min(
+                (psi.some_total - host_psi.some_total) / us, 100.0);
+            psi_full = std::min(
+                (psi.full_total - host_psi.full_total) / us, 100.0);
+        }
+        host_psi = psi;
+        psi_valid = true;
+    } else if (!psi_missing) {
+        psi_missing = true;
+        LOGWAR("MEM: no memory pressure information (PSI) in the host");
+    }
+    host_available = host_mem_available();
+
+    for (const auto &task_ptr : tasklist) {
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        if (!vm || !vm->dom)
+            continue;
+        try {
+            poll_vm(*vm, interval_time);
+        } catch (const std::exception &e) {
+            LOGWAR("MEM: {}"_format(e.what()));
+        }
+    }
+}
+
+void MemoryMonitor::set_balloon(VMTask &vm, uint64_t mb)
+{
+    init_vm(vm);
+    uint64_t kb = mb * 1024;
+    if (vm.mem.max > 0)
+        kb = std::min<uint64_t>(kb, vm.mem.max * 1024);
+
+    vm.task_set_memory(kb);
+    resized.insert(vm.id);
+    vm.mem.actual = kb / 1024.0;
+    LOGDEB("MEM: VM {} balloon set to {} MB"_format(vm.name, kb / 1024));
+}
+
+void MemoryMonitor::restore(const std::vector<std::shared_ptr<Task>> &tasklist)
+{
+    for (const auto &task_ptr : tasklist) {
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        if (!vm || !resized.count(vm->id))
+            continue;
+        try {
+            vm->task_set_memory(initial.at(vm->id));
+        } catch (const std::exception &e) {
+            LOGERR("MEM: could not restore the balloon of VM {}: {}"_format(
+                vm->name, e.what()));
+        }
+    }
+    resized.clear();
+}
+
+double MemoryMonitor::get_psi_some() const
+{
+    return psi_some;
+}
+
+double MemoryMonitor::get_psi_full() const
+{
+    return psi_full;
+}
+
+double MemoryMonitor::get_host_available() const
+{
+    return host_available;
+}
+
+MemoryMonitor &memory_monitor()
+{
+    static MemoryMonitor monitor;
+    return monitor;
+}
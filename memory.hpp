@@ -0,0 +1,109 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Included by the perf counters, so the tasks are only declared here
+class Task;
+class VMTask;
+
+// Memory of a VM in the last interval, from the balloon driver of the guest
+// and the QEMU process. Sizes in MB, swapping in MBps and page faults per
+// second.
+struct VmMemory {
+    double max = 0;       // Most the balloon can grow to
+    double actual = 0;    // Current balloon size
+    double rss = 0;       // Resident in the host
+    double available = 0; // Seen by the guest
+    double usable = 0;    // Can be used without swapping
+    double unused = 0;
+    double swap_in = 0;
+    double swap_out = 0;
+    double major_faults = 0;
+    double minor_faults = 0;
+};
+
+// Pressure Stall Information of a resource: % of the time some or all the
+// tasks were stalled in the last 10 s, and cumulative stall times in us
+struct Psi {
+    double some_avg10 = 0;
+    double full_avg10 = 0;
+    uint64_t some_total = 0;
+    uint64_t full_total = 0;
+};
+
+// Reads a PSI file (e.g. /proc/pressure/memory), false if it cannot be read
+bool psi_read(const std::string &path, Psi &psi);
+
+// Collects the memory stats of the VMs every interval through libvirt,
+// together with the memory pressure of the host (PSI) and its available
+// memory, and resizes the balloons of the VMs. The balloons resized are
+// returned to their size at the first poll by restore().
+class MemoryMonitor
+{
+    // Cumulative counters of the guest at the last poll
+    struct raw_t {
+        double swap_in = 0;  // KB
+        double swap_out = 0; // KB
+        double major_faults = 0;
+        double minor_faults = 0;
+    };
+
+    int period = 1; // Seconds between the stats updates of the guests
+    std::map<uint32_t, raw_t> last;       // VM -> counters
+    std::map<uint32_t, uint64_t> initial; // VM -> balloon size (KB)
+    std::set<uint32_t> resized;           // VMs with the balloon changed
+    std::set<uint32_t> no_stats;          // VMs without stats, warned
+    Psi host_psi;                         // Last read
+    bool psi_valid = false;
+    bool psi_missing = false;
+    double psi_some = 0; // % of the last interval
+    double psi_full = 0;
+    double host_available = 0; // MB
+
+    void init_vm(VMTask &vm);
+    void poll_vm(VMTask &vm, double interval_time);
+
+  public:
+    MemoryMonitor() = default;
+    MemoryMonitor(const MemoryMonitor &) = delete;
+    MemoryMonitor &operator=(const MemoryMonitor &) = delete;
+
+    void set_period(int _period);
+
+    // Every interval, with its length in seconds
+    void poll(double interval_time,
+              const std::vector<std::shared_ptr<Task>> &tasklist);
+    // Balloon size in MB, bounded by the maximum memory of the VM
+    void set_balloon(VMTask &vm, uint64_t mb);
+    void restore(const std::vector<std::shared_ptr<Task>> &tasklist);
+
+    // Memory pressure of the host in the last interval (% of the time)
+    double get_psi_some() const;
+    double get_psi_full() const;
+    // MemAvailable of the host, MB
+    double get_host_available() const;
+};
+
+// Monitor shared by the whole manager
+MemoryMonitor &memory_monitor();
@@ -0,0 +1,281 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <fmt/format.h>
+#include <limits>
+
+#include "log.hpp"
+#include "mrc.hpp"
+#include "policy.hpp"
+#include "throw-with-trace.hpp"
+
+using fmt::literals::operator""_format;
+
+// LLC miss events, in order of preference
+static const std::vector<std::string> miss_events = {
+    "mem_load_retired.l3_miss", "LLC-load-misses", "longest_lat_cache.miss"};
+
+static double mean(const std::deque<std::pair<double, double>> &samples,
+                   bool first)
+{
+    double sum = 0;
+    for (const auto &s : samples)
+        sum += first ? s.first : s.second;
+    return samples.empty() ? 0 : sum / samples.size();
+}
+
+static double ci95(const std::deque<std::pair<double, double>> &samples,
+                   bool first)
+{
+    if (samples.size() < 2)
+        return std::numeric_limits<double>::infinity();
+
+    double m = mean(samples, first);
+    double var = 0;
+    for (const auto &s : samples)
+        var += std::pow((first ? s.first : s.second) - m, 2);
+    var /= samples.size() - 1;
+
+    return 1.96 * std::sqrt(var / samples.size());
+}
+
+uint64_t MrcPoint::count() const
+{
+    return samples.size();
+}
+
+double MrcPoint::mpki() const
+{
+    return mean(samples, true);
+}
+
+double MrcPoint::ipc() const
+{
+    return mean(samples, false);
+}
+
+double MrcPoint::mpki_ci() const
+{
+    return ci95(samples, true);
+}
+
+double MrcPoint::ipc_ci() const
+{
+    return ci95(samples, false);
+}
+
+MrcProfiler::MrcProfiler(uint64_t _every, double _budget,
+                         const std::vector<uint32_t> &_points, size_t _window)
+    : every(_every), budget(_budget), points(_points), window(_window)
+{
+    if (points.empty())
+        throw_with_trace(
+            std::runtime_error("The MRC profiler needs some way counts"));
+
+    // Shrinking the cache takes effect sooner than growing it, so sweep
+    // from more to less ways to spoil fewer samples with the transition
+    std::sort(points.begin(), points.end(), std::greater<uint32_t>());
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+    if (points.back() == 0 || points.front() > cat::max_num_ways)
+        throw_with_trace(std::runtime_error(
+            "The MRC way counts must be in [1, {}]"_format(
+                cat::max_num_ways)));
+}
+
+void MrcProfiler::set_cat(std::shared_ptr<IntelRDT> _cat, bool _by_pid)
+{
+    cat = _cat;
+    by_pid = _by_pid;
+    clos = cat->get_max_closids() - 1;
+    LOGINF("MRC profiler: using CLOS {}, {} way counts, budget {:.2f}%"_format(
+        clos, points.size(), budget * 100));
+}
+
+uint32_t MrcProfiler::get_clos() const
+{
+    return clos;
+}
+
+uint32_t MrcProfiler::current_clos(const Task &task) const
+{
+    return by_pid ? cat->get_clos_of_task(task.pids[0])
+                  : cat->get_clos(task.cpus[0]);
+}
+
+void MrcProfiler::associate(const Task &task, uint32_t clos_id)
+{
+    if (by_pid) {
+        for (uint32_t i = 0; i < task.cpus.size(); i++)
+            if (task.pids[i] > 0)
+                cat->add_task(clos_id, task.pids[i]);
+    } else {
+        for (const auto &cpu : task.cpus)
+            cat->add_cpu(clos_id, cpu);
+    }
+}
+
+void MrcProfiler::add_sample(uint32_t id, uint32_t ways, uint64_t interval,
+                             double mpki, double ipc)
+{
+    auto &point = curves[id][ways];
+    point.samples.emplace_back(mpki, ipc);
+    if (point.samples.size() > window)
+        point.samples.pop_front();
+    point.last = interval;
+}
+
+// Moves the task that has gone the longest without a sweep to the profiling
+// CLOS, if any is due
+void MrcProfiler::start(uint64_t interval, const Task::tasklist_t &tasklist)
+{
+    // Tasks never swept go first
+    const Task *next = nullptr;
+    uint64_t next_last = 0;
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        if (!base_ipc.count(task.id))
+            continue;
+        uint64_t last = 0;
+        if (last_sweep.count(task.id)) {
+            if (interval - last_sweep[task.id] < every)
+                continue;
+            last = last_sweep[task.id] + 1;
+        }
+        if (!next || last < next_last) {
+            next = &task;
+            next_last = last;
+        }
+    }
+    if (!next)
+        return;
+
+    sweeping = true;
+    sweep_task = next->id;
+    sweep_home = current_clos(*next);
+    sweep_step = 0;
+    num_sweeps++;
+
+    cat->set_cbm(clos, 0, ~(-1ULL << points[0]), 0);
+    associate(*next, clos);
+    LOGINF("MRC: sweeping task {} from CLOS {}"_format(next->name, sweep_home));
+}
+
+void MrcProfiler::stop(const Task &task, bool restore)
+{
+    if (restore)
+        associate(task, sweep_home);
+    sweeping = false;
+    LOGINF("MRC: sweep of task {} {}, cost {:.3f}%"_format(
+        task.name, restore ? "finished" : "aborted", get_cost() * 100));
+}
+
+void MrcProfiler::update(uint64_t interval, const Task::tasklist_t &tasklist)
+{
+    if (!cat)
+        throw_with_trace(
+            std::runtime_error("The MRC profiler needs the IntelRDT object"));
+
+    bool found = false;
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        found |= (sweeping && task.id == sweep_task);
+
+        double inst = cat::policy::task_sum(task, cat::policy::inst_event(task));
+        double cycles =
+            cat::policy::task_sum(task, cat::policy::cycles_event(task));
+        if (inst <= 0 || cycles <= 0)
+            continue;
+        double misses = cat::policy::task_sum(
+            task, cat::policy::task_event(task, miss_events));
+        double mpki = 1000 * misses / inst;
+        double ipc = inst / cycles;
+        total_inst += inst;
+
+        if (!sweeping || task.id != sweep_task) {
+            // Point of the current allocation, also the reference to know
+            // how much throughput a sweep costs
+            uint32_t c = current_clos(task);
+            if (c == clos)
+                continue;
+            add_sample(task.id, __builtin_popcountll(cat->get_cbm(c, 0)),
+                       interval, mpki, ipc);
+            double &b = base_ipc[task.id];
+            b = b > 0 ? 0.8 * b + 0.2 * ipc : ipc;
+            continue;
+        }
+
+        // Someone else (e.g. the CLOS allocator) moved the task
+        if (current_clos(task) != clos) {
+            last_sweep[task.id] = interval;
+            stop(task, false);
+            continue;
+        }
+
+        add_sample(task.id, points[sweep_step], interval, mpki, ipc);
+        lost_inst += std::max(0.0, base_ipc[task.id] * cycles - inst);
+        LOGDEB("MRC: task {} with {} ways: MPKI {:.2f}, IPC {:.3f}"_format(
+            task.name, points[sweep_step], mpki, ipc));
+
+        if (++sweep_step == points.size() || get_cost() > budget) {
+            last_sweep[task.id] = interval;
+            stop(task, true);
+        } else {
+            cat->set_cbm(clos, 0, ~(-1ULL << points[sweep_step]), 0);
+        }
+    }
+
+    // The task finished while being swept
+    if (sweeping && !found)
+        sweeping = false;
+
+    if (!sweeping && get_cost() < budget)
+        start(interval, tasklist);
+}
+
+bool MrcProfiler::is_profiling(uint32_t task_id) const
+{
+    return sweeping && sweep_task == task_id;
+}
+
+bool MrcProfiler::has_curve(uint32_t task_id, size_t min_points) const
+{
+    auto it = curves.find(task_id);
+    if (it == curves.end())
+        return false;
+    return (size_t)std::count_if(
+               it->second.begin(), it->second.end(),
+               [](const auto &p) { return p.second.count() > 0; }) >=
+           min_points;
+}
+
+const mrc_t &MrcProfiler::get_curve(uint32_t task_id) const
+{
+    static const mrc_t empty;
+    auto it = curves.find(task_id);
+    return it == curves.end() ? empty : it->second;
+}
+
+double MrcProfiler::get_cost() const
+{
+    return total_inst > 0 ? lost_inst / total_inst : 0;
+}
+
+uint64_t MrcProfiler::get_num_sweeps() const
+{
+    return num_sweeps;
+}
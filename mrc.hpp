@@ -0,0 +1,93 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "intel-rdt.hpp"
+#include "task.hpp"
+
+// Point of a miss-rate curve, from the last samples taken with a number of
+// LLC ways. Confidence bounds are the 95% interval of the mean.
+struct MrcPoint {
+    std::deque<std::pair<double, double>> samples; // (MPKI, IPC)
+    uint64_t last = 0;                             // Interval of the last one
+
+    uint64_t count() const;
+    double mpki() const;
+    double ipc() const;
+    double mpki_ci() const;
+    double ipc_ci() const;
+};
+typedef std::map<uint32_t, MrcPoint> mrc_t; // Ways -> point
+
+// Builds the miss-rate and IPC curves of the tasks. Besides the point seen at
+// the current allocation every interval, tasks are periodically moved to a
+// profiling CLOS whose mask is swept over several way counts, one interval
+// per way count. Only one task is swept at a time, and no sweep is started
+// while the throughput lost by sweeping exceeds the given budget.
+class MrcProfiler
+{
+    std::shared_ptr<IntelRDT> cat;
+    bool by_pid = true;
+    uint32_t clos = 0; // Profiling CLOS, the highest one
+
+    uint64_t every;   // Min. intervals between sweeps of the same task
+    double budget;    // Max. fraction of the instructions lost by sweeping
+    std::vector<uint32_t> points; // Way counts swept, from more to less ways
+    size_t window;    // Samples kept per point
+
+    // Sweep in progress
+    bool sweeping = false;
+    uint32_t sweep_task = 0;
+    uint32_t sweep_home = 0; // CLOS the task is returned to
+    size_t sweep_step = 0;
+
+    std::map<uint32_t, mrc_t> curves;
+    std::map<uint32_t, uint64_t> last_sweep;
+    std::map<uint32_t, double> base_ipc; // IPC at the normal allocation
+    double lost_inst = 0;
+    double total_inst = 0;
+    uint64_t num_sweeps = 0;
+
+    uint32_t current_clos(const Task &task) const;
+    void associate(const Task &task, uint32_t clos_id);
+    void add_sample(uint32_t id, uint32_t ways, uint64_t interval,
+                    double mpki, double ipc);
+    void start(uint64_t interval, const Task::tasklist_t &tasklist);
+    void stop(const Task &task, bool restore);
+
+  public:
+    MrcProfiler(uint64_t _every, double _budget,
+                const std::vector<uint32_t> &_points, size_t _window = 8);
+
+    void set_cat(std::shared_ptr<IntelRDT> _cat, bool _by_pid);
+    uint32_t get_clos() const;
+
+    // To be called once per interval, after the counters have been read
+    void update(uint64_t interval, const Task::tasklist_t &tasklist);
+
+    bool is_profiling(uint32_t task_id) const;
+    bool has_curve(uint32_t task_id, size_t min_points = 2) const;
+    const mrc_t &get_curve(uint32_t task_id) const;
+    double get_cost() const;
+    uint64_t get_num_sweeps() const;
+};
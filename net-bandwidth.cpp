@@ -15,6 +15,9 @@
 */
 
 #include "net-bandwidth.hpp"
+#include "ovsdb.hpp"
+
+using fmt::literals::operator""_format;
 
 void net_getBwBytes(const VMTask &task, long long *rx_bytes,
                     long long *tx_bytes)
@@ -74,89 +77,12 @@ void net_getBridgeInterface(VMTask &task)
 }
 
 
-void net_setBwLimit(const VMTask &task, unsigned long long inbound_avg,
-                    unsigned long long inbound_peak,
-                    unsigned long long inbound_burst,
-                    unsigned long long outbound_avg,
-                    unsigned long long outbound_peak,
-                    unsigned long long outbound_burst)
+// OVS port of the VM: vhost-<last two fields of the domain name>
+std::string net_getVhostPort(const std::string &domain)
 {
-    virNetDevBandwidthRate inbound, outbound;
-
-	FILE *fp;
-
-    memset(&inbound, 0, sizeof(inbound));
-    memset(&outbound, 0, sizeof(outbound));
-
-    inbound.average = inbound_avg;
-    inbound.burst = inbound_burst;
-    inbound.peak = inbound_peak;
-
-    outbound.average = outbound_avg;
-    outbound.burst = outbound_burst;
-    outbound.peak = outbound_peak;
-
-	std::string command;
-
-	/* OVS ifaces names */
-	// std::string command = "sudo ovs-vsctl list interface | grep \"name \" | awk '{print $3}'";
-	// In our case, assume they are called dpdk0 and dpdk1
-
-	/* INBOUND: Input bounds are set by limiting the ingress rate and burst in the client interfaces */
-
-    /* Inbound ingress rate in dpdk0 */
-	command = std::string("sudo ovs-vsctl set interface dpdk0 ingress_policing_rate=" + std::to_string(inbound.average));
-    LOGINF(command);
-
-	fp = popen(command.c_str(), "r");
-    if (fp == NULL) {
-        throw_with_trace(std::runtime_error(
-            "***net_getMACInterface function: Failed to run command"));
-    }
-
-    pclose(fp);
-
-    /* Inbound ingress rate in dpdk1 */
-	command = std::string("sudo ovs-vsctl set interface dpdk1 ingress_policing_rate=" + std::to_string(inbound.average));
-	LOGINF(command);
-
-    fp = popen(command.c_str(), "r");
-    if (fp == NULL) {
-        throw_with_trace(std::runtime_error(
-            "***net_getMACInterface function: Failed to run command"));
-    }
-
-    pclose(fp);
-
-    /* Inbound ingress burst in dpdk0 */
- 	command = std::string("sudo ovs-vsctl set interface dpdk0 ingress_policing_burst=" + std::to_string(inbound.burst));
-    LOGINF(command);
-
-	fp = popen(command.c_str(), "r");
-    if (fp == NULL) {
-        throw_with_trace(std::runtime_error(
-            "***net_getMACInterface function: Failed to run command"));
-    }
-
-    pclose(fp);
-
-    /* Inbound ingress burst in dpdk1 */
-	command = std::string("sudo ovs-vsctl set interface dpdk1 ingress_policing_burst=" + std::to_string(inbound.burst));
-	LOGINF(command);
-
-	fp = popen(command.c_str(), "r");
-    if (fp == NULL) {
-        throw_with_trace(std::runtime_error(
-            "***net_getMACInterface function: Failed to run command"));
-    }
-
-    pclose(fp);
-
-	/* OUTBOUND: Output bounds are set by limiting the ingress rate and burst in the server interface */
-	// Get vhost name
 	const char delim = '_';
 	std::vector<std::string> out;
-	std::stringstream ss(task.domain_name);
+	std::stringstream ss(domain);
 	std::string s;
 	while (std::getline(ss,s,delim))
 		out.push_back(s);
@@ -165,47 +91,68 @@ void net_setBwLimit(const VMTask &task, unsigned long long inbound_avg,
 	out.pop_back();
 	domain_2 = out.back() + "-" + domain_2;
 
+	return "vhost-" + domain_2;
+}
 
-	/* Outbound ingress rate in vhost-user1 */
-	command = std::string("sudo ovs-vsctl set interface vhost-" + domain_2 + " ingress_policing_rate=" + std::to_string(outbound.average));
-	LOGINF(command);
-
-    fp = popen(command.c_str(), "r");
-    if (fp == NULL) {
-        throw_with_trace(std::runtime_error(
-            "***net_getMACInterface function: Failed to run command"));
-    }
-
-    pclose(fp);
+void net_setBwLimit(const VMTask &task, unsigned long long inbound_avg,
+                    unsigned long long inbound_peak,
+                    unsigned long long inbound_burst,
+                    unsigned long long outbound_avg,
+                    unsigned long long outbound_peak,
+                    unsigned long long outbound_burst, bool commit)
+{
+    /* Each VM is limited in its own vhost port, the peak is not supported
+     * by the OVS policers */
+    net_setVmLimit(task, inbound_avg, inbound_burst, outbound_avg,
+                   outbound_burst);
+
+    /* All the interfaces are updated in a single OVSDB transaction */
+    if (commit)
+        net_commitLimits();
+}
 
-	/* Outbound ingress burst in vhost-user1 */
-	command = std::string("sudo ovs-vsctl set interface vhost-" + domain_2 +  " ingress_policing_burst=" + std::to_string(outbound.burst));
-	LOGINF(command);
+void net_setVmLimit(const VMTask &task, unsigned long long inbound_rate,
+                    unsigned long long inbound_burst,
+                    unsigned long long outbound_rate,
+                    unsigned long long outbound_burst)
+{
+    std::string port = net_getVhostPort(task.domain_name);
 
-    fp = popen(command.c_str(), "r");
-    if (fp == NULL) {
-        throw_with_trace(std::runtime_error(
-            "***net_getMACInterface function: Failed to run command"));
+    /* INBOUND: traffic to the VM leaves the switch through its vhost port,
+     * limited by an egress policer (in bytes) */
+    if (inbound_rate == 0) {
+        LOGINF("OVSDB: {} egress policer removed"_format(port));
+        ovsdb_client().set_port_qos(port, "", {});
+    } else {
+        LOGINF("OVSDB: {} egress policer cir={} kbps cbs={} kb"_format(
+            port, inbound_rate, inbound_burst));
+        ovsdb_client().set_port_qos(
+            port, "egress-policer",
+            {{"cir", std::to_string(inbound_rate * 1000 / 8)},
+             {"cbs", std::to_string(inbound_burst * 1000 / 8)}});
     }
 
-    pclose(fp);
+    /* OUTBOUND: traffic from the VM enters the switch through its vhost port,
+     * limited by ingress policing */
+    net_setPortPolicing(port, outbound_rate, outbound_burst);
 }
 
-void ovs_ofctl_poll_stats(std::string domain, double *rx_bytes, double *tx_bytes)
+void net_setPortPolicing(const std::string &port, unsigned long long rate,
+                         unsigned long long burst)
 {
-    // Get vhost name
-	const char delim = '_';
-	std::vector<std::string> out;
-	std::stringstream ss(domain);
-	std::string s;
-	while (std::getline(ss,s,delim))
-		out.push_back(s);
+    LOGINF("OVSDB: {} ingress_policing_rate={} "
+           "ingress_policing_burst={}"_format(port, rate, burst));
+    ovsdb_client().set_policing(port, rate, burst);
+}
 
-	std::string domain_2 = out.back();
-	out.pop_back();
-	domain_2 = out.back() + "-" + domain_2;
+size_t net_commitLimits()
+{
+    return ovsdb_client().commit();
+}
 
-	std::string command = "ovs-ofctl dump-ports ovs_br0 vhost-"+ domain_2;
+void ovs_ofctl_poll_stats(std::string domain, double *rx_bytes, double *tx_bytes)
+{
+	std::string command = "ovs-ofctl dump-ports ovs_br0 " + net_getVhostPort(domain);
 
     // run a process and create a streambuf that reads its stdout and stderr
     redi::ipstream proc(command,
@@ -249,3 +196,65 @@ void ovs_ofctl_poll_stats(std::string domain, double *rx_bytes, double *tx_bytes
     }
 }
 
+// Policer drops and conformance (fraction of the packets that pass) of the
+// vhost port of the VM in the last interval. From the point of view of the
+// switch, tx is the traffic to the VM and rx the traffic from it.
+void net_pollQosStats(VMTask &task, double interval)
+{
+    std::string port = net_getVhostPort(task.domain_name);
+    auto rows = std::map<std::string, JsonValue>();
+    try {
+        rows = ovsdb_client().select_interfaces({port}, {"statistics"});
+    } catch (const std::exception &e) {
+        LOGWAR("OVSDB: could not read the statistics of '{}': {}"_format(
+            port, e.what()));
+        return;
+    }
+    if (!rows.count(port)) {
+        LOGWAR("OVSDB: interface '{}' not found"_format(port));
+        return;
+    }
+    const auto &stats = rows[port]["statistics"];
+
+    auto now = std::map<std::string, double>();
+    for (const auto &dir : {"rx", "tx"}) {
+        // Newer DPDK ports count the policer drops on their own
+        std::string qos_drops = "ovs_{}_qos_drops"_format(dir);
+        std::string dropped = "{}_dropped"_format(dir);
+        now["{}_drops"_format(dir)] = ovsdb_map_get(stats, qos_drops) > 0
+                                          ? ovsdb_map_get(stats, qos_drops)
+                                          : ovsdb_map_get(stats, dropped);
+        now["{}_packets"_format(dir)] =
+            ovsdb_map_get(stats, "{}_packets"_format(dir));
+    }
+
+    // A port that was recreated starts counting again, so the interval in
+    // which any counter goes back is skipped
+    auto &prev = task.ovs_qos_counters;
+    bool reset = false;
+    for (const auto &c : now)
+        reset |= prev.count(c.first) && c.second < prev[c.first];
+    if (!prev.empty() && !reset && interval > 0) {
+        double rx_drops = now["rx_drops"] - prev["rx_drops"];
+        double tx_drops = now["tx_drops"] - prev["tx_drops"];
+        double rx_packets = now["rx_packets"] - prev["rx_packets"];
+        double tx_packets = now["tx_packets"] - prev["tx_packets"];
+
+        task.ovs_rx_drops = rx_drops / interval;
+        task.ovs_tx_drops = tx_drops / interval;
+        task.ovs_rx_conformance =
+            rx_packets + rx_drops > 0 ? rx_packets / (rx_packets + rx_drops)
+                                      : 1;
+        task.ovs_tx_conformance =
+            tx_packets + tx_drops > 0 ? tx_packets / (tx_packets + tx_drops)
+                                      : 1;
+
+        if (rx_drops > 0 || tx_drops > 0)
+            LOGINF("OVS_QOS VM {}:\tIn drops:{:.0f}pkt/s ({:.3f} conform)"
+                   "\tOut drops:{:.0f}pkt/s ({:.3f} conform)"_format(
+                       task.domain_name, task.ovs_tx_drops,
+                       task.ovs_tx_conformance, task.ovs_rx_drops,
+                       task.ovs_rx_conformance));
+    }
+    prev = now;
+}
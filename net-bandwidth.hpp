@@ -45,7 +45,21 @@ void net_setBwLimit(const VMTask &task, unsigned long long inbound_avg,
                     unsigned long long inbound_burst,
                     unsigned long long outbound_avg,
                     unsigned long long outbound_peak,
+                    unsigned long long outbound_burst, bool commit = true);
+
+// Per-port policing through OVSDB: rate in kbps, burst in kb (0 disables it).
+// Updates are queued until net_commitLimits sends them in one transaction.
+std::string net_getVhostPort(const std::string &domain);
+// Limits of a single VM on its vhost port, in kbps and kb (0 disables them)
+void net_setVmLimit(const VMTask &task, unsigned long long inbound_rate,
+                    unsigned long long inbound_burst,
+                    unsigned long long outbound_rate,
                     unsigned long long outbound_burst);
+void net_setPortPolicing(const std::string &port, unsigned long long rate,
+                         unsigned long long burst);
+size_t net_commitLimits();
+
+void net_pollQosStats(VMTask &task, double interval);
 
 void ovs_ofctl_poll_stats(std::string domain, double *rx_bytes, double *tx_bytes);
 
@@ -0,0 +1,639 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "ovsdb.hpp"
+#include "throw-with-trace.hpp"
+
+using fmt::literals::operator""_format;
+
+const JsonValue &JsonValue::operator[](const std::string &key) const
+{
+    static const JsonValue null;
+    if (type != type_t::object)
+        return null;
+    auto it = obj.find(key);
+    return it == obj.end() ? null : it->second;
+}
+
+static void json_dump_string(const std::string &s, std::string &out)
+{
+    out += '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            out += "\\u{:04x}"_format(c);
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+static void json_dump(const JsonValue &v, std::string &out)
+{
+    switch (v.type) {
+    case JsonValue::type_t::null:
+        out += "null";
+        break;
+    case JsonValue::type_t::boolean:
+        out += v.b ? "true" : "false";
+        break;
+    case JsonValue::type_t::number:
+        // OVSDB integer columns do not accept decimals
+        if (std::trunc(v.num) == v.num && std::fabs(v.num) < 9e15)
+            out += std::to_string((long long)v.num);
+        else
+            out += "{:.17g}"_format(v.num);
+        break;
+    case JsonValue::type_t::string:
+        json_dump_string(v.str, out);
+        break;
+    case JsonValue::type_t::array:
+        out += '[';
+        for (size_t i = 0; i < v.arr.size(); i++) {
+            if (i)
+                out += ',';
+            json_dump(v.arr[i], out);
+        }
+        out += ']';
+        break;
+    case JsonValue::type_t::object:
+        out += '{';
+        for (auto it = v.obj.begin(); it != v.obj.end(); ++it) {
+            if (it != v.obj.begin())
+                out += ',';
+            json_dump_string(it->first, out);
+            out += ':';
+            json_dump(it->second, out);
+        }
+        out += '}';
+        break;
+    }
+}
+
+std::string JsonValue::dump() const
+{
+    std::string out;
+    json_dump(*this, out);
+    return out;
+}
+
+namespace
+{
+// Recursive descent parser
+class JsonParser
+{
+    const std::string &text;
+    size_t pos = 0;
+
+    [[noreturn]] void fail(const std::string &what) const
+    {
+        throw_with_trace(std::runtime_error(
+            "Invalid JSON at offset {}: {}"_format(pos, what)));
+    }
+
+    void skip_ws()
+    {
+        while (pos < text.size() && isspace((unsigned char)text[pos]))
+            pos++;
+    }
+
+    char peek()
+    {
+        skip_ws();
+        if (pos >= text.size())
+            fail("unexpected end");
+        return text[pos];
+    }
+
+    void expect(char c)
+    {
+        if (peek() != c)
+            fail("expected '{}'"_format(c));
+        pos++;
+    }
+
+    void literal(const char *word)
+    {
+        size_t len = strlen(word);
+        if (text.compare(pos, len, word) != 0)
+            fail("expected '{}'"_format(word));
+        pos += len;
+    }
+
+    static void utf8(uint32_t cp, std::string &out)
+    {
+        if (cp < 0x80) {
+            out += (char)cp;
+        } else if (cp < 0x800) {
+            out += (char)(0xC0 | (cp >> 6));
+            out += (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += (char)(0xE0 | (cp >> 12));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        } else {
+            out += (char)(0xF0 | (cp >> 18));
+            out += (char)(0x80 | ((cp >> 12) & 0x3F));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    uint32_t hex4()
+    {
+        if (pos + 4 > text.size())
+            fail("truncated escape");
+        uint32_t cp = std::stoul(text.substr(pos, 4), nullptr, 16);
+        pos += 4;
+        return cp;
+    }
+
+    std::string string()
+    {
+        expect('"');
+        std::string out;
+        while (true) {
+            if (pos >= text.size())
+                fail("unterminated string");
+            char c = text[pos++];
+            if (c == '"')
+                return out;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text.size())
+                fail("unterminated string");
+            c = text[pos++];
+            switch (c) {
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'u': {
+                uint32_t cp = hex4();
+                // Surrogate pair
+                if (cp >= 0xD800 && cp < 0xDC00 &&
+                    text.compare(pos, 2, "\\u") == 0) {
+                    pos += 2;
+                    uint32_t low = hex4();
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                utf8(cp, out);
+                break;
+            }
+            default:
+                out += c;
+                break;
+            }
+        }
+    }
+
+  public:
+    JsonParser(const std::string &_text) : text(_text)
+    {
+    }
+
+    JsonValue value()
+    {
+        char c = peek();
+        if (c == '{') {
+            pos++;
+            auto obj = std::map<std::string, JsonValue>();
+            if (peek() == '}') {
+                pos++;
+                return JsonValue(obj);
+            }
+            while (true) {
+                std::string key = string();
+                expect(':');
+                obj[key] = value();
+                if (peek() == ',') {
+                    pos++;
+                    continue;
+                }
+                expect('}');
+                return JsonValue(obj);
+            }
+        } else if (c == '[') {
+            pos++;
+            auto arr = std::vector<JsonValue>();
+            if (peek() == ']') {
+                pos++;
+                return JsonValue(arr);
+            }
+            while (true) {
+                arr.push_back(value());
+                if (peek() == ',') {
+                    pos++;
+                    continue;
+                }
+                expect(']');
+                return JsonValue(arr);
+            }
+        } else if (c == '"') {
+            return JsonValue(string());
+        } else if (c == 't') {
+            literal("true");
+            return JsonValue(true);
+        } else if (c == 'f') {
+            literal("false");
+            return JsonValue(false);
+        } else if (c == 'n') {
+            literal("null");
+            return JsonValue();
+        } else {
+            const char *start = text.c_str() + pos;
+            char *end = nullptr;
+            double num = strtod(start, &end);
+            if (end == start)
+                fail("unexpected '{}'"_format(c));
+            pos += end - start;
+            return JsonValue(num);
+        }
+    }
+
+    void finish()
+    {
+        skip_ws();
+        if (pos != text.size())
+            fail("trailing data");
+    }
+};
+} // namespace
+
+JsonValue JsonValue::parse(const std::string &text)
+{
+    JsonParser parser(text);
+    JsonValue v = parser.value();
+    parser.finish();
+    return v;
+}
+
+OvsdbClient::OvsdbClient(const std::string &_path, const std::string &_db)
+    : path(_path), db(_db)
+{
+}
+
+OvsdbClient::~OvsdbClient()
+{
+    disconnect();
+}
+
+const std::string &OvsdbClient::get_path() const
+{
+    return path;
+}
+
+void OvsdbClient::connect()
+{
+    if (fd >= 0)
+        return;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        throw_with_trace(std::runtime_error(
+            "OVSDB socket path '{}' is too long"_format(path)));
+    strcpy(addr.sun_path, path.c_str());
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw_with_trace(std::runtime_error(
+            "Could not create socket: {}"_format(strerror(errno))));
+
+    // The server answers in a few ms, do not hang the manager if it does not
+    struct timeval tv = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int err = errno;
+        disconnect();
+        throw_with_trace(std::runtime_error(
+            "Could not connect to OVSDB at '{}': {}"_format(path,
+                                                           strerror(err))));
+    }
+    buffer.clear();
+    LOGINF("OVSDB: connected to '{}'"_format(path));
+}
+
+void OvsdbClient::disconnect()
+{
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+    buffer.clear();
+}
+
+void OvsdbClient::send(const JsonValue &msg)
+{
+    std::string data = msg.dump();
+    LOGDEB("OVSDB: >> {}"_format(data));
+
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent,
+                           MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            int err = errno;
+            disconnect();
+            throw_with_trace(std::runtime_error(
+                "Could not send to OVSDB: {}"_format(strerror(err))));
+        }
+        sent += n;
+    }
+}
+
+// Messages are JSON objects sent back to back, without any framing
+JsonValue OvsdbClient::receive()
+{
+    while (true) {
+        // Look for the end of the first complete object in the buffer
+        int depth = 0;
+        bool in_string = false, escaped = false;
+        for (size_t i = 0; i < buffer.size(); i++) {
+            char c = buffer[i];
+            if (in_string) {
+                if (escaped)
+                    escaped = false;
+                else if (c == '\\')
+                    escaped = true;
+                else if (c == '"')
+                    in_string = false;
+            } else if (c == '"') {
+                in_string = true;
+            } else if (c == '{' || c == '[') {
+                depth++;
+            } else if ((c == '}' || c == ']') && --depth == 0) {
+                std::string msg = buffer.substr(0, i + 1);
+                buffer.erase(0, i + 1);
+                LOGDEB("OVSDB: << {}"_format(msg));
+                return JsonValue::parse(msg);
+            }
+        }
+
+        char data[4096];
+        ssize_t n = recv(fd, data, sizeof(data), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            int err = n < 0 ? errno : ECONNRESET;
+            disconnect();
+            throw_with_trace(std::runtime_error(
+                "Could not receive from OVSDB: {}"_format(strerror(err))));
+        }
+        buffer.append(data, n);
+    }
+}
+
+JsonValue OvsdbClient::call(const std::string &method,
+                            const std::vector<JsonValue> &params)
+{
+    connect();
+
+    uint64_t id = next_id++;
+    send(std::map<std::string, JsonValue>{
+        {"method", method}, {"params", params}, {"id", id}});
+
+    while (true) {
+        JsonValue msg = receive();
+
+        // The server checks that we are alive with echo requests
+        if (msg["method"].str == "echo") {
+            send(std::map<std::string, JsonValue>{
+                {"result", msg["params"]}, {"error", JsonValue()},
+                {"id", msg["id"]}});
+            continue;
+        }
+        // Notifications of monitors are not used
+        if (msg.has("method") || msg["id"].num != id)
+            continue;
+
+        if (!msg["error"].is_null())
+            throw_with_trace(std::runtime_error(
+                "OVSDB {} failed: {}"_format(method, msg["error"].dump())));
+        return msg["result"];
+    }
+}
+
+std::vector<JsonValue>
+OvsdbClient::transact(const std::vector<JsonValue> &operations)
+{
+    auto params = std::vector<JsonValue>{db};
+    params.insert(params.end(), operations.begin(), operations.end());
+
+    JsonValue result = call("transact", params);
+
+    // A failed operation aborts the whole transaction
+    for (const auto &r : result.arr)
+        if (r.has("error"))
+            throw_with_trace(std::runtime_error(
+                "OVSDB transaction failed: {} ({})"_format(
+                    r["error"].str, r["details"].str)));
+    return result.arr;
+}
+
+void OvsdbClient::queue_update(const std::string &table,
+                               const JsonValue &where,
+                               const std::map<std::string, JsonValue> &columns,
+                               const std::string &row)
+{
+    ops.push_back(std::map<std::string, JsonValue>{
+        {"op", "update"}, {"table", table}, {"where", where}, {"row", columns}});
+    rows.push_back(row);
+}
+
+void OvsdbClient::set_interface(const std::string &name,
+                                const std::map<std::string, JsonValue> &columns)
+{
+    auto where = std::vector<JsonValue>{
+        std::vector<JsonValue>{"name", "==", name}};
+    queue_update("Interface", where, columns, "interface '{}'"_format(name));
+}
+
+void OvsdbClient::set_port_qos(const std::string &port, const std::string &type,
+                               const std::map<std::string, std::string> &config)
+{
+    auto port_where = std::vector<JsonValue>{
+        std::vector<JsonValue>{"name", "==", port}};
+
+    if (type.empty()) {
+        // Unreferenced QoS rows are garbage collected by the server
+        queue_update("Port", port_where,
+                     {{"qos", std::vector<JsonValue>{
+                                  "set", std::vector<JsonValue>()}}},
+                     "port '{}'"_format(port));
+        qos.erase(port);
+        return;
+    }
+
+    auto pairs = std::vector<JsonValue>();
+    for (const auto &kv : config)
+        pairs.push_back(std::vector<JsonValue>{kv.first, kv.second});
+    auto columns = std::map<std::string, JsonValue>{
+        {"type", type},
+        {"other_config", std::vector<JsonValue>{"map", pairs}}};
+
+    auto it = qos.find(port);
+    if (it != qos.end()) {
+        auto where = std::vector<JsonValue>{std::vector<JsonValue>{
+            "_uuid", "==", std::vector<JsonValue>{"uuid", it->second}}};
+        queue_update("QoS", where, columns, "QoS of port '{}'"_format(port));
+        return;
+    }
+
+    // New QoS row referenced by the port in the same transaction
+    std::string name = "qos_{}"_format(next_name++);
+    inserted[ops.size()] = port;
+    ops.push_back(std::map<std::string, JsonValue>{
+        {"op", "insert"}, {"table", "QoS"}, {"row", columns},
+        {"uuid-name", name}});
+    rows.push_back("");
+    queue_update("Port", port_where,
+                 {{"qos", std::vector<JsonValue>{"named-uuid", name}}},
+                 "port '{}'"_format(port));
+}
+
+void OvsdbClient::set_policing(const std::string &name, uint64_t rate,
+                               uint64_t burst)
+{
+    set_interface(name, {{"ingress_policing_rate", rate},
+                         {"ingress_policing_burst", burst}});
+}
+
+size_t OvsdbClient::commit()
+{
+    if (ops.empty())
+        return 0;
+
+    // The queue is emptied even if the transaction fails, so that a bad
+    // update is not retried forever
+    auto operations = std::move(ops);
+    auto names = std::move(rows);
+    auto inserts = std::move(inserted);
+    ops.clear();
+    rows.clear();
+    inserted.clear();
+
+    auto results = transact(operations);
+
+    size_t count = 0;
+    for (size_t i = 0; i < names.size() && i < results.size(); i++) {
+        if (inserts.count(i)) {
+            const auto &uuid = results[i]["uuid"].arr;
+            if (uuid.size() == 2)
+                qos[inserts[i]] = uuid[1].str;
+            count++;
+            continue;
+        }
+        size_t n = results[i]["count"].num;
+        if (n == 0)
+            LOGWAR("OVSDB: {} not found"_format(names[i]));
+        count += n;
+    }
+    LOGDEB("OVSDB: {} updates in one transaction, {} rows changed"_format(
+        operations.size(), count));
+    return count;
+}
+
+size_t OvsdbClient::num_pending() const
+{
+    return ops.size();
+}
+
+std::map<std::string, JsonValue>
+OvsdbClient::select_interfaces(const std::vector<std::string> &names,
+                               const std::vector<std::string> &columns)
+{
+    auto cols = std::vector<JsonValue>(columns.begin(), columns.end());
+    auto operations = std::vector<JsonValue>();
+    for (const auto &name : names) {
+        auto where = std::vector<JsonValue>{
+            std::vector<JsonValue>{"name", "==", name}};
+        operations.push_back(std::map<std::string, JsonValue>{
+            {"op", "select"},
+            {"table", "Interface"},
+            {"where", where},
+            {"columns", cols}});
+    }
+
+    auto results = transact(operations);
+
+    auto rows_by_name = std::map<std::string, JsonValue>();
+    for (size_t i = 0; i < names.size() && i < results.size(); i++) {
+        const auto &found = results[i]["rows"].arr;
+        if (!found.empty())
+            rows_by_name[names[i]] = found[0];
+    }
+    return rows_by_name;
+}
+
+double ovsdb_map_get(const JsonValue &map, const std::string &key)
+{
+    if (map.arr.size() != 2 || map.arr[0].str != "map")
+        return 0;
+    for (const auto &kv : map.arr[1].arr)
+        if (kv.arr.size() == 2 && kv.arr[0].str == key)
+            return kv.arr[1].num;
+    return 0;
+}
+
+static std::string ovsdb_path = "/var/run/openvswitch/db.sock";
+static std::unique_ptr<OvsdbClient> ovsdb;
+
+OvsdbClient &ovsdb_client()
+{
+    if (!ovsdb)
+        ovsdb.reset(new OvsdbClient(ovsdb_path));
+    return *ovsdb;
+}
+
+void ovsdb_set_path(const std::string &path)
+{
+    ovsdb_path = path;
+    ovsdb.reset();
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Minimal JSON value, enough for the OVSDB protocol (RFC 7047)
+struct JsonValue {
+    enum class type_t { null, boolean, number, string, array, object };
+
+    type_t type = type_t::null;
+    bool b = false;
+    double num = 0;
+    std::string str;
+    std::vector<JsonValue> arr;
+    std::map<std::string, JsonValue> obj;
+
+    JsonValue() = default;
+    JsonValue(bool _b) : type(type_t::boolean), b(_b)
+    {
+    }
+    JsonValue(int _num) : type(type_t::number), num(_num)
+    {
+    }
+    JsonValue(uint64_t _num) : type(type_t::number), num(_num)
+    {
+    }
+    JsonValue(double _num) : type(type_t::number), num(_num)
+    {
+    }
+    JsonValue(const char *_str) : type(type_t::string), str(_str)
+    {
+    }
+    JsonValue(const std::string &_str) : type(type_t::string), str(_str)
+    {
+    }
+    JsonValue(const std::vector<JsonValue> &_arr)
+        : type(type_t::array), arr(_arr)
+    {
+    }
+    JsonValue(const std::map<std::string, JsonValue> &_obj)
+        : type(type_t::object), obj(_obj)
+    {
+    }
+
+    bool is_null() const
+    {
+        return type == type_t::null;
+    }
+    bool has(const std::string &key) const
+    {
+        return type == type_t::object && obj.count(key);
+    }
+    const JsonValue &operator[](const std::string &key) const;
+
+    std::string dump() const;
+    // Parses a complete value, throws if the text is not valid JSON
+    static JsonValue parse(const std::string &text);
+};
+
+// Client of the local ovsdb-server, speaking JSON-RPC over its unix socket
+// instead of forking ovs-vsctl for every change. Updates to the Interface,
+// Port and QoS tables are queued and sent together in a single transaction
+// by commit().
+class OvsdbClient
+{
+    std::string path; // Unix socket of the server
+    std::string db;
+    int fd = -1;
+    uint64_t next_id = 0;
+    std::string buffer; // Received data not consumed yet
+
+    std::vector<JsonValue> ops;    // Queued operations
+    std::vector<std::string> rows; // Row each queued op updates, if any
+    std::map<size_t, std::string> inserted; // Queued QoS insert -> port
+    std::map<std::string, std::string> qos; // Port -> uuid of its QoS row
+    uint64_t next_name = 0;
+
+    void queue_update(const std::string &table, const JsonValue &where,
+                      const std::map<std::string, JsonValue> &columns,
+                      const std::string &row);
+
+    void connect();
+    void disconnect();
+    void send(const JsonValue &msg);
+    JsonValue receive();
+    JsonValue call(const std::string &method,
+                   const std::vector<JsonValue> &params);
+
+  public:
+    OvsdbClient(const std::string &_path = "/var/run/openvswitch/db.sock",
+                const std::string &_db = "Open_vSwitch");
+    OvsdbClient(const OvsdbClient &) = delete;
+    OvsdbClient &operator=(const OvsdbClient &) = delete;
+    ~OvsdbClient();
+
+    const std::string &get_path() const;
+
+    // Queues an update of some columns of an interface
+    void set_interface(const std::string &name,
+                       const std::map<std::string, JsonValue> &columns);
+    // Ingress policing of a port: rate in kbps and burst in kb (0 disables it)
+    void set_policing(const std::string &name, uint64_t rate, uint64_t burst);
+    // Egress QoS of a port (traffic to the VM for a vhost port), e.g. an
+    // 'egress-policer' with 'cir' and 'cbs'. The QoS row of the port is
+    // created the first time and updated afterwards; an empty type removes it.
+    void set_port_qos(const std::string &port, const std::string &type,
+                      const std::map<std::string, std::string> &config);
+    // Sends the queued updates as one transaction, returns the rows changed
+    size_t commit();
+    size_t num_pending() const;
+
+    // Runs a transaction with the given operations and returns their results
+    std::vector<JsonValue> transact(const std::vector<JsonValue> &operations);
+    // Columns of the interfaces with the given names, by name
+    std::map<std::string, JsonValue>
+    select_interfaces(const std::vector<std::string> &names,
+                      const std::vector<std::string> &columns);
+};
+
+// Value of an OVSDB map column (["map", [[k, v], ...]]), 0 if missing
+double ovsdb_map_get(const JsonValue &map, const std::string &key);
+
+// Client shared by the whole manager
+OvsdbClient &ovsdb_client();
+void ovsdb_set_path(const std::string &path);
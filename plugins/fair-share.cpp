@@ -0,0 +1,62 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Example policy plugin: splits the LLC ways evenly among the running tasks.
+//
+//   policy:
+//     path: plugins/fair-share.so
+//     every: 10
+
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "policy-plugin.hpp"
+
+using fmt::literals::operator""_format;
+
+class FairShare : public cat::policy::Base
+{
+    uint64_t every = 1;
+    std::map<uint32_t, ClosRequest> current;
+
+  public:
+    FairShare(const YAML::Node &node)
+    {
+        if (node["every"])
+            every = node["every"].as<uint64_t>();
+    }
+
+    virtual void apply(uint64_t current_interval, double, double,
+                       const tasklist_t &tasklist) override
+    {
+        if (current_interval % every != 0 || tasklist.empty() || !clos_alloc)
+            return;
+
+        uint32_t ways = std::max(cat::min_num_ways,
+                                 (uint32_t)(cat::max_num_ways / tasklist.size()));
+        auto requests = std::map<uint32_t, ClosRequest>();
+        for (const auto &task_ptr : tasklist)
+            requests[task_ptr->id] = {ways, task_ptr->req_mbps};
+
+        if (requests == current)
+            return;
+        clos_alloc->apply(tasklist, requests);
+        current = requests;
+        LOGINF("FairShare: {} ways per task"_format(ways));
+    }
+};
+
+POLICY_PLUGIN(FairShare)
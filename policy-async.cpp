@@ -0,0 +1,240 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "policy-async.hpp"
+#include "throw-with-trace.hpp"
+
+namespace cat
+{
+namespace policy
+{
+
+using fmt::literals::operator""_format;
+
+// Copy of a task as it was at the end of an interval. Identity, cpus, pids
+// and stats are kept; the task cannot be managed through it.
+class TaskSnapshot : public Task
+{
+  public:
+    TaskSnapshot(const Task &task) : Task(task)
+    {
+    }
+
+    virtual void reset() override
+    {
+        unsupported();
+    }
+    virtual void task_pause() override
+    {
+        unsupported();
+    }
+    virtual void task_resume() override
+    {
+        unsupported();
+    }
+    virtual void task_kill() override
+    {
+        unsupported();
+    }
+    virtual void task_get_ready_to_execute(bool) override
+    {
+        unsupported();
+    }
+    virtual void task_start_to_execute() override
+    {
+        unsupported();
+    }
+    virtual void task_restart() override
+    {
+        unsupported();
+    }
+    virtual bool task_exited(bool) const override
+    {
+        return false;
+    }
+    virtual int get_cpu_id(pid_t pid) override
+    {
+        for (uint32_t i = 0; i < cpus.size(); i++)
+            if (pids[i] == pid)
+                return cpus[i];
+        return -1;
+    }
+    virtual void task_restart_or_set_done(std::shared_ptr<IntelRDT>, Perf &,
+                                          const std::vector<std::string> &,
+                                          uint32_t) override
+    {
+        unsupported();
+    }
+    virtual void task_stats_print_headers(std::ostream &,
+                                          const std::string & = ",") override
+    {
+    }
+    virtual void
+    task_stats_print_times_headers(std::ostream &,
+                                   const std::string & = ",") override
+    {
+    }
+    virtual void task_stats_print_interval(uint64_t, std::ostream &, bool,
+                                           const std::string & = ",") override
+    {
+    }
+    virtual void task_stats_print_total(uint64_t, std::ostream &,
+                                        const std::string & = ",") override
+    {
+    }
+    virtual void
+    task_stats_print_times_interval(uint64_t, std::ostream &, bool,
+                                    const std::string & = ",") override
+    {
+    }
+
+  private:
+    void unsupported() const
+    {
+        throw_with_trace(std::runtime_error(
+            "Task {} is a snapshot and cannot be managed"_format(name)));
+    }
+};
+
+Async::Async(std::shared_ptr<Base> _policy, double _deadline)
+    : policy(_policy), deadline(_deadline)
+{
+    worker = std::thread(&Async::run, this);
+}
+
+Async::~Async()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    cv.notify_all();
+    worker.join();
+}
+
+void Async::run()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        cv.wait(lock, [this] { return stop || (pending && !ready); });
+        if (stop)
+            return;
+
+        // The shadow and the snapshot are only touched by this thread until
+        // the decision is marked as ready
+        lock.unlock();
+        std::exception_ptr err;
+        try {
+            policy->apply(job_interval, job_ti, job_adj_ti, job_tasks);
+        } catch (...) {
+            err = std::current_exception();
+        }
+        lock.lock();
+
+        job_latency =
+            std::chrono::duration<double>(clock_t::now() - job_start).count();
+        error = err;
+        ready = true;
+        cv.notify_all();
+    }
+}
+
+// Replays the decision on the hardware. Called with the lock held.
+void Async::commit(uint64_t current_interval)
+{
+    pending = false;
+    ready = false;
+    job_tasks.clear();
+
+    if (error) {
+        auto err = error;
+        error = nullptr;
+        std::rethrow_exception(err);
+    }
+
+    size_t writes = shadow->replay(*cat);
+    // The manager looks up the CLOS of the tasks in its own allocator
+    if (clos_alloc && policy->get_clos_alloc())
+        clos_alloc->adopt(*policy->get_clos_alloc());
+    num_decisions++;
+    LOGINF("ASYNC: decision of interval {} applied in interval {}: latency "
+           "{:.3f} ms, {} writes"_format(job_interval, current_interval,
+                                         job_latency * 1000, writes));
+}
+
+void Async::apply(uint64_t current_interval, double interval_time,
+                  double adjust_interval_time, const tasklist_t &tasklist)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+
+    // The policy sees the hardware through a shadow with the same layout
+    if (!shadow) {
+        shadow = std::make_shared<ShadowRDT>(
+            max_num_ways, cat->get_max_closids(), cat->get_l3_way_size());
+        shadow->init();
+        by_pid = clos_alloc ? clos_alloc->is_by_pid() : true;
+        shadow->sync(*cat, tasklist, by_pid, true);
+        policy->set_cat(shadow);
+        if (clos_alloc)
+            policy->set_clos_alloc(std::make_shared<ClosAllocator>(
+                shadow, by_pid, max_num_ways, 1, 500,
+                cat->get_max_closids() - 1 - clos_alloc->get_num_clos()));
+        shadow->set_journaling(true);
+    }
+
+    // A decision that missed its deadline is applied now
+    if (ready)
+        commit(current_interval);
+
+    if (pending) {
+        num_skipped++;
+        LOGINF("ASYNC: interval {}: still deciding on interval {}, keeping "
+               "the allocation ({} skipped)"_format(
+                   current_interval, job_interval, num_skipped));
+        return;
+    }
+
+    // Immutable copy of the tasks for the policy thread
+    shadow->sync(*cat, tasklist, by_pid, false);
+    job_tasks.clear();
+    for (const auto &task_ptr : tasklist)
+        job_tasks.push_back(std::make_shared<TaskSnapshot>(*task_ptr));
+    // Set while the policy thread is idle
+    policy->set_classifier(classifier);
+    job_interval = current_interval;
+    job_ti = interval_time;
+    job_adj_ti = adjust_interval_time;
+    job_start = clock_t::now();
+    pending = true;
+    cv.notify_all();
+
+    bool done = cv.wait_for(lock, std::chrono::duration<double>(deadline),
+                            [this] { return ready; });
+    if (done) {
+        commit(current_interval);
+    } else {
+        num_late++;
+        LOGWAR("ASYNC: interval {}: decision missed the deadline of {:.3f} ms, "
+               "keeping the allocation ({} late)"_format(
+                   current_interval, deadline * 1000, num_late));
+    }
+}
+
+} // namespace policy
+} // namespace cat
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "policy.hpp"
+#include "shadow-rdt.hpp"
+
+namespace cat
+{
+namespace policy
+{
+
+// Runs another policy on a dedicated thread, so that an expensive decision
+// does not delay the next interval. The policy gets a copy of the tasks and
+// their stats, and a ShadowRDT (with its own CLOS allocator) that records
+// what it sets. The manager waits for the decision up to the deadline, and
+// replays it on the hardware when it is ready. A decision that misses the
+// deadline keeps the previous allocation, and is applied at the end of the
+// interval in which it completes; no new evaluation is started meanwhile.
+// The VM classifier is forwarded, but it is updated by the manager thread, so
+// the policy has to take the categories from the copies of the tasks, and its
+// listeners run there. The MRC profiler is not forwarded, as it is updated
+// by the manager thread as well, and neither are the power actuators nor the
+// actuator layer, whose writes are not journaled.
+class Async : public Base
+{
+  protected:
+    typedef std::chrono::steady_clock clock_t;
+
+    std::shared_ptr<Base> policy;
+    double deadline; // Seconds
+
+    std::shared_ptr<ShadowRDT> shadow;
+    bool by_pid = true;
+
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stop = false;
+    bool pending = false; // Evaluation requested and not finished
+    bool ready = false;   // Decision available to be applied
+    std::exception_ptr error;
+
+    // Evaluation in progress
+    uint64_t job_interval = 0;
+    double job_ti = 0, job_adj_ti = 0;
+    tasklist_t job_tasks;
+    clock_t::time_point job_start;
+    double job_latency = 0; // Seconds
+
+    uint64_t num_decisions = 0;
+    uint64_t num_late = 0;
+    uint64_t num_skipped = 0;
+
+    void run();
+    void commit(uint64_t current_interval);
+
+  public:
+    Async(std::shared_ptr<Base> _policy, double _deadline);
+    Async(const Async &) = delete;
+    Async &operator=(const Async &) = delete;
+    virtual ~Async();
+
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+} // namespace policy
+} // namespace cat
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <dlfcn.h>
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "policy-plugin.hpp"
+#include "throw-with-trace.hpp"
+
+namespace cat
+{
+namespace policy
+{
+
+using fmt::literals::operator""_format;
+
+// Looks up a symbol of the plugin, failing if it is not exported
+template <typename T>
+static T plugin_symbol(void *handle, const std::string &path,
+                       const char *name)
+{
+    dlerror();
+    void *sym = dlsym(handle, name);
+    const char *err = dlerror();
+    if (err || !sym)
+        throw_with_trace(std::runtime_error(
+            "Policy plugin '{}' does not export '{}': {}"_format(
+                path, name, err ? err : "null symbol")));
+    return reinterpret_cast<T>(sym);
+}
+
+Plugin::Plugin(const std::string &_path, const YAML::Node &node) : path(_path)
+{
+    handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle)
+        throw_with_trace(std::runtime_error(
+            "Could not load policy plugin '{}': {}"_format(path, dlerror())));
+
+    try {
+        auto abi = plugin_symbol<policy_plugin_abi_t>(handle, path,
+                                                      "policy_plugin_abi");
+        auto base_size = plugin_symbol<policy_plugin_base_size_t>(
+            handle, path, "policy_plugin_base_size");
+        auto create = plugin_symbol<policy_plugin_create_t>(
+            handle, path, "policy_plugin_create");
+        destroy = plugin_symbol<policy_plugin_destroy_t>(
+            handle, path, "policy_plugin_destroy");
+
+        if (abi() != POLICY_PLUGIN_ABI_VERSION ||
+            base_size() != sizeof(Base))
+            throw_with_trace(std::runtime_error(
+                "Policy plugin '{}' was built for ABI {} (Base of {} bytes), "
+                "the manager uses ABI {} ({} bytes)"_format(
+                    path, abi(), base_size(), POLICY_PLUGIN_ABI_VERSION,
+                    sizeof(Base))));
+
+        policy = create(node);
+        if (!policy)
+            throw_with_trace(std::runtime_error(
+                "Policy plugin '{}' did not create a policy"_format(path)));
+    } catch (...) {
+        dlclose(handle);
+        throw;
+    }
+
+    LOGINF("Loaded policy plugin '{}'"_format(path));
+}
+
+Plugin::~Plugin()
+{
+    // The policy code lives in the plugin, so destroy it before unloading
+    if (policy)
+        destroy(policy);
+    if (handle)
+        dlclose(handle);
+}
+
+void Plugin::apply(uint64_t current_interval, double interval_time,
+                   double adjust_interval_time, const tasklist_t &tasklist)
+{
+    policy->set_cat(cat);
+    policy->set_clos_alloc(clos_alloc);
+    policy->set_mrc(mrc);
+    policy->set_power(power);
+    policy->set_classifier(classifier);
+    policy->set_actuators(actuators);
+    policy->apply(current_interval, interval_time, adjust_interval_time,
+                  tasklist);
+}
+
+} // namespace policy
+} // namespace cat
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <yaml-cpp/yaml.h>
+
+#include "policy.hpp"
+
+// Policies can be built as shared objects and loaded at runtime with a
+// 'path' field in the policy section of the config file. A plugin derives
+// from cat::policy::Base, takes the policy node in its constructor and is
+// exported with POLICY_PLUGIN(ClassName). It links against the symbols of the
+// manager (task_sum, IntelRDT, logging...), so it has to be built with the
+// same headers; the ABI version and the size of Base are checked on load.
+#define POLICY_PLUGIN_ABI_VERSION 6
+
+extern "C" {
+typedef unsigned (*policy_plugin_abi_t)();
+typedef size_t (*policy_plugin_base_size_t)();
+typedef cat::policy::Base *(*policy_plugin_create_t)(const YAML::Node &);
+typedef void (*policy_plugin_destroy_t)(cat::policy::Base *);
+}
+
+#define POLICY_PLUGIN(cls)                                                     \
+    extern "C" unsigned policy_plugin_abi()                                    \
+    {                                                                          \
+        return POLICY_PLUGIN_ABI_VERSION;                                      \
+    }                                                                          \
+    extern "C" size_t policy_plugin_base_size()                                \
+    {                                                                          \
+        return sizeof(cat::policy::Base);                                      \
+    }                                                                          \
+    extern "C" cat::policy::Base *policy_plugin_create(const YAML::Node &node) \
+    {                                                                          \
+        return new cls(node);                                                  \
+    }                                                                          \
+    extern "C" void policy_plugin_destroy(cat::policy::Base *policy)           \
+    {                                                                          \
+        delete policy;                                                         \
+    }
+
+namespace cat
+{
+namespace policy
+{
+
+// Policy loaded from a shared object. Forwards the resources of the manager
+// (IntelRDT, CLOS allocator, MRC profiler, power actuators) to it before each
+// call.
+class Plugin : public Base
+{
+  protected:
+    std::string path;
+    void *handle = nullptr;
+    Base *policy = nullptr;
+    policy_plugin_destroy_t destroy = nullptr;
+
+  public:
+    Plugin(const std::string &_path, const YAML::Node &node);
+    Plugin(const Plugin &) = delete;
+    Plugin &operator=(const Plugin &) = delete;
+    virtual ~Plugin();
+
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+} // namespace policy
+} // namespace cat
@@ -15,9 +15,11 @@
 */
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <tuple>
 
@@ -31,7 +33,11 @@
 
 #include "policy.hpp"
 #include "log.hpp"
+#include "memory.hpp"
+#include "net-bandwidth.hpp"
+#include "slo.hpp"
 #include "stats.hpp"
+#include "throw-with-trace.hpp"
 //#include "disk-utils.hpp"
 //#include "intel-cmt-cat/lib/pqos.h"
 
@@ -56,9 +62,147 @@ typedef ACC::accumulator_set<
 using std::string;
 using fmt::literals::operator""_format;
 
-const char *vm_categories_map[] = {"Invalid", "CPU/Mem", "CPU/Mem Low",
-                                   "Disk",    "Disk RD", "Disk WR",
-                                   "Network", "Unknown"};
+// First of the given events that is being monitored for the task
+string task_event(const Task &task,
+                         const std::vector<string> &candidates)
+{
+    for (const auto &name : candidates)
+        if (task.stats[0].has(name))
+            return name;
+    throw_with_trace(std::runtime_error(
+        "Task {} does not monitor any of the events {}"_format(
+            task.name,
+            iterable_to_string(candidates.begin(), candidates.end(),
+                               [](const auto &n) { return n; }, ", "))));
+}
+
+string inst_event(const Task &task)
+{
+    return task_event(task, {"inst_retired.any", "instructions"});
+}
+
+string cycles_event(const Task &task)
+{
+    return task_event(
+        task, {"cycles", "cpu_clk_unhalted.ref_tsc", "ref-cycles"});
+}
+
+void MetricWindow::push(const tasklist_t &tasklist, double time)
+{
+    interval_t interval;
+    interval.time = time;
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        auto &slots = interval.tasks[task.id];
+        slots.resize(task.cpus.size());
+        for (size_t i = 0; i < task.cpus.size(); i++)
+            for (const auto &event : task.stats[i].events)
+                slots[i][event.first] = acc::last(event.second);
+    }
+    intervals.push_back(std::move(interval));
+    if (intervals.size() > capacity)
+        intervals.pop_front();
+}
+
+void MetricWindow::set_span(size_t n)
+{
+    span = std::min(std::max<size_t>(n, 1), capacity);
+}
+
+size_t MetricWindow::size() const
+{
+    return std::min(span, intervals.size());
+}
+
+double MetricWindow::get_time() const
+{
+    double total = 0;
+    for (auto it = intervals.end() - size(); it != intervals.end(); it++)
+        total += it->time;
+    return total;
+}
+
+double MetricWindow::get_last_time() const
+{
+    return intervals.empty() ? 0 : intervals.back().time;
+}
+
+double MetricWindow::value(const Task &task, size_t i,
+                           const string &name) const
+{
+    double total = 0;
+    size_t n = 0;
+    for (auto it = intervals.end() - size(); it != intervals.end(); it++) {
+        auto t = it->tasks.find(task.id);
+        if (t == it->tasks.end() || i >= t->second.size())
+            continue;
+        auto v = t->second[i].find(name);
+        if (v == t->second[i].end())
+            continue;
+        total += v->second;
+        n++;
+    }
+    if (n == 0)
+        return task.stats[i].last(name);
+    return task.stats[i].is_snapshot(name) ? total / n : total;
+}
+
+static const MetricWindow *metric_window = nullptr;
+
+void set_metric_window(const MetricWindow *window)
+{
+    metric_window = window;
+}
+
+// Value of a counter of a cpu of the task in the last interval, or over the
+// metric window if there is one
+static double task_value(const Task &task, size_t i, const string &name)
+{
+    return metric_window ? metric_window->value(task, i, name)
+                         : task.stats[i].last(name);
+}
+
+// Length of the last interval, over which the stats that are not in the
+// metric window (e.g. those of the disks) were read
+static double last_interval_time(double ti)
+{
+    return metric_window ? metric_window->get_last_time() : ti;
+}
+
+double task_sum(const Task &task, const string &name)
+{
+    double total = 0;
+    for (uint32_t i = 0; i < task.cpus.size(); i++)
+        if (task.pids[i] > 0 && task.stats[i].has(name))
+            total += task_value(task, i, name);
+    return total;
+}
+
+double task_rdt(const Task &task, const IntelRDT &cat, const string &name)
+{
+    double total = 0;
+    for (uint32_t i = 0; i < task.cpus.size(); i++) {
+        if (task.pids[i] <= 0 || !task.stats[i].has(name))
+            continue;
+        // Pids of the same group report the values of the whole group
+        unsigned members = cat.monitor_group_size_pid(task.pids[i]);
+        total += task_value(task, i, name) / std::max(members, 1U);
+    }
+    return total;
+}
+
+double task_ipc(const Task &task)
+{
+    double cycles = task_sum(task, cycles_event(task));
+    return cycles > 0 ? task_sum(task, inst_event(task)) / cycles : 0;
+}
+
+double task_mpki_l3(const Task &task)
+{
+    double inst = task_sum(task, inst_event(task));
+    double misses = task_sum(task, "mem_load_retired.l3_miss");
+    return inst > 0 ? 1000 * misses / inst : 0;
+}
 
 // Test partitioning policy
 void Test::apply(uint64_t current_interval, double interval_time,
@@ -140,8 +284,1796 @@ void Test::apply(uint64_t current_interval, double interval_time,
     }
 }
 
+// MPKI expected with w ways. Points not observed yet are extrapolated from
+// the closest one with a power law, and there is no benefit beyond the ways
+// the task is able to fill.
+double Ucp::mpki(uint32_t id, uint32_t w, uint32_t sat_ways) const
+{
+    const auto &curve = curves.at(id);
+    w = std::max(std::min(w, sat_ways), 1U);
+
+    auto it = curve.find(w);
+    if (it != curve.end())
+        return it->second;
+
+    auto nearest = curve.begin();
+    for (auto c = curve.begin(); c != curve.end(); ++c)
+        if (std::abs((int)c->first - (int)w) <
+            std::abs((int)nearest->first - (int)w))
+            nearest = c;
+
+    return nearest->second * std::pow((double)nearest->first / w, alpha);
+}
+
+// UCP lookahead: repeatedly give the block of ways with the highest marginal
+// utility per way to its task, starting from the minimum guaranteed ways
+std::map<uint32_t, uint32_t>
+Ucp::lookahead(const std::map<uint32_t, std::vector<double>> &utility) const
+{
+    auto alloc = std::map<uint32_t, uint32_t>();
+    for (const auto &u : utility)
+        alloc[u.first] = min_ways;
+
+    int balance = (int)max_num_ways - (int)(min_ways * utility.size());
+    while (balance > 0) {
+        double best_mu = 0;
+        uint32_t best_id = 0, best_k = 0;
+
+        for (const auto &u : utility) {
+            const uint32_t cur = alloc[u.first];
+            for (uint32_t k = 1; k <= (uint32_t)balance; k++) {
+                if (cur + k > max_num_ways)
+                    break;
+                double mu = (u.second[cur + k] - u.second[cur]) / k;
+                if (mu > best_mu) {
+                    best_mu = mu;
+                    best_id = u.first;
+                    best_k = k;
+                }
+            }
+        }
+
+        // Nobody benefits from more ways, give the rest to the task that
+        // gets the most utility from the cache
+        if (best_k == 0) {
+            auto top = std::max_element(
+                utility.begin(), utility.end(),
+                [&alloc](const auto &a, const auto &b) {
+                    return a.second[alloc.at(a.first)] <
+                           b.second[alloc.at(b.first)];
+                });
+            best_id = top->first;
+            best_k = std::min((uint32_t)balance,
+                              max_num_ways - alloc[best_id]);
+            if (best_k == 0)
+                break;
+        }
+
+        alloc[best_id] += best_k;
+        balance -= best_k;
+    }
+
+    return alloc;
+}
+
+void Ucp::apply(uint64_t current_interval, double interval_time,
+                double adjust_interval_time, const tasklist_t &tasklist)
+{
+    if (!clos_alloc)
+        throw_with_trace(
+            std::runtime_error("The UCP policy needs the CLOS allocator"));
+
+    if (way_size == 0)
+        way_size = cat->get_l3_way_size();
+
+    // Accumulate the counters of this interval
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        if (!task.stats[0].has("mem_load_retired.l3_miss"))
+            throw_with_trace(std::runtime_error(
+                "The UCP policy needs the mem_load_retired.l3_miss event"));
+
+        auto &s = samples[task.id];
+        s.inst += task_sum(task, inst_event(task));
+        s.cycles += task_sum(task, cycles_event(task));
+        s.misses += task_sum(task, "mem_load_retired.l3_miss");
+        s.occup += task_rdt(task, *cat, "LLC_occup[MB]");
+        s.n++;
+    }
+
+    // Apply only when the amount of intervals specified has passed
+    if (current_interval % every != 0)
+        return;
+
+    LOGINF("Policy name: UCP");
+
+    auto utility = std::map<uint32_t, std::vector<double>>();
+    auto current = std::map<uint32_t, uint32_t>();
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        const auto &s = samples[task.id];
+        if (s.inst <= 0 || s.cycles <= 0)
+            continue;
+
+        uint32_t w = ways.count(task.id)
+                         ? ways[task.id]
+                         : __builtin_popcountll(
+                               cat->get_cbm(task_clos(task), 0));
+        current[task.id] = w;
+
+        // Refresh the point of the curve for the current allocation
+        double m = 1000 * s.misses / s.inst;
+        auto &curve = curves[task.id];
+        curve[w] = curve.count(w) ? (curve[w] + m) / 2 : m;
+
+        // Points measured by the profiler are preferred when they are tight
+        // enough, they come from sweeps and not from extrapolation
+        if (mrc) {
+            for (const auto &p : mrc->get_curve(task.id))
+                if (p.first != w && p.second.count() > 1 &&
+                    p.second.mpki_ci() < 0.2 * p.second.mpki() + 0.1)
+                    curve[p.first] = p.second.mpki();
+        }
+
+        // A task that does not fill its ways will not use more of them
+        double occup_ways = s.occup / s.n * 1024 * 1024 / way_size;
+        uint32_t sat_ways = (occup_ways < 0.9 * w)
+                                ? std::max((uint32_t)std::ceil(occup_ways),
+                                           min_ways)
+                                : max_num_ways;
+
+        double ipc = s.inst / s.cycles;
+        auto &u = utility[task.id];
+        u.assign(max_num_ways + 1, 0);
+        for (uint32_t k = min_ways; k <= max_num_ways; k++)
+            u[k] = (mpki(task.id, min_ways, sat_ways) -
+                    mpki(task.id, k, sat_ways)) *
+                   ipc;
+
+        LOGINF("Task {}: {} ways, MPKI {:.2f}, IPC {:.2f}, LLC {:.2f} "
+               "MB"_format(task.name, w, m, ipc, s.occup / s.n));
+    }
+    samples.clear();
+
+    if (utility.empty())
+        return;
+
+    auto proposal = lookahead(utility);
+
+    // Hysteresis: only repartition if the expected gain is worth it
+    double u_cur = 0, u_new = 0;
+    for (const auto &u : utility) {
+        u_cur += u.second[std::min(std::max(current[u.first], min_ways),
+                                   max_num_ways)];
+        u_new += u.second[proposal[u.first]];
+    }
+    bool changed = false;
+    for (const auto &p : proposal)
+        changed |= (p.second != current[p.first]);
+
+    if (!changed || u_new - u_cur <= hysteresis * std::max(u_cur, 1e-9)) {
+        LOGINF("UCP: keeping allocation (utility {:.4f} -> {:.4f})"_format(
+            u_cur, u_new));
+        return;
+    }
+
+    auto requests = std::map<uint32_t, ClosRequest>();
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        if (proposal.count(task.id))
+            requests[task.id] = {proposal[task.id], task.req_mbps};
+        else if (ways.count(task.id))
+            requests[task.id] = {ways[task.id], task.req_mbps};
+    }
+    clos_alloc->apply(tasklist, requests);
+
+    for (const auto &r : requests) {
+        ways[r.first] = r.second.ways;
+        LOGINF("UCP: task {} -> {} ways"_format(r.first, r.second.ways));
+    }
+    LOGINF("UCP: utility {:.4f} -> {:.4f}"_format(u_cur, u_new));
+}
+
+void MbaFeedback::apply(uint64_t current_interval, double interval_time,
+                        double adjust_interval_time, const tasklist_t &tasklist)
+{
+    // Memory BW of each task and of the whole system
+    double total_mbt = 0;
+    auto mbt = std::map<uint32_t, double>();
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        mbt[task.id] = task_rdt(task, *cat, "MBT[MBps]");
+        total_mbt += mbt[task.id];
+    }
+
+    // Health of the latency-critical tasks
+    bool degraded = false;
+    bool healthy = true;
+    auto lc_clos = std::set<uint32_t>();
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        if (task.batch)
+            continue;
+        lc_clos.insert(task_clos(task));
+
+        double ipc = task_ipc(task);
+        if (ipc <= 0)
+            continue;
+        double &base = baseline[task.id];
+        base = std::max(ipc, base * decay);
+
+        double stalls = 0;
+        for (const auto &name : {"cycle_activity.stalls_l3_miss",
+                                 "cycle_activity.stalls_mem_any"}) {
+            if (task.stats[0].has(name)) {
+                double cycles = task_sum(task, cycles_event(task));
+                stalls = cycles > 0 ? task_sum(task, name) / cycles : 0;
+                break;
+            }
+        }
+
+        degraded |= (ipc < (1 - ipc_drop) * base) || (stalls > max_stalls);
+        healthy &= (ipc >= (1 - ipc_drop / 2) * base) && (stalls <= max_stalls);
+
+        LOGDEB("MBA: LC task {} IPC {:.3f} (baseline {:.3f}), stalls "
+               "{:.3f}"_format(task.name, ipc, base, stalls));
+    }
+
+    // Batch tasks that use a large share of the memory BW
+    auto aggressors = std::set<uint32_t>();
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        if (!task.batch || total_mbt <= 0 ||
+            mbt[task.id] < aggressor_share * total_mbt)
+            continue;
+
+        uint32_t clos = task_clos(task);
+        if (clos == 0 || lc_clos.count(clos)) {
+            LOGWAR("MBA: aggressor {} shares CLOS {} with latency-critical "
+                   "tasks, not throttled"_format(task.name, clos));
+            continue;
+        }
+        aggressors.insert(clos);
+        LOGDEB("MBA: aggressor {} in CLOS {}: MBT {:.0f} MBps, MBL {:.0f} "
+               "MBps"_format(task.name, clos, mbt[task.id],
+                             task_rdt(task, *cat, "MBL[MBps]")));
+    }
+
+    // Tighten the aggressors or loosen the throttled CLOS
+    auto targets = std::map<uint32_t, unsigned>();
+    if (degraded) {
+        for (const auto &clos : aggressors) {
+            double current = limits.count(clos) ? limits[clos] : max_mb;
+            targets[clos] = std::max((double)min_mb, current * (1 - step));
+        }
+    } else if (healthy) {
+        for (const auto &l : limits)
+            targets[l.first] = std::min((double)max_mb,
+                                        l.second * (1 + step / 2));
+    }
+
+    for (const auto &t : targets) {
+        if (limits.count(t.first) && limits[t.first] == t.second)
+            continue;
+
+        if (actuators) {
+            actuators->set_mb(t.first, t.second, ctrl);
+            LOGINF("MBA: CLOS {} {} to {} {}"_format(
+                t.first, degraded ? "throttled" : "released", t.second,
+                ctrl ? "MBps" : "%"));
+        } else {
+            unsigned actual = cat->set_mb(t.first, 0, ctrl, t.second);
+            LOGINF("MBA: CLOS {} {} to {} (actual {}) {}"_format(
+                t.first, degraded ? "throttled" : "released", t.second,
+                actual, ctrl ? "MBps" : "%"));
+        }
+
+        if (t.second >= max_mb)
+            limits.erase(t.first);
+        else
+            limits[t.first] = t.second;
+    }
+}
+
+// Max-min fair share of the capacity, plus an equal part of what is left,
+// with a floor for each VM
+std::map<uint32_t, double>
+DiskIo::share(const std::map<uint32_t, double> &demand, double capacity,
+              double floor) const
+{
+    auto result = std::map<uint32_t, double>();
+    if (demand.empty())
+        return result;
+
+    auto order = std::vector<std::pair<double, uint32_t>>();
+    for (const auto &d : demand)
+        order.push_back({d.second, d.first});
+    std::sort(order.begin(), order.end());
+
+    double left = std::max(capacity, 0.0);
+    size_t pending = order.size();
+    for (const auto &o : order) {
+        double fair = left / pending--;
+        result[o.second] = std::min(o.first, fair);
+        left -= result[o.second];
+    }
+
+    for (auto &r : result)
+        r.second = std::max(r.second + left / result.size(), floor);
+    return result;
+}
+
+bool DiskIo::changed(unsigned long long current,
+                     unsigned long long wanted) const
+{
+    if ((current == 0) != (wanted == 0))
+        return true;
+    return std::fabs((double)wanted - current) > hysteresis * current;
+}
+
+void DiskIo::apply(uint64_t current_interval, double interval_time,
+                   double adjust_interval_time, const tasklist_t &tasklist)
+{
+    // Smoothed demand of each VM, from the disk stats of the last interval
+    double ti = last_interval_time(
+        adjust_interval_time > 0 ? adjust_interval_time : interval_time);
+    auto tasks = std::map<uint32_t, VMTask *>();
+    for (const auto &task_ptr : tasklist) {
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        if (!vm || ti <= 0)
+            continue;
+        tasks[vm->id] = vm;
+
+        DiskUtils &du = vm->diskUtils;
+        double bytes = du.get_read_bytes_sec_q() + du.get_write_bytes_sec_q();
+        double ops = du.get_read_iops_sec_q() + du.get_write_iops_sec_q();
+        double latency = ops > 0 ? du.get_disk_io_time() / ops : 0;
+
+        vm_t &v = vms[vm->id];
+        v.bw = alpha * bytes / ti + (1 - alpha) * v.bw;
+        v.iops = alpha * ops / ti + (1 - alpha) * v.iops;
+        v.latency = alpha * latency + (1 - alpha) * v.latency;
+    }
+
+    if (current_interval % every != 0 || tasks.empty())
+        return;
+
+    auto bw_demand = std::map<uint32_t, double>();
+    auto iops_demand = std::map<uint32_t, double>();
+    double bw_capacity = bytes_sec;
+    double iops_capacity = iops_sec;
+    bool degraded = false, healthy = true;
+
+    for (const auto &t : tasks) {
+        const vm_t &v = vms[t.first];
+        double bw = v.bw * (1 + headroom);
+        double iops = v.iops * (1 + headroom);
+
+        if (priority && !t.second->batch) {
+            // Latency-critical VMs are not limited, but their demand is
+            // reserved
+            bw_capacity -= bw;
+            iops_capacity -= iops;
+            if (max_latency > 0) {
+                degraded |= v.latency > max_latency;
+                healthy &= v.latency <= max_latency / 2;
+            }
+            continue;
+        }
+        bw_demand[t.first] = bw;
+        iops_demand[t.first] = iops;
+    }
+
+    if (priority && max_latency > 0) {
+        if (degraded)
+            batch_scale = std::max(min_share, batch_scale * (1 - step));
+        else if (healthy)
+            batch_scale = std::min(1.0, batch_scale * (1 + step / 2));
+        bw_capacity *= batch_scale;
+        iops_capacity *= batch_scale;
+    }
+
+    // The floor comes from the capacity of the backend, as the one left to
+    // the batch VMs can be none when the LC VMs reserve it all
+    auto bw_limits = share(bw_demand, bw_capacity, min_share * bytes_sec);
+    auto iops_limits =
+        iops_sec > 0
+            ? share(iops_demand, iops_capacity, min_share * iops_sec)
+            : std::map<uint32_t, double>();
+
+    // A limit of 0 is no limit, so the VMs throttled get at least 1
+    auto limit = [](const std::map<uint32_t, double> &limits, uint32_t id) {
+        auto it = limits.find(id);
+        if (it == limits.end())
+            return 0ULL;
+        return std::max<unsigned long long>(it->second, 1);
+    };
+
+    // All the limits are decided before setting any of them
+    auto updates = std::vector<std::tuple<VMTask *, unsigned long long,
+                                          unsigned long long>>();
+    for (const auto &t : tasks) {
+        vm_t &v = vms[t.first];
+        unsigned long long bw = limit(bw_limits, t.first);
+        unsigned long long iops = limit(iops_limits, t.first);
+
+        if (!changed(v.bw_limit, bw) && !changed(v.iops_limit, iops))
+            continue;
+        updates.push_back(std::make_tuple(t.second, bw, iops));
+        v.bw_limit = bw;
+        v.iops_limit = iops;
+    }
+
+    for (const auto &u : updates) {
+        VMTask *vm = std::get<0>(u);
+        const vm_t &v = vms[vm->id];
+        if (actuators)
+            actuators->set_iotune(*vm, std::get<1>(u), std::get<2>(u));
+        else
+            vm->diskUtils.set_iotune(vm->dom, std::get<1>(u), std::get<2>(u));
+        LOGINF("DISK: {} limited to {:.1f} MB/s and {} IOPS (demand {:.1f} "
+               "MB/s, {:.0f} IOPS, {:.0f} us/op)"_format(
+                   vm->name, std::get<1>(u) / 1024.0 / 1024,
+                   std::get<2>(u) ? std::to_string(std::get<2>(u))
+                                  : string("unlimited"),
+                   v.bw / 1024 / 1024, v.iops, v.latency / 1000));
+    }
+    if (!updates.empty())
+        LOGINF("DISK: {} limits updated, batch capacity at {:.0f}%"_format(
+            updates.size(), batch_scale * 100));
+}
+
+void PowerCap::apply(uint64_t current_interval, double interval_time,
+                     double adjust_interval_time, const tasklist_t &tasklist)
+{
+    if (!power)
+        throw_with_trace(std::runtime_error(
+            "The power policy needs the power actuators"));
+
+    // Batch cores, unless they are shared with a latency-critical task
+    auto batch_cpus = std::set<uint32_t>();
+    auto lc_cpus = std::set<uint32_t>();
+    for (const auto &task_ptr : tasklist)
+        for (auto cpu : task_ptr->cpus)
+            (task_ptr->batch ? batch_cpus : lc_cpus).insert(cpu);
+    for (auto cpu : lc_cpus)
+        batch_cpus.erase(cpu);
+
+    if (!initialized) {
+        for (auto pkg : power->get_packages()) {
+            power->get_package_power(pkg);
+            if (rapl > 0)
+                power->set_package_limit(pkg, rapl);
+        }
+        for (auto cpu : lc_cpus) {
+            uint64_t min_khz, max_khz;
+            power->get_freq_range(cpu, min_khz, max_khz);
+            power->set_max_freq(cpu, max_khz);
+        }
+        initialized = true;
+        return;
+    }
+
+    // Tasks that come and go release their caps
+    for (auto it = caps.begin(); it != caps.end();) {
+        if (batch_cpus.count(it->first)) {
+            ++it;
+            continue;
+        }
+        uint64_t min_khz, max_khz;
+        power->get_freq_range(it->first, min_khz, max_khz);
+        power->set_max_freq(it->first, max_khz);
+        it = caps.erase(it);
+    }
+
+    if (current_interval % every != 0)
+        return;
+
+    double watts = 0;
+    for (auto pkg : power->get_packages())
+        watts += power->get_package_power(pkg);
+
+    int direction = 0;
+    if (watts > budget)
+        direction = -1;
+    else if (watts < budget * (1 - margin))
+        direction = 1;
+    if (direction == 0)
+        return;
+
+    size_t changes = 0;
+    for (auto cpu : batch_cpus) {
+        uint64_t min_khz, max_khz;
+        power->get_freq_range(cpu, min_khz, max_khz);
+        min_khz = std::max(min_khz, min_freq);
+        uint64_t current = caps.count(cpu) ? caps[cpu] : max_khz;
+
+        uint64_t wanted = std::min(current + step, max_khz);
+        if (direction < 0)
+            wanted = current > min_khz + step ? current - step : min_khz;
+        if (wanted == current)
+            continue;
+
+        power->set_max_freq(cpu, wanted);
+        changes++;
+        if (wanted == max_khz)
+            caps.erase(cpu);
+        else
+            caps[cpu] = wanted;
+    }
+
+    if (changes)
+        LOGINF("POWER: {:.1f} W with a budget of {:.1f} W, {} batch cores {} "
+               "a step"_format(watts, budget, changes,
+                               direction < 0 ? "lowered" : "raised"));
+}
+
+uint32_t SloFeedback::batch_ways() const
+{
+    uint32_t used = 0;
+    for (const auto &w : ways)
+        used += w.second;
+    return used < max_num_ways ? max_num_ways - used : 0;
+}
+
+// The VMs with an SLO ask for an explicit MBA value, so that they are never
+// merged with the unthrottled batch tasks into the same CLOS
+void SloFeedback::allocate(const tasklist_t &tasklist)
+{
+    auto requests = std::map<uint32_t, ClosRequest>();
+    int mbps = batch_mb < max_mb ? (int)batch_mb : -1;
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        if (ways.count(task.id))
+            requests[task.id] = {ways[task.id], (int)max_mb};
+        else if (task.batch)
+            requests[task.id] = {batch_ways(), mbps};
+    }
+    clos_alloc->apply(tasklist, requests);
+}
+
+// All the VCPUs of a batch VM run on the first n of its cores
+void SloFeedback::set_cores(VMTask &vm, uint32_t n)
+{
+    auto cpus = std::vector<uint32_t>(vm.cpus.begin(), vm.cpus.begin() + n);
+    vm.task_pin_vcpus(cpus);
+    cores[vm.id] = n;
+    LOGINF("SLO: batch VM {} runs on {} cores"_format(vm.name, n));
+}
+
+// One step more for the VM furthest over its SLO, false if there is nothing
+// left to take from the batch tasks
+bool SloFeedback::tighten(VMTask &worst, const tasklist_t &tasklist)
+{
+    if (batch_ways() >= min_ways + step_ways) {
+        ways[worst.id] += step_ways;
+        LOGINF("SLO: VM {} -> {} ways"_format(worst.name, ways[worst.id]));
+        return true;
+    }
+
+    if (batch_mb > min_mb) {
+        batch_mb = std::max((double)min_mb, batch_mb * (1 - step));
+        LOGINF("SLO: batch tasks throttled to {} MBps"_format(batch_mb));
+        return true;
+    }
+
+    bool done = false;
+    for (const auto &task_ptr : tasklist) {
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        if (vm && cores.count(vm->id) && cores[vm->id] > min_cores) {
+            set_cores(*vm, cores[vm->id] - 1);
+            done = true;
+        }
+    }
+    return done;
+}
+
+// Undoes the last kind of step, the ways are returned by the VM furthest
+// under its SLO
+bool SloFeedback::release(VMTask &best, const tasklist_t &tasklist)
+{
+    bool done = false;
+    for (const auto &task_ptr : tasklist) {
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        if (vm && cores.count(vm->id) && cores[vm->id] < vm->cpus.size()) {
+            set_cores(*vm, cores[vm->id] + 1);
+            done = true;
+        }
+    }
+    if (done)
+        return true;
+
+    if (batch_mb < max_mb) {
+        batch_mb = std::min((double)max_mb, batch_mb * (1 + step / 2));
+        LOGINF("SLO: batch tasks released to {} MBps"_format(batch_mb));
+        return true;
+    }
+
+    uint32_t base = best.req_ways ? best.req_ways : lc_ways;
+    if (ways[best.id] >= base + step_ways) {
+        ways[best.id] -= step_ways;
+        LOGINF("SLO: VM {} -> {} ways"_format(best.name, ways[best.id]));
+        return true;
+    }
+    return false;
+}
+
+void SloFeedback::apply(uint64_t current_interval, double interval_time,
+                        double adjust_interval_time,
+                        const tasklist_t &tasklist)
+{
+    if (!clos_alloc)
+        throw_with_trace(
+            std::runtime_error("The SLO policy needs the CLOS allocator"));
+
+    if (!initialized) {
+        for (const auto &task_ptr : tasklist) {
+            auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+            if (vm && vm->slo > 0)
+                ways[vm->id] = vm->req_ways ? vm->req_ways : lc_ways;
+            else if (vm && vm->batch)
+                cores[vm->id] = vm->cpus.size();
+        }
+        if (ways.empty())
+            LOGWAR("SLO: no VM has an 'slo', nothing to do");
+        batch_mb = max_mb;
+        allocate(tasklist);
+        initialized = true;
+    }
+
+    if (current_interval % every != 0)
+        return;
+
+    // Latency over the SLO of the VMs with a recent report. Resources are
+    // only released when all of them are known to have some slack.
+    VMTask *worst = nullptr, *best = nullptr;
+    double max_ratio = 0, min_ratio = 0;
+    bool relaxed = true;
+    for (const auto &task_ptr : tasklist) {
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        if (!vm || !ways.count(vm->id))
+            continue;
+        if (current_interval - vm->lat_interval >= every ||
+            slo_latency(*vm) <= 0) {
+            relaxed = false;
+            continue;
+        }
+
+        double ratio = slo_latency(*vm) / vm->slo;
+        LOGINF("SLO: VM {} p{} {:.0f} us (SLO {:.0f} us), {:.0f} QPS, {} "
+               "ways"_format(vm->name, vm->slo_percentile, slo_latency(*vm),
+                             vm->slo, vm->lat_qps, ways[vm->id]));
+        if (!worst || ratio > max_ratio) {
+            worst = vm;
+            max_ratio = ratio;
+        }
+        if (!best || ratio < min_ratio) {
+            best = vm;
+            min_ratio = ratio;
+        }
+        relaxed &= ratio < 1 - slack;
+    }
+    if (!worst)
+        return;
+
+    bool changed = false;
+    if (max_ratio > 1) {
+        num_violations++;
+        changed = tighten(*worst, tasklist);
+        if (!changed)
+            LOGWAR("SLO: VM {} is over its SLO and there is nothing left to "
+                   "take from the batch tasks"_format(worst->name));
+    } else if (relaxed) {
+        changed = release(*best, tasklist);
+    }
+
+    if (changed)
+        allocate(tasklist);
+}
+
+static const char *joint_resources[] = {"ways", "MBps", "cores", "Kbps",
+                                        "MB/s"};
+
+// Demand, sensitivity and potential IPS of each task, from the stats of the
+// intervals since the previous decision
+std::vector<Joint::task_t> Joint::estimate(const tasklist_t &tasklist)
+{
+    auto result = std::vector<task_t>();
+    double way_mb = cat->get_l3_way_size() / 1024.0 / 1024;
+
+    for (const auto &task_ptr : tasklist) {
+        auto it = samples.find(task_ptr->id);
+        if (it == samples.end() || it->second.time <= 0 ||
+            it->second.inst <= 0)
+            continue;
+        const sample_t &s = it->second;
+
+        task_t t;
+        t.task = task_ptr.get();
+        t.vm = dynamic_cast<VMTask *>(t.task);
+        t.demand.fill(0);
+        t.floor.fill(0);
+        t.max.fill(0);
 
+        // Without stall events, the category of a classified VM tells
+        // whether it is memory bound
+        double mem = 0.5;
+        if (s.stalls >= 0 && s.cycles > 0)
+            mem = std::min(std::max(s.stalls / s.cycles, 0.05), 1.0);
+        else if (t.vm && t.vm->vm_cat == vm_cat_cpu_mem)
+            mem = 1;
+        else if (t.vm && t.vm->vm_cat != vm_cat_invalid &&
+                 t.vm->vm_cat != vm_cat_unknown)
+            mem = 0.05;
+        t.weight = {mem, mem, 1, 1, 1};
 
+        t.demand[ways_r] =
+            std::max(s.occup / s.n / way_mb * (1 + headroom), 1.0);
+        t.floor[ways_r] = std::max(min[ways_r], (double)t.task->req_ways);
+        t.max[ways_r] = max_num_ways;
+
+        if (capacity[mbps_r] > 0) {
+            t.demand[mbps_r] = s.mbt / s.n * (1 + headroom);
+            t.floor[mbps_r] = min[mbps_r];
+            t.max[mbps_r] = capacity[mbps_r];
+        }
+
+        if (t.vm && capacity[cores_r] > 0) {
+            double ncpus = t.task->cpus.size();
+            t.demand[cores_r] = std::max(s.cpus / s.n * (1 + headroom), 1.0);
+            t.floor[cores_r] = std::min(std::max(min[cores_r], 1.0), ncpus);
+            t.max[cores_r] = ncpus;
+        }
+        if (t.vm && capacity[net_r] > 0) {
+            t.demand[net_r] = s.net / s.n * (1 + headroom);
+            // A limit of 0 is no limit, so at least a unit is given
+            t.floor[net_r] = std::max(min[net_r], unit[net_r]);
+            t.max[net_r] = capacity[net_r];
+        }
+        if (t.vm && capacity[disk_r] > 0) {
+            t.demand[disk_r] = s.disk / s.n * (1 + headroom);
+            t.floor[disk_r] = std::max(min[disk_r], unit[disk_r]);
+            t.max[disk_r] = capacity[disk_r];
+        }
+
+        // The observed IPS is limited by the plan in place
+        t.ips = 1;
+        double factor =
+            current.count(t.task->id) ? predict(t, current[t.task->id]) : 1;
+        t.ips = s.inst / s.time / std::max(factor, 0.05);
+
+        result.push_back(t);
+    }
+    return result;
+}
+
+double Joint::predict(const task_t &t, const alloc_t &a) const
+{
+    double ips = t.ips;
+    for (int r = 0; r < num_resources; r++)
+        if (t.demand[r] > 0 && t.weight[r] > 0)
+            ips *= std::pow(std::min(a[r] / t.demand[r], 1.0), t.weight[r]);
+    return ips;
+}
+
+// Greedy search with lookahead from the floors of the tasks. The capacity
+// left when it stops is handed out too, as it costs nothing.
+Joint::plan_t Joint::search(const std::vector<task_t> &tasks)
+{
+    auto plan = plan_t();
+    alloc_t left = capacity;
+    left[ways_r] = max_num_ways;
+    for (const auto &t : tasks) {
+        plan[t.task->id] = t.floor;
+        for (int r = 0; r < num_resources; r++)
+            left[r] -= t.floor[r];
+    }
+    for (int r = 0; r < num_resources; r++) {
+        if (left[r] < 0) {
+            LOGWAR("JOINT: the floors need more {} than available, keeping "
+                   "the allocation"_format(joint_resources[r]));
+            return plan_t();
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t steps = 0;
+    while (true) {
+        double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+        if (elapsed > budget) {
+            LOGINF("JOINT: search budget exhausted after {} steps"_format(
+                steps));
+            break;
+        }
+
+        double best_gain = 0, best_amount = 0;
+        const task_t *best = nullptr;
+        int best_r = 0;
+        for (const auto &t : tasks) {
+            const alloc_t &a = plan[t.task->id];
+            double base = predict(t, a);
+            for (int r = 0; r < num_resources; r++) {
+                if (r != ways_r && capacity[r] <= 0)
+                    continue;
+                double cap = r == ways_r ? max_num_ways : capacity[r];
+                for (uint32_t k = 1; k <= lookahead; k++) {
+                    double amount = k * unit[r];
+                    if (amount > left[r] + 1e-9 ||
+                        a[r] + amount > t.max[r] + 1e-9)
+                        break;
+                    alloc_t b = a;
+                    b[r] += amount;
+                    double gain = (predict(t, b) - base) / (amount / cap);
+                    if (gain > best_gain) {
+                        best_gain = gain;
+                        best = &t;
+                        best_r = r;
+                        best_amount = amount;
+                    }
+                }
+            }
+        }
+        if (!best)
+            break;
+
+        plan[best->task->id][best_r] += best_amount;
+        left[best_r] -= best_amount;
+        steps++;
+    }
+
+    // Units nobody gains from go round robin to the most sensitive tasks
+    for (int r = 0; r < num_resources; r++) {
+        if (r != ways_r && capacity[r] <= 0)
+            continue;
+        auto order = std::vector<const task_t *>();
+        for (const auto &t : tasks)
+            order.push_back(&t);
+        std::sort(order.begin(), order.end(),
+                  [r](const auto &a, const auto &b) {
+                      return a->weight[r] * a->ips > b->weight[r] * b->ips;
+                  });
+
+        bool given = true;
+        while (given && left[r] >= unit[r] - 1e-9) {
+            given = false;
+            for (const auto &t : order) {
+                double &a = plan[t->task->id][r];
+                if (left[r] < unit[r] - 1e-9 || a + unit[r] > t->max[r] + 1e-9)
+                    continue;
+                a += unit[r];
+                left[r] -= unit[r];
+                given = true;
+            }
+        }
+    }
+    return plan;
+}
+
+// Writes what changes from one plan to the other. Network limits are queued
+// and sent in a single OVSDB transaction at the end.
+void Joint::actuate(const plan_t &to, const plan_t &from,
+                    const tasklist_t &tasklist)
+{
+    auto differs = [&from](uint32_t id, const alloc_t &a, int r) {
+        auto it = from.find(id);
+        return it == from.end() ||
+               std::lround(it->second[r]) != std::lround(a[r]);
+    };
+
+    bool clos = false;
+    auto requests = std::map<uint32_t, ClosRequest>();
+    for (const auto &p : to) {
+        clos |= differs(p.first, p.second, ways_r) ||
+                differs(p.first, p.second, mbps_r);
+        requests[p.first] = {
+            (uint32_t)std::lround(p.second[ways_r]),
+            capacity[mbps_r] > 0 ? (int)std::lround(p.second[mbps_r]) : -1};
+    }
+    if (clos)
+        clos_alloc->apply(tasklist, requests);
+
+    bool net = false;
+    for (const auto &task_ptr : tasklist) {
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        auto it = to.find(task_ptr->id);
+        if (!vm || it == to.end())
+            continue;
+        const alloc_t &a = it->second;
+
+        if (capacity[cores_r] > 0 && differs(vm->id, a, cores_r)) {
+            auto n = std::min((size_t)std::lround(a[cores_r]), vm->cpus.size());
+            vm->task_pin_vcpus(std::vector<uint32_t>(vm->cpus.begin(),
+                                                     vm->cpus.begin() + n));
+        }
+        if (capacity[net_r] > 0 && differs(vm->id, a, net_r)) {
+            auto rate = std::max(std::llround(a[net_r]), 1LL);
+            net_setVmLimit(*vm, rate, rate / 10, rate, rate / 10);
+            net = true;
+        }
+        if (capacity[disk_r] > 0 && differs(vm->id, a, disk_r))
+            vm->diskUtils.set_iotune(
+                vm->dom, std::max(std::llround(a[disk_r]), 1LL), 0);
+    }
+    if (net)
+        net_commitLimits();
+}
+
+void Joint::apply(uint64_t current_interval, double interval_time,
+                  double adjust_interval_time, const tasklist_t &tasklist)
+{
+    if (!clos_alloc)
+        throw_with_trace(
+            std::runtime_error("The joint policy needs the CLOS allocator"));
+
+    // Accumulate the stats of this interval
+    double ti = adjust_interval_time > 0 ? adjust_interval_time : interval_time;
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        sample_t &s = samples[task.id];
+        s.inst += task_sum(task, inst_event(task));
+        s.cycles += task_sum(task, cycles_event(task));
+        if (task.stats[0].has("cycle_activity.stalls_mem_any"))
+            s.stalls = std::max(s.stalls, 0.0) +
+                       task_sum(task, "cycle_activity.stalls_mem_any");
+        s.occup += task_rdt(task, *cat, "LLC_occup[MB]");
+        s.mbt += task_rdt(task, *cat, "MBT[MBps]");
+
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        if (vm) {
+            for (const auto &u : vm->vm_cpu_util)
+                s.cpus += u.second / 100;
+            // KB/s to Kbps
+            s.net += std::max(vm->ovs_bwtx, vm->ovs_bwrx) * 1024 * 8 / 1000;
+            // Only read over the last interval, not the metric window
+            double disk_ti = last_interval_time(ti);
+            if (disk_ti > 0)
+                s.disk += (vm->diskUtils.get_read_bytes_sec_q() +
+                           vm->diskUtils.get_write_bytes_sec_q()) /
+                          disk_ti;
+        }
+        s.time += ti;
+        s.n++;
+    }
+
+    if (current_interval % every != 0)
+        return;
+
+    auto tasks = estimate(tasklist);
+    samples.clear();
+    if (tasks.empty())
+        return;
+
+    auto plan = search(tasks);
+    if (plan.empty())
+        return;
+
+    // Expected IPS with the plan in place and with the new one
+    double ips_cur = 0, ips_new = 0;
+    bool known = current.size() == plan.size();
+    for (const auto &t : tasks) {
+        ips_new += predict(t, plan[t.task->id]);
+        if (current.count(t.task->id))
+            ips_cur += predict(t, current[t.task->id]);
+        else
+            known = false;
+    }
+    if (known && ips_new <= (1 + hysteresis) * ips_cur) {
+        LOGINF("JOINT: keeping the plan ({:.3f} -> {:.3f} GIPS)"_format(
+            ips_cur / 1e9, ips_new / 1e9));
+        return;
+    }
+
+    try {
+        actuate(plan, current, tasklist);
+    } catch (const std::exception &e) {
+        num_rollbacks++;
+        LOGERR("JOINT: {}, restoring the previous plan"_format(e.what()));
+        try {
+            actuate(current, plan, tasklist);
+        } catch (const std::exception &e2) {
+            LOGERR("JOINT: could not restore the previous plan: {}"_format(
+                e2.what()));
+        }
+        return;
+    }
+    current = plan;
+    num_plans++;
+
+    for (const auto &t : tasks) {
+        const alloc_t &a = plan[t.task->id];
+        LOGINF("JOINT: task {}: {:.0f} ways, {:.0f} MBps, {:.0f} cores, {:.0f} "
+               "Kbps, {:.1f} MB/s"_format(t.task->name, a[ways_r], a[mbps_r],
+                                          a[cores_r], a[net_r],
+                                          a[disk_r] / 1024 / 1024));
+    }
+    LOGINF("JOINT: plan {} applied ({:.3f} -> {:.3f} GIPS)"_format(
+        num_plans, ips_cur / 1e9, ips_new / 1e9));
+}
+
+void Preempt::preempt(Task &task, double ips)
+{
+    if (throttle) {
+        for (auto cpu : task.cpus) {
+            uint64_t min_khz, max_khz;
+            power->get_freq_range(cpu, min_khz, max_khz);
+            power->set_max_freq(cpu, min_khz);
+        }
+    } else {
+        task.task_pause();
+    }
+
+    preempted_t &p = preempted[task.id];
+    p.ips = ips;
+    p.active = true;
+    p.count++;
+    p.cpus = task.cpus;
+    order.push_back(task.id);
+    LOGINF("PREEMPT: task {} {} ({:.3f} GIPS)"_format(
+        task.name, throttle ? "throttled" : "paused", ips / 1e9));
+}
+
+void Preempt::resume(Task &task)
+{
+    if (throttle) {
+        for (auto cpu : task.cpus) {
+            uint64_t min_khz, max_khz;
+            power->get_freq_range(cpu, min_khz, max_khz);
+            power->set_max_freq(cpu, max_khz);
+        }
+    } else {
+        task.task_resume();
+    }
+
+    preempted_t &p = preempted[task.id];
+    p.active = false;
+    order.erase(std::remove(order.begin(), order.end(), task.id), order.end());
+    LOGINF("PREEMPT: task {} resumed, {:.1f} s preempted and {:.3f} Ginst "
+           "given up in {} preemptions"_format(task.name, p.time, p.lost / 1e9,
+                                               p.count));
+}
+
+void Preempt::apply(uint64_t current_interval, double interval_time,
+                    double adjust_interval_time, const tasklist_t &tasklist)
+{
+    if (throttle && !power)
+        throw_with_trace(std::runtime_error(
+            "Throttling batch tasks needs the power actuators"));
+
+    // Time and instructions given up by the preempted tasks
+    double ti = adjust_interval_time > 0 ? adjust_interval_time : interval_time;
+    auto tasks = std::map<uint32_t, Task *>();
+    for (const auto &task_ptr : tasklist) {
+        Task &task = *task_ptr;
+        tasks[task.id] = &task;
+        auto it = preempted.find(task.id);
+        if (it == preempted.end() || !it->second.active)
+            continue;
+        preempted_t &p = it->second;
+        p.time += ti;
+        p.lost += std::max(p.ips * ti - task_sum(task, inst_event(task)), 0.0);
+    }
+
+    // Tasks that are gone are forgotten, and the cores of the throttled
+    // ones get their frequency back
+    for (auto it = preempted.begin(); it != preempted.end();) {
+        if (tasks.count(it->first)) {
+            ++it;
+            continue;
+        }
+        if (throttle && it->second.active) {
+            for (auto cpu : it->second.cpus) {
+                uint64_t min_khz, max_khz;
+                power->get_freq_range(cpu, min_khz, max_khz);
+                power->set_max_freq(cpu, max_khz);
+            }
+        }
+        it = preempted.erase(it);
+    }
+    order.erase(std::remove_if(order.begin(), order.end(),
+                               [&tasks](uint32_t id) {
+                                   return !tasks.count(id);
+                               }),
+                order.end());
+
+    // Health of the latency-critical tasks
+    bool degraded = false;
+    bool healthy = true;
+    auto lc_cpus = std::set<uint32_t>();
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        if (task.batch)
+            continue;
+        lc_cpus.insert(task.cpus.begin(), task.cpus.end());
+
+        double ipc = task_ipc(task);
+        if (ipc > 0) {
+            double &base = baseline[task.id];
+            base = std::max(ipc, base * decay);
+            degraded |= ipc < (1 - ipc_drop) * base;
+            healthy &= ipc >= (1 - ipc_drop / 2) * base;
+        }
+
+        double cycles = task_sum(task, cycles_event(task));
+        for (const auto &name : {"cycle_activity.stalls_l3_miss",
+                                 "cycle_activity.stalls_mem_any"}) {
+            if (task.stats[0].has(name)) {
+                double stalls = cycles > 0 ? task_sum(task, name) / cycles : 0;
+                degraded |= stalls > max_stalls;
+                healthy &= stalls <= max_stalls;
+                break;
+            }
+        }
+
+        // Only fresh latency reports count
+        auto vm = dynamic_cast<const VMTask *>(&task);
+        if (vm && vm->slo > 0 && slo_latency(*vm) > 0 &&
+            current_interval - vm->lat_interval < every) {
+            double ratio = slo_latency(*vm) / vm->slo;
+            degraded |= ratio > 1;
+            healthy &= ratio < 1 - slack;
+        }
+    }
+
+    if (current_interval % every != 0)
+        return;
+
+    if (degraded) {
+        healthy_streak = 0;
+
+        // Running batch task with the largest share of the LLC and memory BW
+        double total_occup = 0, total_mbt = 0;
+        for (const auto &task_ptr : tasklist) {
+            total_occup += task_rdt(*task_ptr, *cat, "LLC_occup[MB]");
+            total_mbt += task_rdt(*task_ptr, *cat, "MBT[MBps]");
+        }
+
+        Task *victim = nullptr;
+        double max_score = -1;
+        for (const auto &task_ptr : tasklist) {
+            Task &task = *task_ptr;
+            if (!task.batch || task.get_status() != Task::Status::runnable ||
+                (preempted.count(task.id) && preempted[task.id].active))
+                continue;
+            // Throttling a core would slow down the LC tasks on it too
+            if (throttle && std::any_of(task.cpus.begin(), task.cpus.end(),
+                                        [&lc_cpus](uint32_t cpu) {
+                                            return lc_cpus.count(cpu);
+                                        }))
+                continue;
+
+            double score =
+                (total_occup > 0 ? task_rdt(task, *cat, "LLC_occup[MB]") /
+                                       total_occup
+                                 : 0) +
+                (total_mbt > 0 ? task_rdt(task, *cat, "MBT[MBps]") / total_mbt
+                               : 0);
+            if (score > max_score) {
+                max_score = score;
+                victim = &task;
+            }
+        }
+
+        if (victim)
+            preempt(*victim,
+                    ti > 0 ? task_sum(*victim, inst_event(*victim)) / ti : 0);
+        else
+            LOGDEB("PREEMPT: latency-critical tasks degraded, no batch task "
+                   "left to preempt");
+    } else if (healthy && !order.empty()) {
+        if (++healthy_streak >= resume_after) {
+            resume(*tasks[order.back()]);
+            healthy_streak = 0;
+        }
+    } else {
+        healthy_streak = 0;
+    }
+}
+
+double Bandit::reward(const tasklist_t &tasklist)
+{
+    double r = 0;
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        double ipc = task_ipc(task);
+        if (ipc <= 0)
+            continue;
+        if (!speedup) {
+            r += ipc;
+            continue;
+        }
+        // Tasks that arrive later take the IPC of their first arm instead
+        stats_t &b = base[task.id];
+        if (current == 0 || b.n == 0) {
+            b.n++;
+            b.mean += (ipc - b.mean) / b.n;
+        }
+        r += ipc / b.mean;
+    }
+    return r;
+}
+
+size_t Bandit::best() const
+{
+    size_t result = 0;
+    for (size_t i = 1; i < stats.size(); i++)
+        if (stats[i].n > 0 &&
+            (stats[result].n == 0 || stats[i].mean > stats[result].mean))
+            result = i;
+    return result;
+}
+
+size_t Bandit::select()
+{
+    // Every arm is tried once after a phase change
+    for (size_t i = 0; i < arms.size(); i++)
+        if (stats[i].n == 0)
+            return i;
+
+    if (explore_cost > budget * total_reward)
+        return best();
+
+    // Rewards are scaled by the best mean to keep c independent of them
+    uint64_t total = 0;
+    double scale = 0;
+    for (const auto &s : stats) {
+        total += s.n;
+        scale = std::max(scale, std::fabs(s.mean));
+    }
+
+    std::normal_distribution<double> normal;
+    size_t result = 0;
+    double max_score = -std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < arms.size(); i++) {
+        const stats_t &s = stats[i];
+        double score;
+        if (thompson) {
+            // Gaussian posterior of the mean, wide until there is a variance
+            double sd = s.n > 1 ? std::sqrt(s.m2 / (s.n - 1)) : scale;
+            score = s.mean + sd / std::sqrt(s.n) * normal(rng);
+        } else {
+            score = s.mean + c * scale * std::sqrt(2 * std::log(total) / s.n);
+        }
+        if (score > max_score) {
+            max_score = score;
+            result = i;
+        }
+    }
+    return result;
+}
+
+void Bandit::pull(size_t arm)
+{
+    if (!started || arm != current) {
+        for (const auto &clos : arms[arm]) {
+            if (clos.mask && actuators)
+                actuators->set_cbm(clos.num, clos.mask);
+            else if (clos.mask)
+                cat->set_cbm(clos.num, 0, clos.mask, 0);
+            if (clos.mbps >= 0 && actuators)
+                actuators->set_mb(clos.num, clos.mbps);
+            else if (clos.mbps >= 0)
+                cat->set_mb(clos.num, 0, 1, clos.mbps);
+        }
+        if (stats[arm].n == 0)
+            LOGINF("BANDIT: trying arm {}"_format(arm));
+        else
+            LOGINF("BANDIT: arm {} ({}), mean reward {:.3f}"_format(
+                arm, arm == best() ? "best" : "exploring", stats[arm].mean));
+        pulled = 0;
+    } else {
+        // Same configuration, no transient to skip
+        pulled = warmup;
+    }
+    current = arm;
+    started = true;
+    reward_sum = 0;
+    reward_n = 0;
+}
+
+void Bandit::reset()
+{
+    stats.assign(arms.size(), stats_t());
+    base.clear();
+    total_reward = 0;
+    explore_cost = 0;
+    deviated = 0;
+    num_phases++;
+}
+
+void Bandit::apply(uint64_t, double, double, const tasklist_t &tasklist)
+{
+    if (arms.empty())
+        return;
+    if (!started) {
+        pull(select());
+        return;
+    }
+
+    if (++pulled <= warmup)
+        return;
+    reward_sum += reward(tasklist);
+    if (++reward_n < epoch)
+        return;
+
+    // End of the pull, update the mean and variance of the arm (Welford)
+    double r = reward_sum / reward_n;
+    stats_t &s = stats[current];
+    bool was_best = s.n > 0 && current == best();
+    double prev = s.mean;
+    s.n++;
+    double delta = r - s.mean;
+    s.mean += delta / s.n;
+    s.m2 += delta * (r - s.mean);
+
+    total_reward += r;
+    size_t b = best();
+    if (current != b)
+        explore_cost += std::max(stats[b].mean - r, 0.0);
+    LOGDEB("BANDIT: arm {} reward {:.3f}, mean {:.3f} over {} pulls, "
+           "exploration cost {:.1f}% of the reward"_format(
+               current, r, s.mean, s.n,
+               total_reward > 0 ? explore_cost / total_reward * 100 : 0));
+
+    // A phase change moves the reward of the arm that was being exploited
+    if (was_best) {
+        if (prev > 0 && std::fabs(r - prev) > phase * prev) {
+            if (++deviated >= phase_epochs) {
+                LOGINF("BANDIT: phase change, reward of arm {} went from "
+                       "{:.3f} to {:.3f}, exploring again"_format(current,
+                                                                  prev, r));
+                reset();
+            }
+        } else {
+            deviated = 0;
+        }
+    }
+
+    pull(select());
+}
+
+size_t Multi::max_window(const std::vector<loop_t> &loops)
+{
+    size_t result = 1;
+    for (const auto &loop : loops)
+        result = std::max<size_t>(result, loop.window);
+    return result;
+}
+
+void Multi::apply(uint64_t current_interval, double interval_time,
+                  double adjust_interval_time, const tasklist_t &tasklist)
+{
+    double ti = adjust_interval_time > 0 ? adjust_interval_time : interval_time;
+    window.push(tasklist, ti);
+
+    for (auto &loop : loops) {
+        if (current_interval % loop.every != 0)
+            continue;
+
+        loop.policy->set_cat(cat);
+        loop.policy->set_clos_alloc(clos_alloc);
+        loop.policy->set_mrc(mrc);
+        loop.policy->set_classifier(classifier);
+        loop.policy->set_actuators(actuators);
+        loop.policy->set_power(loop.actuators.count("freq") ? power : nullptr);
+
+        window.set_span(loop.window);
+        set_metric_window(&window);
+        auto start = std::chrono::steady_clock::now();
+        try {
+            loop.policy->apply(current_interval,
+                               interval_time * window.size(),
+                               window.get_time(), tasklist);
+        } catch (...) {
+            set_metric_window(nullptr);
+            throw;
+        }
+        set_metric_window(nullptr);
+        double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+        loop.runs++;
+        loop.time += elapsed;
+        LOGDEB("MULTI: loop {} ran over {} intervals ({:.3f} s) in {:.2f} "
+               "ms, {:.2f} ms on average"_format(
+                   loop.name, window.size(), window.get_time(),
+                   elapsed * 1000, loop.time / loop.runs * 1000));
+    }
+}
+
+// Pinned right away, not through the actuator layer, as the pinning has to
+// be ordered with the change of the vCPUs online, which the layer could
+// defer
+void VcpuScale::pin(VMTask &vm, uint32_t online)
+{
+    auto online_cpus =
+        std::vector<uint32_t>(vm.cpus.begin(), vm.cpus.begin() + online);
+    for (uint32_t i = 0; i < vm.cpus.size(); i++) {
+        auto cpus = i < online ? std::vector<uint32_t>{vm.cpus[i]}
+                               : online_cpus;
+        vm.task_pin_vcpu(i, cpus);
+    }
+}
+
+void VcpuScale::apply(uint64_t current_interval, double, double,
+                      const tasklist_t &tasklist)
+{
+    if (current_interval % every != 0)
+        return;
+
+    for (const auto &task_ptr : tasklist) {
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        if (!vm || vm->cpus.empty() ||
+            vm->get_status() != Task::Status::runnable)
+            continue;
+        auto it = last_change.find(vm->id);
+        if (it != last_change.end() &&
+            current_interval - it->second < cooldown)
+            continue;
+
+        // The vCPUs offline are idle, so the use of all the cores of the VM
+        // is the use of the online ones
+        uint32_t total = vm->cpus.size();
+        uint32_t online = vm->online_vcpus ? vm->online_vcpus : total;
+        double util = 0;
+        for (auto cpu : std::set<uint32_t>(vm->cpus.begin(), vm->cpus.end()))
+            util += vm->vm_cpu_util.count(cpu) ? vm->vm_cpu_util[cpu] : 0;
+        double per_vcpu = util / online;
+
+        uint32_t target = online;
+        if (per_vcpu > high && online < total)
+            target = online + 1;
+        else if (per_vcpu < low && online > std::max(min_vcpus, 1U) &&
+                 util / (online - 1) < high)
+            target = online - 1;
+        if (target == online)
+            continue;
+
+        // Bring a vCPU online before giving it its own core, and take it
+        // offline after taking the core away
+        try {
+            if (target > online) {
+                vm->task_set_online_vcpus(target);
+                pin(*vm, target);
+                num_up++;
+            } else {
+                pin(*vm, target);
+                vm->task_set_online_vcpus(target);
+                num_down++;
+            }
+        } catch (const std::exception &e) {
+            LOGWAR("VSCALE: could not scale {} to {} vCPUs: {}"_format(
+                vm->name, target, e.what()));
+            continue;
+        }
+        last_change[vm->id] = current_interval;
+        LOGINF("VSCALE: {} from {} to {} vCPUs online, {:.0f}% per vCPU "
+               "({} up and {} down so far)"_format(vm->name, online, target,
+                                                   per_vcpu, num_up,
+                                                   num_down));
+    }
+}
+
+bool Balloon::resize(VMTask &vm, double mb)
+{
+    try {
+        if (actuators)
+            actuators->set_balloon(vm, mb);
+        else
+            memory_monitor().set_balloon(vm, mb);
+    } catch (const std::exception &e) {
+        LOGWAR("BALLOON: could not resize {} to {:.0f} MB: {}"_format(
+            vm.name, mb, e.what()));
+        return false;
+    }
+    return true;
+}
+
+void Balloon::apply(uint64_t current_interval, double, double,
+                    const tasklist_t &tasklist)
+{
+    if (current_interval % every != 0)
+        return;
+
+    // VMs under pressure, the ones with the most major faults first
+    auto pressured = std::vector<std::pair<double, VMTask *>>();
+    double available = memory_monitor().get_host_available();
+    for (const auto &task_ptr : tasklist) {
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        if (!vm || vm->get_status() != Task::Status::runnable)
+            continue;
+        // Without the stats of the guest its usage is unknown
+        const VmMemory &mem = vm->mem;
+        if (mem.actual <= 0 || mem.available <= 0)
+            continue;
+        auto it = last_change.find(vm->id);
+        if (it != last_change.end() &&
+            current_interval - it->second < cooldown)
+            continue;
+
+        double usable = mem.usable / mem.actual * 100;
+        if (mem.swap_in > 0 || mem.major_faults > max_faults || usable < low) {
+            pressured.push_back({mem.major_faults, vm});
+            continue;
+        }
+        if (usable <= high)
+            continue;
+
+        // The size is updated by the resize if it is written right away
+        double actual = mem.actual;
+        double target = std::max(min_mb, actual - mem.max * step / 100);
+        if (target >= actual || !resize(*vm, target))
+            continue;
+        LOGINF("BALLOON: reclaimed {:.0f} MB from {} ({:.0f}% usable), "
+               "{:.0f} MB left"_format(actual - target, vm->name, usable,
+                                       target));
+        available += actual - target;
+        last_change[vm->id] = current_interval;
+        num_reclaimed++;
+    }
+
+    if (pressured.empty())
+        return;
+    double psi = memory_monitor().get_psi_some();
+    if (psi > max_psi) {
+        LOGDEB("BALLOON: host memory pressure {:.1f}%, not growing {} "
+               "VMs"_format(psi, pressured.size()));
+        return;
+    }
+
+    std::sort(pressured.begin(), pressured.end(),
+              [](const std::pair<double, VMTask *> &a,
+                 const std::pair<double, VMTask *> &b) {
+                  return a.first > b.first;
+              });
+    for (const auto &p : pressured) {
+        VMTask *vm = p.second;
+        const VmMemory &mem = vm->mem;
+        double target = std::min(mem.actual + mem.max * step / 100, mem.max);
+        double need = target - mem.actual;
+        if (need <= 0)
+            continue;
+        if (available - need < reserve) {
+            LOGDEB("BALLOON: {} under pressure, but only {:.0f} MB available "
+                   "in the host"_format(vm->name, available));
+            continue;
+        }
+        if (!resize(*vm, target))
+            continue;
+        LOGINF("BALLOON: grew {} by {:.0f} MB to {:.0f} MB ({:.1f} major "
+               "faults/s, {:.2f} MBps swapped in, {} grown and {} reclaimed "
+               "so far)"_format(vm->name, need, target, mem.major_faults,
+                                mem.swap_in, num_grown + 1, num_reclaimed));
+        available -= need;
+        last_change[vm->id] = current_interval;
+        num_grown++;
+    }
+}
+
+const std::vector<uint32_t> &VcpuPin::get_siblings(uint32_t cpu)
+{
+    auto it = siblings.find(cpu);
+    if (it == siblings.end())
+        it = siblings.emplace(cpu, cpu_get_siblings(cpu)).first;
+    return it->second;
+}
+
+void VcpuPin::move(vcpu_t &v, uint32_t cpu, uint64_t current_interval,
+                   const char *reason)
+{
+    uint32_t from = v.cpu;
+    v.task->task_pin_vcpu(v.vcpu, cpu);
+    pins[v.task->id][v.vcpu] = cpu;
+    v.cpu = cpu;
+
+    // The cost is measured in the next interval
+    const Stats &stats = v.task->stats[v.vcpu];
+    double cycles = stats.last(cycles_event(*v.task));
+    double ipc = cycles > 0 ? stats.last(inst_event(*v.task)) / cycles : 0;
+    moved.push_back({v.task->id, v.vcpu, ipc});
+    last_move[{v.task->id, v.vcpu}] = current_interval;
+    num_moves++;
+
+    LOGINF("VCPU: {} vCPU {} moved from cpu {} to cpu {} ({}): util {:.1f}%, "
+           "stalls {:.3f}"_format(v.task->name, v.vcpu, from, cpu, reason,
+                                  v.util, v.stalls));
+}
+
+void VcpuPin::apply(uint64_t current_interval, double interval_time,
+                    double adjust_interval_time, const tasklist_t &tasklist)
+{
+    auto vms = std::vector<VMTask *>();
+    for (const auto &task_ptr : tasklist)
+        if (auto vm = dynamic_cast<VMTask *>(task_ptr.get()))
+            vms.push_back(vm);
+
+    // Start from one cpu per vCPU, as the affinity of the VMs allows any of
+    // their cpus to be used by any vCPU
+    if (!pinned) {
+        for (auto vm : vms) {
+            for (uint32_t i = 0; i < vm->cpus.size(); i++) {
+                vm->task_pin_vcpu(i, vm->cpus[i]);
+                if (std::find(cores.begin(), cores.end(), vm->cpus[i]) ==
+                    cores.end())
+                    cores.push_back(vm->cpus[i]);
+            }
+            pins[vm->id] = vm->cpus;
+        }
+        pinned = true;
+        LOGINF("VCPU: pinned the vCPUs of {} VMs, pool of {} cpus"_format(
+            vms.size(), cores.size()));
+        return;
+    }
+
+    // Cost of the last moves: instructions lost with respect to the IPC that
+    // the vCPU had before moving
+    for (auto vm : vms) {
+        for (uint32_t i = 0; i < vm->cpus.size(); i++) {
+            if (vm->pids[i] > 0 && vm->stats[i].has(inst_event(*vm)))
+                total_inst += vm->stats[i].last(inst_event(*vm));
+        }
+        for (const auto &m : moved) {
+            if (m.task_id != vm->id || m.vcpu >= vm->cpus.size())
+                continue;
+            const Stats &stats = vm->stats[m.vcpu];
+            double cycles = stats.last(cycles_event(*vm));
+            double inst = stats.last(inst_event(*vm));
+            double lost = std::max(0.0, m.ipc * cycles - inst);
+            lost_inst += lost;
+            LOGINF("VCPU: {} vCPU {} migration cost {:.0f} instructions, "
+                   "{} moves, {:.4f}% of the instructions lost so far"_format(
+                       vm->name, m.vcpu, lost, num_moves,
+                       total_inst > 0 ? lost_inst / total_inst * 100 : 0));
+        }
+    }
+    moved.clear();
+
+    if (current_interval % every != 0)
+        return;
+    if (total_inst > 0 && lost_inst / total_inst > budget) {
+        LOGDEB("VCPU: migration budget exhausted, no moves");
+        return;
+    }
+
+    // Current placement and metrics of every vCPU
+    auto vcpus = std::vector<vcpu_t>();
+    auto placement = std::map<uint32_t, std::vector<size_t>>();
+    for (auto vm : vms) {
+        auto p = pins.find(vm->id);
+        if (p == pins.end())
+            continue;
+        for (uint32_t i = 0; i < vm->cpus.size(); i++) {
+            if (vm->pids[i] <= 0)
+                continue;
+            uint32_t cpu = p->second[i];
+            double util = vm->vm_cpu_util.count(vm->cpus[i])
+                              ? vm->vm_cpu_util[vm->cpus[i]]
+                              : 0;
+
+            // Without stall events any busy co-runner counts as contention
+            double stalls = 1;
+            const Stats &stats = vm->stats[i];
+            for (const auto &name : {"cycle_activity.stalls_total",
+                                     "cycle_activity.stalls_mem_any"}) {
+                if (stats.has(name)) {
+                    double cycles = stats.last(cycles_event(*vm));
+                    stalls = cycles > 0 ? stats.last(name) / cycles : 0;
+                    break;
+                }
+            }
+
+            placement[cpu].push_back(vcpus.size());
+            vcpus.push_back({vm, i, cpu, util, stalls});
+        }
+    }
+
+    auto temps = std::map<uint32_t, double>();
+    for (auto cpu : cores)
+        temps[cpu] = getTemperatureCPU(cpu);
+
+    auto is_free = [&](uint32_t cpu) {
+        return !placement.count(cpu) || placement[cpu].empty();
+    };
+    auto busy = [&](const vcpu_t &v) { return v.util >= busy_util; };
+    auto in_pool = [&](uint32_t cpu) {
+        return std::find(cores.begin(), cores.end(), cpu) != cores.end();
+    };
+    // Free cpu of the pool whose core is completely free, coolest first
+    auto free_core = [&](double temp_limit) {
+        int best = -1;
+        for (auto cpu : cores) {
+            bool free = true;
+            for (auto s : get_siblings(cpu))
+                free &= is_free(s) && (s == cpu || in_pool(s));
+            if (free && temps[cpu] < temp_limit &&
+                (best < 0 || temps[cpu] < temps[best]))
+                best = cpu;
+        }
+        return best;
+    };
+    auto relocate = [&](size_t idx, uint32_t cpu, const char *reason) {
+        vcpu_t &v = vcpus[idx];
+        auto &from = placement[v.cpu];
+        from.erase(std::find(from.begin(), from.end(), idx));
+        move(v, cpu, current_interval, reason);
+        placement[cpu].push_back(idx);
+    };
+
+    uint32_t moves = 0;
+    for (size_t idx = 0; idx < vcpus.size() && moves < max_moves; idx++) {
+        vcpu_t &v = vcpus[idx];
+        uint32_t cpu = v.cpu;
+        auto it = last_move.find({v.task->id, v.vcpu});
+        if (it != last_move.end() && current_interval - it->second < cooldown)
+            continue;
+        if (!busy(v))
+            continue;
+
+        // Away from overheated cores
+        if (temps.count(cpu) && temps[cpu] >= max_temp) {
+            int target = free_core(max_temp);
+            if (target >= 0) {
+                relocate(idx, target, "temperature");
+                moves++;
+            }
+            continue;
+        }
+
+        // Apart from busy vCPUs of other VMs in the same core
+        if (v.stalls < max_stalls)
+            continue;
+        bool contended = false;
+        for (auto s : get_siblings(cpu)) {
+            if (s == cpu || !placement.count(s))
+                continue;
+            for (auto other : placement[s])
+                contended |= vcpus[other].task != v.task && busy(vcpus[other]);
+        }
+        if (contended) {
+            int target = free_core(max_temp);
+            if (target >= 0) {
+                relocate(idx, target, "SMT contention");
+                moves++;
+            }
+        }
+    }
+
+    // Pack idle vCPUs that are alone in their core next to other idle ones
+    for (size_t idx = 0; idx < vcpus.size() && moves < max_moves; idx++) {
+        vcpu_t &v = vcpus[idx];
+        uint32_t cpu = v.cpu;
+        auto it = last_move.find({v.task->id, v.vcpu});
+        if (busy(v) ||
+            (it != last_move.end() && current_interval - it->second < cooldown))
+            continue;
+
+        bool alone = placement[cpu].size() == 1;
+        for (auto s : get_siblings(cpu))
+            alone &= s == cpu || is_free(s);
+        if (!alone)
+            continue;
+
+        for (auto target : cores) {
+            if (!is_free(target) || get_siblings(target) == get_siblings(cpu))
+                continue;
+            bool idle_sibling = false;
+            for (auto s : get_siblings(target)) {
+                if (s == target || !placement.count(s) || placement[s].empty())
+                    continue;
+                idle_sibling = true;
+                for (auto other : placement[s])
+                    idle_sibling &= !busy(vcpus[other]);
+            }
+            if (idle_sibling) {
+                relocate(idx, target, "packing");
+                moves++;
+                break;
+            }
+        }
+    }
+}
 
 } // namespace policy
 } // namespace cat
@@ -16,8 +16,13 @@
 
 #pragma once
 
+#include "actuator.hpp"
 #include "app-task.hpp"
+#include "classifier.hpp"
+#include "clos-alloc.hpp"
 #include "intel-rdt.hpp"
+#include "mrc.hpp"
+#include "power.hpp"
 #include "vm-task.hpp"
 
 #include <boost/accumulators/accumulators.hpp>
@@ -26,7 +31,9 @@
 #include <boost/accumulators/statistics/rolling_variance.hpp>
 #include <boost/accumulators/statistics/rolling_window.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
+#include <array>
 #include <deque>
+#include <random>
 #include <set>
 
 typedef std::shared_ptr<Task> task_ptr_t;
@@ -42,15 +49,116 @@ namespace policy
 {
 namespace acc = boost::accumulators;
 
+// Metrics of a whole task, aggregated over the stats of its cpus. The RDT
+// ones are split among the pids that share a monitoring group.
+double task_sum(const Task &task, const std::string &name);
+double task_rdt(const Task &task, const IntelRDT &cat,
+                const std::string &name);
+double task_ipc(const Task &task);
+double task_mpki_l3(const Task &task);
+
+// Name of the first of the candidate events monitored for the task, and of
+// the instructions and cycles events in use
+std::string task_event(const Task &task,
+                       const std::vector<std::string> &candidates);
+std::string inst_event(const Task &task);
+std::string cycles_event(const Task &task);
+
+// Counters of the tasks over their last intervals: the sum of the counters
+// and the mean of the snapshots and rates. Keeps up to 'capacity' intervals,
+// of which the last 'span' ones are read.
+class MetricWindow
+{
+    struct interval_t {
+        double time;
+        // Task id -> cpu slot -> counter -> value
+        std::map<uint32_t, std::vector<std::map<std::string, double>>> tasks;
+    };
+    std::deque<interval_t> intervals;
+    size_t capacity;
+    size_t span;
+
+  public:
+    MetricWindow(size_t _capacity) : capacity(_capacity), span(_capacity)
+    {
+    }
+
+    void push(const tasklist_t &tasklist, double time);
+    void set_span(size_t n);
+    size_t size() const;          // Intervals read
+    double get_time() const;      // Seconds of the intervals read
+    double get_last_time() const; // Seconds of the last interval
+    double value(const Task &task, size_t i, const std::string &name) const;
+};
+
+// Window the metrics above are read from instead of the last interval, none
+// if null. Set by the policies that run others over longer periods.
+void set_metric_window(const MetricWindow *window);
+
 // Base class that does nothing
 class Base
 {
   protected:
     std::shared_ptr<IntelRDT> cat;
+    std::shared_ptr<ClosAllocator> clos_alloc;
+    std::shared_ptr<MrcProfiler> mrc;
+    std::shared_ptr<PowerCtl> power;
+    std::shared_ptr<VmClassifier> classifier;
+    std::shared_ptr<Actuators> actuators;
 
   public:
     Base() = default;
 
+    void set_clos_alloc(std::shared_ptr<ClosAllocator> _clos_alloc)
+    {
+        clos_alloc = _clos_alloc;
+    }
+    std::shared_ptr<ClosAllocator> get_clos_alloc()
+    {
+        return clos_alloc;
+    }
+
+    // Miss-rate curves, if the profiler is enabled
+    void set_mrc(std::shared_ptr<MrcProfiler> _mrc)
+    {
+        mrc = _mrc;
+    }
+    std::shared_ptr<MrcProfiler> get_mrc()
+    {
+        return mrc;
+    }
+
+    // RAPL and cpufreq actuators
+    void set_power(std::shared_ptr<PowerCtl> _power)
+    {
+        power = _power;
+    }
+    std::shared_ptr<PowerCtl> get_power()
+    {
+        return power;
+    }
+
+    // Online classifier of the VMs, if enabled
+    void set_classifier(std::shared_ptr<VmClassifier> _classifier)
+    {
+        classifier = _classifier;
+    }
+    std::shared_ptr<VmClassifier> get_classifier()
+    {
+        return classifier;
+    }
+
+    // Declarative actuator layer, if enabled. Policies that support it submit
+    // their writes to it instead of making them directly.
+    void set_actuators(std::shared_ptr<Actuators> _actuators)
+    {
+        actuators = _actuators;
+    }
+    std::shared_ptr<Actuators> get_actuators()
+    {
+        return actuators;
+    }
+
     void set_cat(std::shared_ptr<IntelRDT> _cat)
     {
         cat = _cat;
@@ -73,6 +181,28 @@ class Base
         }
     }
 
+    // CLOS the task is currently mapped to
+    uint32_t task_clos(const Task &task) const
+    {
+        if (clos_alloc && clos_alloc->has_task(task.id))
+            return clos_alloc->get_clos(task.id);
+        if (clos_alloc && !clos_alloc->is_by_pid())
+            return cat->get_clos(task.cpus[0]);
+        return cat->get_clos_of_task(task.pids[0]);
+    }
+
+    // L2 masks are set in every L2 cluster, as the CLOS is the same for all
+    // of them. Use it to keep latency-critical vCPUs apart from their SMT
+    // siblings by giving both CLOS disjoint L2 ways.
+    void set_l2_cbms(const cbms_t &cbms)
+    {
+        assert(cat->get_l2_max_closids() >= cbms.size());
+        for (size_t clos = 0; clos < cbms.size(); clos++)
+            for (const auto &l2id : cat->get_l2ids())
+                cat->set_l2_clos(clos, cbms[clos], l2id, 0,
+                                 CAT_UPDATE_SCOPE_BOTH);
+    }
+
     virtual ~Base() = default;
 
     // Derived classes should perform their operations here.
@@ -97,5 +227,562 @@ class Test : public Base
 };
 typedef Test Tt;
 
+// Utility-based cache partitioning. Estimates the miss curve of every task
+// from the MPKI observed at each allocation, weights the misses saved by the
+// IPC of the task and distributes the ways with the UCP lookahead algorithm.
+class Ucp : public Base
+{
+  protected:
+    uint64_t every = -1;
+    uint32_t min_ways = min_num_ways;
+    double hysteresis = 0.05; // Min. relative utility gain to repartition
+    double alpha = 0.5;       // Exponent of the power law for unseen points
+    uint64_t way_size = 0;    // Bytes per LLC way
+
+    // Counters accumulated since the last partitioning
+    struct sample_t {
+        double inst = 0;
+        double cycles = 0;
+        double misses = 0;
+        double occup = 0;
+        uint64_t n = 0;
+    };
+    std::map<uint32_t, sample_t> samples;
+
+    std::map<uint32_t, std::map<uint32_t, double>> curves; // MPKI per ways
+    std::map<uint32_t, uint32_t> ways;                      // Current ways
+
+    double mpki(uint32_t id, uint32_t w, uint32_t sat_ways) const;
+    std::map<uint32_t, uint32_t>
+    lookahead(const std::map<uint32_t, std::vector<double>> &utility) const;
+
+  public:
+    virtual ~Ucp() = default;
+    Ucp(uint64_t _every, uint32_t _min_ways, double _hysteresis,
+        double _alpha)
+        : every(_every), min_ways(_min_ways), hysteresis(_hysteresis),
+          alpha(_alpha)
+    {
+    }
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+// Closed-loop MBA. Batch tasks that use a large share of the memory BW are
+// throttled while the latency-critical (non-batch) tasks show an IPC drop or
+// too many memory stalls, and released again when they recover.
+class MbaFeedback : public Base
+{
+  protected:
+    int ctrl = 1;                // 1: limits in MBps, 0: limits in %
+    unsigned min_mb = 500;       // Lowest limit set to an aggressor
+    unsigned max_mb = 20000;     // Limit that means unthrottled
+    double step = 0.2;           // Tighten by step, loosen by step / 2
+    double aggressor_share = 0.2; // Min. share of the total BW of aggressors
+    double ipc_drop = 0.1;       // Relative IPC drop that triggers throttling
+    double max_stalls = 1;       // Fraction of stall cycles that triggers it
+    double decay = 0.995;        // Decay of the IPC baseline per interval
+
+    std::map<uint32_t, double> baseline; // Peak IPC of the LC tasks
+    std::map<uint32_t, unsigned> limits; // Current limit of throttled CLOS
+
+  public:
+    virtual ~MbaFeedback() = default;
+    MbaFeedback(int _ctrl, unsigned _min_mb, unsigned _max_mb, double _step,
+                double _aggressor_share, double _ipc_drop, double _max_stalls)
+        : ctrl(_ctrl), min_mb(_min_mb), max_mb(_max_mb), step(_step),
+          aggressor_share(_aggressor_share), ipc_drop(_ipc_drop),
+          max_stalls(_max_stalls)
+    {
+    }
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+// Shares the disk BW and IOPS of the storage backend among the VMs with the
+// block I/O throttling of libvirt. The demand of each VM is smoothed every
+// interval, and every few intervals the capacity is divided max-min fairly
+// among the VMs, with some headroom over their demand so that they can grow.
+// With priorities the latency-critical (non-batch) VMs are not limited, and
+// the batch VMs share what they leave, shrunk while the latency per operation
+// of a latency-critical VM is over the limit. Limits are only rewritten when
+// they change more than the hysteresis.
+class DiskIo : public Base
+{
+  protected:
+    uint64_t every = 5;
+    double bytes_sec;          // Capacity of the backend
+    double iops_sec;           // 0 if IOPS are not limited
+    bool priority = false;     // Batch VMs share what the LC VMs leave
+    double headroom = 0.2;     // Limit over the demand of a VM
+    double min_share = 0.05;   // Min. fraction of the capacity of a VM
+    double hysteresis = 0.1;   // Min. relative change to rewrite a limit
+    double max_latency = 0;    // ns per operation of the LC VMs, 0 disables
+    double step = 0.2;         // Change of the batch capacity
+    double alpha = 0.5;        // Smoothing of the demand
+
+    struct vm_t {
+        double bw = 0;   // Bytes/s
+        double iops = 0; // Operations/s
+        double latency = 0;
+        unsigned long long bw_limit = 0;
+        unsigned long long iops_limit = 0;
+    };
+    std::map<uint32_t, vm_t> vms;
+    double batch_scale = 1;
+
+    std::map<uint32_t, double> share(const std::map<uint32_t, double> &demand,
+                                     double capacity, double floor) const;
+    bool changed(unsigned long long current, unsigned long long wanted) const;
+
+  public:
+    virtual ~DiskIo() = default;
+    DiskIo(uint64_t _every, double _bytes_sec, double _iops_sec,
+           bool _priority, double _headroom, double _min_share,
+           double _hysteresis, double _max_latency, double _step)
+        : every(_every), bytes_sec(_bytes_sec), iops_sec(_iops_sec),
+          priority(_priority), headroom(_headroom), min_share(_min_share),
+          hysteresis(_hysteresis), max_latency(_max_latency), step(_step)
+    {
+    }
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+// Keeps the power of the packages under a budget by capping the frequency of
+// the cores of the batch tasks, which is lowered a step while the power is
+// over the budget and raised again when it is below it by some margin. The
+// cores of the latency-critical tasks are left at their maximum frequency.
+// Optionally sets the RAPL limit of the packages as a hard limit.
+class PowerCap : public Base
+{
+  protected:
+    uint64_t every = 1;
+    double budget;         // W, all the packages
+    uint64_t step = 100000; // kHz
+    uint64_t min_freq = 0; // kHz, lowest cap of a batch core
+    double margin = 0.05;  // Fraction of the budget to raise the caps
+    double rapl = 0;       // W per package, 0 leaves RAPL untouched
+
+    bool initialized = false;
+    std::map<uint32_t, uint64_t> caps; // Batch cpu -> current cap
+
+  public:
+    virtual ~PowerCap() = default;
+    PowerCap(uint64_t _every, double _budget, uint64_t _step,
+             uint64_t _min_freq, double _margin, double _rapl)
+        : every(_every), budget(_budget), step(_step), min_freq(_min_freq),
+          margin(_margin), rapl(_rapl)
+    {
+    }
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+// Keeps the tail latency of the client-server VMs under their SLO with the
+// reports of their clients. While a VM violates its SLO it is given LLC ways
+// taken from the batch tasks, then the batch tasks are throttled with MBA, and
+// then the batch VMs are packed on fewer of their cores. When every VM has
+// some slack under its SLO the steps are undone in the reverse order. The
+// VMs with an SLO and the batch tasks are mapped by the CLOS allocator, the
+// batch ones all with the same allocation.
+class SloFeedback : public Base
+{
+  protected:
+    uint64_t every = 1;
+    double slack = 0.2;        // Fraction under the SLO to release resources
+    uint32_t lc_ways = 2;      // Initial ways of a VM without requested ways
+    uint32_t min_ways = 2;     // Ways left to the batch tasks
+    uint32_t step_ways = 1;    // Ways given per step
+    unsigned min_mb = 500;     // Lowest MBA limit of the batch tasks (MBps)
+    unsigned max_mb = 20000;   // Limit that means unthrottled
+    double step = 0.2;         // Tighten the MBA limit by step
+    uint32_t min_cores = 1;    // Cores left to a batch VM
+
+    bool initialized = false;
+    std::map<uint32_t, uint32_t> ways;  // VM with an SLO -> LLC ways
+    std::map<uint32_t, uint32_t> cores; // Batch VM -> cores it runs on
+    unsigned batch_mb = 0;
+    uint64_t num_violations = 0;
+
+    uint32_t batch_ways() const;
+    void allocate(const tasklist_t &tasklist);
+    void set_cores(VMTask &vm, uint32_t n);
+    bool tighten(VMTask &worst, const tasklist_t &tasklist);
+    bool release(VMTask &best, const tasklist_t &tasklist);
+
+  public:
+    virtual ~SloFeedback() = default;
+    SloFeedback(uint64_t _every, double _slack, uint32_t _lc_ways,
+                uint32_t _min_ways, uint32_t _step_ways, unsigned _min_mb,
+                unsigned _max_mb, double _step, uint32_t _min_cores)
+        : every(_every), slack(_slack), lc_ways(_lc_ways), min_ways(_min_ways),
+          step_ways(_step_ways), min_mb(_min_mb), max_mb(_max_mb), step(_step),
+          min_cores(_min_cores)
+    {
+    }
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+// Allocates the LLC ways, memory BW (MBA), cores, network and disk BW of the
+// tasks jointly to maximize the instructions per second of the system. The
+// IPS of a task is modeled as the IPS it would reach without limits times
+// the fraction of its demand of each resource that it gets, raised to its
+// sensitivity to the resource, all estimated from its stats (or, for the
+// memory of the VMs without stall events, from the category the classifier
+// gives them). Starting from the floors of the tasks, a greedy search with
+// lookahead hands out blocks of units to the task and resource with the
+// largest gain per fraction of the capacity taken, until nothing gains or
+// the compute budget runs out.
+// A new plan is only applied when it is expected to gain enough, and it is
+// applied as a whole: if an actuator fails, the previous plan is restored.
+// Cores, network and disk are only allocated to the VMs.
+class Joint : public Base
+{
+  public:
+    enum resource_t { ways_r, mbps_r, cores_r, net_r, disk_r, num_resources };
+    typedef std::array<double, num_resources> alloc_t;
+    typedef std::map<uint32_t, alloc_t> plan_t;
+
+  protected:
+    struct task_t {
+        Task *task;
+        VMTask *vm; // nullptr for apps
+        double ips; // Potential IPS, without limits
+        alloc_t demand;
+        alloc_t weight; // Sensitivity to each resource
+        alloc_t floor;
+        alloc_t max;
+    };
+    // Sums over the intervals of a decision
+    struct sample_t {
+        double inst = 0;
+        double cycles = 0;
+        double stalls = -1; // Memory stall cycles, -1 if not monitored
+        double occup = 0;   // MB
+        double mbt = 0;     // MBps
+        double cpus = 0;    // Busy cores
+        double net = 0;     // Kbps of the busiest direction
+        double disk = 0;    // Bytes/s
+        double time = 0;    // Seconds
+        uint64_t n = 0;
+    };
+
+    uint64_t every = 10;
+    alloc_t capacity; // 0 disables a resource (but the ways)
+    alloc_t unit;
+    alloc_t min; // Floor of every task
+    uint32_t lookahead = 4;
+    double budget = 0.005;    // Seconds of search per decision
+    double hysteresis = 0.05; // Min. relative gain to apply a plan
+    double headroom = 0.2;    // Demand over the observed use
+
+    std::map<uint32_t, sample_t> samples;
+    plan_t current;
+    uint64_t num_plans = 0;
+    uint64_t num_rollbacks = 0;
+
+    std::vector<task_t> estimate(const tasklist_t &tasklist);
+    double predict(const task_t &t, const alloc_t &a) const;
+    plan_t search(const std::vector<task_t> &tasks);
+    void actuate(const plan_t &to, const plan_t &from,
+                 const tasklist_t &tasklist);
+
+  public:
+    virtual ~Joint() = default;
+    Joint(uint64_t _every, const alloc_t &_capacity, const alloc_t &_unit,
+          const alloc_t &_min, uint32_t _lookahead, double _budget,
+          double _hysteresis, double _headroom)
+        : every(_every), capacity(_capacity), unit(_unit), min(_min),
+          lookahead(_lookahead), budget(_budget), hysteresis(_hysteresis),
+          headroom(_headroom)
+    {
+    }
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+// Preempts batch tasks while the latency-critical (non-batch) tasks degrade:
+// their IPC drops under the peak, they stall too much on memory or, for VMs
+// with an SLO, their tail latency goes over it. Each decision the running
+// batch task with the most LLC occupancy and memory BW is paused, or has the
+// frequency of its cores set to the minimum, and once the latency-critical
+// tasks have had headroom for some decisions the last preempted task is
+// resumed. The time each task spends preempted and the instructions it gives
+// up (at the rate it had before) are tracked.
+class Preempt : public Base
+{
+  protected:
+    uint64_t every = 1;
+    bool throttle = false;     // Throttle the cores instead of pausing
+    double ipc_drop = 0.1;     // Relative IPC drop of a LC task
+    double max_stalls = 1;     // Fraction of stall cycles of a LC task
+    double slack = 0.2;        // Fraction under the SLO that is headroom
+    uint64_t resume_after = 3; // Decisions with headroom to resume a task
+    double decay = 0.995;      // Decay of the IPC baseline per interval
+
+    struct preempted_t {
+        double ips = 0;  // Before being preempted
+        double time = 0; // Seconds preempted, all the times
+        double lost = 0; // Instructions given up, all the times
+        uint64_t count = 0;
+        bool active = false;
+        std::vector<uint32_t> cpus; // Throttled, to restore them
+    };
+    std::map<uint32_t, double> baseline; // Peak IPC of the LC tasks
+    std::map<uint32_t, preempted_t> preempted;
+    std::vector<uint32_t> order; // Preempted tasks, the last one at the end
+    uint64_t healthy_streak = 0;
+
+    void preempt(Task &task, double ips);
+    void resume(Task &task);
+
+  public:
+    virtual ~Preempt() = default;
+    Preempt(uint64_t _every, bool _throttle, double _ipc_drop,
+            double _max_stalls, double _slack, uint64_t _resume_after)
+        : every(_every), throttle(_throttle), ipc_drop(_ipc_drop),
+          max_stalls(_max_stalls), slack(_slack), resume_after(_resume_after)
+    {
+    }
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+// Explores a small set of candidate CAT/MBA configurations (the arms) as a
+// multi-armed bandit. Each arm is run for an epoch of some intervals and
+// rewarded with the aggregate IPC of the tasks or their weighted speedup
+// (their IPC over the one they have with the first arm, the reference), and
+// the next arm is chosen with UCB1 or Thompson sampling, so it converges on
+// the best one. The reward lost running arms worse than the best one is kept
+// within a fraction of the total reward; once it is spent only the best arm
+// is run. When the reward of the best arm moves away from its mean for some
+// epochs in a row the phase is considered changed and the arms are explored
+// again. The tasks keep their CLOS, the arms only change their schematas.
+class Bandit : public Base
+{
+  public:
+    struct clos_t {
+        uint32_t num;
+        uint64_t mask; // 0 leaves the ways untouched
+        int mbps;      // -1 leaves MBA untouched
+    };
+    typedef std::vector<clos_t> arm_t;
+
+  protected:
+    struct stats_t {
+        uint64_t n = 0;
+        double mean = 0;
+        double m2 = 0; // Sum of squared deviations from the mean
+    };
+
+    std::vector<arm_t> arms;
+    uint64_t epoch = 5;        // Rewarded intervals per pull
+    uint64_t warmup = 1;       // Intervals after a switch not rewarded
+    bool thompson = false;     // UCB1 otherwise
+    bool speedup = false;      // Weighted speedup, aggregate IPC otherwise
+    double c = 1;              // Exploration weight of UCB1
+    double budget = 0.1;       // Fraction of the reward for exploring
+    double phase = 0.2;        // Relative deviation of a phase change
+    uint64_t phase_epochs = 2; // Epochs deviated to explore again
+
+    std::vector<stats_t> stats;   // Per arm, since the last phase change
+    std::map<uint32_t, stats_t> base; // IPC of the tasks with the first arm
+    std::mt19937 rng;
+    size_t current = 0;
+    bool started = false;
+    uint64_t pulled = 0; // Intervals into the current pull
+    double reward_sum = 0;
+    uint64_t reward_n = 0;
+    double total_reward = 0;
+    double explore_cost = 0;
+    uint64_t deviated = 0;
+    uint64_t num_phases = 0;
+
+    double reward(const tasklist_t &tasklist);
+    size_t best() const;
+    size_t select();
+    void pull(size_t arm);
+    void reset();
+
+  public:
+    virtual ~Bandit() = default;
+    Bandit(const std::vector<arm_t> &_arms, uint64_t _epoch,
+           uint64_t _warmup, bool _thompson, bool _speedup, double _c,
+           double _budget, double _phase, uint64_t _phase_epochs)
+        : arms(_arms), epoch(_epoch), warmup(_warmup), thompson(_thompson),
+          speedup(_speedup), c(_c), budget(_budget), phase(_phase),
+          phase_epochs(_phase_epochs), stats(_arms.size()),
+          rng(std::random_device()())
+    {
+    }
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+// Runs several policies as control loops with their own periods, so that
+// fast controllers (e.g. a power cap every interval) do not force the slow
+// ones (e.g. cache partitioning every few seconds) to run as fast, all fed by
+// the same sampling. Every interval the counters of the tasks are added to a
+// metric window, and each loop that is due runs its policy with the metric
+// helpers reading the intervals of its own window and with the time of the
+// window as the interval time. Loops due in the same interval run in order.
+// Each loop owns a set of actuators that no other loop can own (checked
+// when reading the config, which also keeps the ways and MBA, both set on
+// the CLOS, in the same loop), and only the owner of the frequency gets the
+// power actuators.
+class Multi : public Base
+{
+  public:
+    struct loop_t {
+        std::string name;
+        std::shared_ptr<Base> policy;
+        uint64_t every = 1;
+        uint64_t window = 1;             // Intervals of its metric window
+        std::set<std::string> actuators; // Owned by the loop
+        uint64_t runs = 0;
+        double time = 0;                 // Seconds spent running the policy
+    };
+
+  protected:
+    std::vector<loop_t> loops;
+    MetricWindow window;
+
+    static size_t max_window(const std::vector<loop_t> &loops);
+
+  public:
+    virtual ~Multi() = default;
+    Multi(const std::vector<loop_t> &_loops)
+        : loops(_loops), window(max_window(_loops))
+    {
+    }
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+// Scales the vCPUs online in each VM with its CPU utilization: while the
+// utilization per online vCPU is over 'high' one more is brought online, and
+// while it is under 'low' one is taken offline, down to 'min_vcpus', through
+// the guest agent. The online vCPUs are pinned each to its own core, and the
+// offline ones to the cores of the online ones, so that the cores of the
+// vCPUs offline are left free. A VM is not scaled again until 'cooldown'
+// intervals after a change.
+class VcpuScale : public Base
+{
+  protected:
+    uint64_t every = 5;
+    double high = 80; // % of a core per online vCPU
+    double low = 30;
+    uint32_t min_vcpus = 1;
+    uint64_t cooldown = 10;
+
+    std::map<uint32_t, uint64_t> last_change; // VM -> interval
+    uint64_t num_up = 0;
+    uint64_t num_down = 0;
+
+    void pin(VMTask &vm, uint32_t online);
+
+  public:
+    virtual ~VcpuScale() = default;
+    VcpuScale(uint64_t _every, double _high, double _low, uint32_t _min_vcpus,
+              uint64_t _cooldown)
+        : every(_every), high(_high), low(_low), min_vcpus(_min_vcpus),
+          cooldown(_cooldown)
+    {
+    }
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+// Resizes the balloons of the VMs to overcommit the memory of the host. A VM
+// under pressure (swapping in, over 'max_faults' major faults per second or
+// less than 'low' % of its memory usable) grows by 'step' % of its maximum
+// memory, while the host keeps 'reserve' MB available and its memory pressure
+// (PSI) stays under 'max_psi' %. A VM with more than 'high' % of its memory
+// usable gives back the same step, down to 'min_mb'. The VMs are reclaimed
+// before growing the others, and a VM is not resized again until 'cooldown'
+// intervals after a change.
+class Balloon : public Base
+{
+  protected:
+    uint64_t every = 5;
+    double low = 10; // % of the balloon usable by the guest
+    double high = 40;
+    double step = 10;        // % of the maximum memory of the VM
+    double min_mb = 1024;    // Smallest balloon
+    double reserve = 2048;   // MB left available in the host
+    double max_faults = 100; // Major faults per second
+    double max_psi = 10;     // % of the time stalled in the host
+    uint64_t cooldown = 3;
+
+    std::map<uint32_t, uint64_t> last_change; // VM -> interval
+    uint64_t num_grown = 0;
+    uint64_t num_reclaimed = 0;
+
+    bool resize(VMTask &vm, double mb);
+
+  public:
+    virtual ~Balloon() = default;
+    Balloon(uint64_t _every, double _low, double _high, double _step,
+            double _min_mb, double _reserve, double _max_faults,
+            double _max_psi, uint64_t _cooldown)
+        : every(_every), low(_low), high(_high), step(_step), min_mb(_min_mb),
+          reserve(_reserve), max_faults(_max_faults), max_psi(_max_psi),
+          cooldown(_cooldown)
+    {
+    }
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
+// Moves the VCPUs of the VMs among a pool of cores at runtime. Busy VCPUs
+// with many stalls that share an SMT core with a busy VCPU of another VM, or
+// that run on a core over the temperature limit, are moved to a free core,
+// and idle VCPUs are packed on the siblings of other idle ones to free whole
+// cores. Each move is charged the instructions the VCPU loses in the next
+// interval, and no moves are done while that cost exceeds the budget.
+class VcpuPin : public Base
+{
+  protected:
+    uint64_t every = 1;
+    std::vector<uint32_t> cores; // Pool of cores (all the VM cpus if empty)
+    double busy_util = 50;       // VCPU utilization (%) considered busy
+    double max_stalls = 0.4;     // Stall fraction that reveals contention
+    double max_temp = 80;        // Temperature (C) to move away from
+    uint32_t max_moves = 2;      // Moves per decision
+    uint64_t cooldown = 10;      // Intervals before moving a VCPU again
+    double budget = 0.01;        // Max. fraction of instructions lost
+
+    struct vcpu_t {
+        VMTask *task;
+        uint32_t vcpu;
+        uint32_t cpu; // Pinned to
+        double util;
+        double stalls;
+    };
+    struct move_t {
+        uint32_t task_id;
+        uint32_t vcpu;
+        double ipc; // Before the move
+    };
+
+    bool pinned = false;
+    // VM -> cpu each vCPU is pinned to. The cpus of the tasks are left as
+    // configured, as the stats and utilization of the vCPUs are kept by them.
+    std::map<uint32_t, std::vector<uint32_t>> pins;
+    std::map<std::pair<uint32_t, uint32_t>, uint64_t> last_move;
+    std::vector<move_t> moved; // Moves whose cost is still to be measured
+    std::map<uint32_t, std::vector<uint32_t>> siblings;
+    uint64_t num_moves = 0;
+    double lost_inst = 0;
+    double total_inst = 0;
+
+    const std::vector<uint32_t> &get_siblings(uint32_t cpu);
+    void move(vcpu_t &v, uint32_t cpu, uint64_t current_interval,
+              const char *reason);
+
+  public:
+    virtual ~VcpuPin() = default;
+    VcpuPin(uint64_t _every, const std::vector<uint32_t> &_cores,
+            double _busy_util, double _max_stalls, double _max_temp,
+            uint32_t _max_moves, uint64_t _cooldown, double _budget)
+        : every(_every), cores(_cores), busy_util(_busy_util),
+          max_stalls(_max_stalls), max_temp(_max_temp), max_moves(_max_moves),
+          cooldown(_cooldown), budget(_budget)
+    {
+    }
+    virtual void apply(uint64_t, double, double, const tasklist_t &) override;
+};
+
 } // namespace policy
 } // namespace cat
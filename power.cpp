@@ -0,0 +1,188 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "log.hpp"
+#include "power.hpp"
+#include "throw-with-trace.hpp"
+
+namespace fs = boost::filesystem;
+using fmt::literals::operator""_format;
+
+PowerCtl::PowerCtl(const std::string &_powercap_dir,
+                   const std::string &_cpu_dir)
+    : powercap_dir(_powercap_dir), cpu_dir(_cpu_dir)
+{
+    discover();
+}
+
+// Top level RAPL zones are called package-N
+void PowerCtl::discover()
+{
+    if (!fs::is_directory(powercap_dir))
+        return;
+
+    for (const auto &entry : fs::directory_iterator(powercap_dir)) {
+        std::string zone = entry.path().filename().string();
+        if (zone.find("intel-rapl:") != 0 ||
+            zone.find(':', 11) != std::string::npos)
+            continue;
+
+        std::ifstream f((entry.path() / "name").string());
+        std::string name;
+        if (!(f >> name) || name.find("package-") != 0)
+            continue;
+        packages[std::stoul(name.substr(8))] = entry.path().string();
+    }
+    LOGINF("POWER: {} RAPL packages found"_format(packages.size()));
+}
+
+uint64_t PowerCtl::read(const std::string &path) const
+{
+    uint64_t value;
+    auto f = open_ifstream(path);
+    f >> value;
+    return value;
+}
+
+void PowerCtl::write(const std::string &path, uint64_t value)
+{
+    if (!saved.count(path)) {
+        std::ifstream in(path);
+        std::string original;
+        if (!(in >> original))
+            throw_with_trace(
+                std::runtime_error("Could not read '{}'"_format(path)));
+        saved[path] = original;
+    }
+
+    std::ofstream out(path);
+    out << value;
+    out.close();
+    if (!out)
+        throw_with_trace(std::runtime_error(
+            "Could not write {} to '{}'"_format(value, path)));
+    num_writes++;
+}
+
+std::vector<uint32_t> PowerCtl::get_packages() const
+{
+    auto result = std::vector<uint32_t>();
+    for (const auto &p : packages)
+        result.push_back(p.first);
+    return result;
+}
+
+void PowerCtl::set_package_limit(uint32_t pkg, double watts, bool short_term)
+{
+    if (!packages.count(pkg))
+        throw_with_trace(
+            std::runtime_error("Unknown RAPL package {}"_format(pkg)));
+
+    std::string path = "{}/constraint_{}_power_limit_uw"_format(
+        packages.at(pkg), short_term ? 1 : 0);
+    write(path, watts * 1000 * 1000);
+    LOGINF("POWER: package {} {} term limit set to {:.1f} W"_format(
+        pkg, short_term ? "short" : "long", watts));
+}
+
+double PowerCtl::get_package_limit(uint32_t pkg, bool short_term) const
+{
+    if (!packages.count(pkg))
+        throw_with_trace(
+            std::runtime_error("Unknown RAPL package {}"_format(pkg)));
+    return read("{}/constraint_{}_power_limit_uw"_format(
+               packages.at(pkg), short_term ? 1 : 0)) /
+           1e6;
+}
+
+double PowerCtl::get_package_power(uint32_t pkg)
+{
+    if (!packages.count(pkg))
+        throw_with_trace(
+            std::runtime_error("Unknown RAPL package {}"_format(pkg)));
+
+    const std::string &zone = packages.at(pkg);
+    uint64_t uj = read(zone + "/energy_uj");
+    auto now = clock_t::now();
+
+    double watts = 0;
+    auto it = energy.find(pkg);
+    if (it != energy.end()) {
+        // The counter wraps around at max_energy_range_uj
+        uint64_t delta = uj >= it->second.first
+                             ? uj - it->second.first
+                             : read(zone + "/max_energy_range_uj") -
+                                   it->second.first + uj;
+        double secs =
+            std::chrono::duration<double>(now - it->second.second).count();
+        watts = secs > 0 ? delta / 1e6 / secs : 0;
+    }
+    energy[pkg] = {uj, now};
+    return watts;
+}
+
+void PowerCtl::set_max_freq(uint32_t cpu, uint64_t khz)
+{
+    // The kernel rejects caps under the minimum of the governor
+    uint64_t min_khz, max_khz;
+    get_freq_range(cpu, min_khz, max_khz);
+    uint64_t gov_min =
+        read("{}/cpu{}/cpufreq/scaling_min_freq"_format(cpu_dir, cpu));
+    min_khz = std::max(min_khz, gov_min);
+    khz = std::min(std::max(khz, min_khz), max_khz);
+    write("{}/cpu{}/cpufreq/scaling_max_freq"_format(cpu_dir, cpu), khz);
+    LOGDEB("POWER: cpu {} max frequency set to {} kHz"_format(cpu, khz));
+}
+
+uint64_t PowerCtl::get_max_freq(uint32_t cpu) const
+{
+    return read("{}/cpu{}/cpufreq/scaling_max_freq"_format(cpu_dir, cpu));
+}
+
+void PowerCtl::get_freq_range(uint32_t cpu, uint64_t &min_khz,
+                              uint64_t &max_khz) const
+{
+    min_khz = read("{}/cpu{}/cpufreq/cpuinfo_min_freq"_format(cpu_dir, cpu));
+    max_khz = read("{}/cpu{}/cpufreq/cpuinfo_max_freq"_format(cpu_dir, cpu));
+}
+
+// Best effort, the rest of the files are restored if one fails
+void PowerCtl::restore()
+{
+    for (const auto &s : saved) {
+        std::ofstream out(s.first);
+        out << s.second;
+        out.close();
+        if (!out)
+            LOGERR("POWER: could not restore '{}' to {}"_format(s.first,
+                                                               s.second));
+    }
+    if (!saved.empty())
+        LOGINF("POWER: {} power settings restored"_format(saved.size()));
+    saved.clear();
+}
+
+uint64_t PowerCtl::get_num_writes() const
+{
+    return num_writes;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Power actuators: RAPL power limits of the packages (powercap) and frequency
+// caps of the cores (cpufreq scaling_max_freq). Every file is saved before it
+// is first written, and restore() writes the original values back, so the
+// manager has to call it when it exits or dies.
+class PowerCtl
+{
+    typedef std::chrono::steady_clock clock_t;
+
+    std::string powercap_dir;
+    std::string cpu_dir;
+
+    std::map<uint32_t, std::string> packages; // Package -> powercap zone
+    std::map<std::string, std::string> saved; // File -> original value
+    uint64_t num_writes = 0;
+
+    // Last energy read of each package
+    std::map<uint32_t, std::pair<uint64_t, clock_t::time_point>> energy;
+
+    void discover();
+    uint64_t read(const std::string &path) const;
+    void write(const std::string &path, uint64_t value);
+
+  public:
+    PowerCtl(const std::string &_powercap_dir = "/sys/class/powercap",
+             const std::string &_cpu_dir = "/sys/devices/system/cpu");
+
+    std::vector<uint32_t> get_packages() const;
+
+    // RAPL limit of a package in W, long term (constraint 0) or short term
+    // (constraint 1)
+    void set_package_limit(uint32_t pkg, double watts, bool short_term = false);
+    double get_package_limit(uint32_t pkg, bool short_term = false) const;
+    // Average power of a package in W since the previous call (0 the first)
+    double get_package_power(uint32_t pkg);
+
+    // Frequency cap of a core in kHz, clamped to the range of the core
+    void set_max_freq(uint32_t cpu, uint64_t khz);
+    uint64_t get_max_freq(uint32_t cpu) const;
+    void get_freq_range(uint32_t cpu, uint64_t &min_khz,
+                        uint64_t &max_khz) const;
+
+    // Writes back the original value of every file written
+    void restore();
+    uint64_t get_num_writes() const;
+};
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "policy.hpp"
+#include "settle.hpp"
+
+using fmt::literals::operator""_format;
+
+static const char *kind_metric[] = {"LLC_occup[MB]", "MBT[MBps]"};
+static const char *kind_unit[] = {"MB", "MBps"};
+// Spread under which a metric is settled whatever its value (noise)
+static const double kind_floor[] = {0.5, 100};
+
+double SettleMonitor::value(kind_t kind, uint32_t clos,
+                            const Task::tasklist_t &tasklist) const
+{
+    double total = 0;
+    if (!clos_of || !cat)
+        return total;
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        if (clos_of(task) != clos)
+            continue;
+        // The pids of a group report the values of the whole group
+        total += cat::policy::task_rdt(task, *cat, kind_metric[kind]);
+    }
+    return total;
+}
+
+void SettleMonitor::finish(kind_t kind, uint32_t clos, const watch_t &w,
+                           bool settled)
+{
+    result_t r;
+    r.kind = kind;
+    r.clos = clos;
+    r.requested = w.requested;
+    r.before = w.before;
+    r.settled = settled;
+    r.time = w.time;
+    r.achieved = w.window.empty() ? w.before : w.window.back().second;
+    if (settled) {
+        r.time = w.window.front().first;
+        r.achieved = 0;
+        for (const auto &s : w.window)
+            r.achieved += s.second;
+        r.achieved /= w.window.size();
+    }
+    r.effective = r.achieved <= r.requested * (1 + tolerance);
+
+    summary_t &sum = summary[kind];
+    sum.changes++;
+    if (settled) {
+        sum.settled++;
+        sum.time += r.time;
+        sum.max_time = std::max(sum.max_time, r.time);
+        if (kind == mb_k) {
+            mba_effective[clos] = r.effective;
+            if (!r.effective) {
+                sum.ineffective++;
+                LOGWAR("SETTLE: MBA limit of CLOS {} ineffective, {:.0f} "
+                       "MBps requested and {:.0f} MBps achieved"_format(
+                           clos, r.requested, r.achieved));
+            }
+        }
+    }
+
+    LOGDEB("SETTLE: {} of CLOS {} {} in {:.2f} s, {:.1f} {} requested, "
+           "{:.1f} before and {:.1f} achieved"_format(
+               kind == cbm_k ? "mask" : "MBA limit", clos,
+               settled ? "settled" : "not settled", r.time, r.requested,
+               kind_unit[kind], r.before, r.achieved));
+
+    results.push_back(r);
+    if (results.size() > max_results)
+        results.pop_front();
+}
+
+void SettleMonitor::watch(kind_t kind, uint32_t clos, double requested,
+                          const Task::tasklist_t &tasklist)
+{
+    auto key = std::make_pair(kind, clos);
+    auto it = watches.find(key);
+    if (it != watches.end()) {
+        finish(kind, clos, it->second, false);
+        watches.erase(it);
+    }
+
+    watch_t w;
+    w.requested = requested;
+    w.before = value(kind, clos, tasklist);
+    watches[key] = w;
+}
+
+void SettleMonitor::update(double interval_time,
+                           const Task::tasklist_t &tasklist)
+{
+    for (auto it = watches.begin(); it != watches.end();) {
+        kind_t kind = it->first.first;
+        uint32_t clos = it->first.second;
+        watch_t &w = it->second;
+
+        w.time += interval_time;
+        w.window.emplace_back(w.time, value(kind, clos, tasklist));
+        if (w.window.size() > stable)
+            w.window.pop_front();
+
+        bool settled = false;
+        if (w.window.size() == stable) {
+            double min = w.window.front().second;
+            double max = min;
+            double mean = 0;
+            for (const auto &s : w.window) {
+                min = std::min(min, s.second);
+                max = std::max(max, s.second);
+                mean += s.second;
+            }
+            mean /= w.window.size();
+            settled = max - min <= std::max(tolerance * std::fabs(mean),
+                                            kind_floor[kind]);
+        }
+
+        if (settled || w.time >= timeout) {
+            finish(kind, clos, w, settled);
+            it = watches.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+double SettleMonitor::settling_time(kind_t kind) const
+{
+    const summary_t &sum = summary[kind];
+    return sum.settled ? sum.time / sum.settled : 0;
+}
+
+bool SettleMonitor::mba_ineffective(uint32_t clos) const
+{
+    auto it = mba_effective.find(clos);
+    return it != mba_effective.end() && !it->second;
+}
+
+const std::deque<SettleMonitor::result_t> &SettleMonitor::get_results() const
+{
+    return results;
+}
+
+void SettleMonitor::print_stats() const
+{
+    for (int k = 0; k < num_kinds; k++) {
+        const summary_t &sum = summary[k];
+        if (sum.changes == 0)
+            continue;
+        LOGINF("SETTLE: {}: {} changes, {} settled in {:.2f} s on average "
+               "(max {:.2f} s), {} ineffective"_format(
+                   k == cbm_k ? "masks" : "MBA limits", sum.changes,
+                   sum.settled, settling_time((kind_t)k), sum.max_time,
+                   sum.ineffective));
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "task.hpp"
+
+// Measures how long the CAT and MBA changes take to take effect. After the
+// mask or the MBA limit of a CLOS changes, the LLC occupancy or the memory
+// BW of the tasks in the CLOS is followed every interval until it stays
+// within a tolerance for some intervals in a row, and the settling time and
+// the value achieved (against the one requested) are recorded. A change that
+// does not settle before the timeout, or that is replaced by a newer one, is
+// recorded as unsettled. An MBA limit is ineffective if the BW settles over
+// it by more than the tolerance.
+class SettleMonitor
+{
+  public:
+    enum kind_t { cbm_k, mb_k, num_kinds };
+
+    struct result_t {
+        kind_t kind;
+        uint32_t clos;
+        double requested; // MB of LLC or MBps
+        double before;    // Value in the interval before the change
+        double achieved;  // Mean once settled, last value otherwise
+        double time;      // Seconds to settle, or followed
+        bool settled;
+        bool effective;
+    };
+
+  protected:
+    struct watch_t {
+        double requested;
+        double before;
+        double time = 0;
+        std::deque<std::pair<double, double>> window; // Time, value
+    };
+    struct summary_t {
+        uint64_t changes = 0;
+        uint64_t settled = 0;
+        uint64_t ineffective = 0;
+        double time = 0; // Seconds, the settled ones
+        double max_time = 0;
+    };
+
+    double tolerance = 0.05; // Relative spread of a settled metric
+    uint64_t stable = 3;     // Intervals within the tolerance
+    double timeout = 30;     // Seconds
+    size_t max_results = 1000;
+
+    std::function<uint32_t(const Task &)> clos_of;
+    std::shared_ptr<IntelRDT> cat;
+    std::map<std::pair<kind_t, uint32_t>, watch_t> watches;
+    std::array<summary_t, num_kinds> summary;
+    std::map<uint32_t, bool> mba_effective; // Last settled MBA change
+    std::deque<result_t> results;
+
+    double value(kind_t kind, uint32_t clos,
+                 const Task::tasklist_t &tasklist) const;
+    void finish(kind_t kind, uint32_t clos, const watch_t &w, bool settled);
+
+  public:
+    SettleMonitor(double _tolerance, uint64_t _stable, double _timeout)
+        : tolerance(_tolerance), stable(_stable), timeout(_timeout)
+    {
+    }
+
+    // CLOS each task is mapped to, set by the manager
+    void set_clos_of(std::function<uint32_t(const Task &)> _clos_of)
+    {
+        clos_of = _clos_of;
+    }
+
+    // To split the values of the pids sharing a monitoring group
+    void set_cat(std::shared_ptr<IntelRDT> _cat)
+    {
+        cat = _cat;
+    }
+
+    // Follows a change just written, replacing the previous one of the CLOS
+    void watch(kind_t kind, uint32_t clos, double requested,
+               const Task::tasklist_t &tasklist);
+    // Every interval, with the stats of the interval
+    void update(double interval_time, const Task::tasklist_t &tasklist);
+
+    // Mean settling time of the changes of the kind, 0 if none settled yet.
+    // Useful to choose the period of the decisions.
+    double settling_time(kind_t kind) const;
+    // True if the last MBA change of the CLOS settled over its limit
+    bool mba_ineffective(uint32_t clos) const;
+    const std::deque<result_t> &get_results() const;
+
+    void print_stats() const;
+};
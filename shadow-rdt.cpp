@@ -0,0 +1,369 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <fmt/format.h>
+#include <limits>
+
+#include "log.hpp"
+#include "shadow-rdt.hpp"
+#include "throw-with-trace.hpp"
+
+using fmt::literals::operator""_format;
+
+ShadowRDT::ShadowRDT(uint32_t _num_ways, uint32_t _num_closids,
+                     uint64_t _way_size)
+    : num_ways(_num_ways), num_closids(_num_closids), way_size(_way_size)
+{
+}
+
+bool ShadowRDT::is_initialized() const
+{
+    return initialized;
+}
+
+void ShadowRDT::init()
+{
+    initialized = true;
+    reset();
+}
+
+// Same state as the hardware after pqos_alloc_reset: all the CLOS with the
+// complete mask, no throttling and everything in CLOS 0
+void ShadowRDT::reset()
+{
+    if (!initialized)
+        throw_with_trace(std::runtime_error(
+            "Could not reset: init method must be called first"));
+
+    cbms.clear();
+    mbs.clear();
+    mb_ctrl.clear();
+    cpu_clos.clear();
+    pid_clos.clear();
+}
+
+void ShadowRDT::fini()
+{
+    initialized = false;
+}
+
+void ShadowRDT::set_cbm(uint32_t clos, uint32_t socket, uint64_t cbm,
+                        uint32_t cdp, std::string type)
+{
+    set_l3_clos(clos, cbm, socket, cdp, CAT_UPDATE_SCOPE_BOTH);
+}
+
+void ShadowRDT::add_cpu(uint32_t clos, uint32_t cpu)
+{
+    if (clos >= num_closids)
+        throw_with_trace(std::runtime_error("Invalid CLOS {}"_format(clos)));
+    cpu_clos[cpu] = clos;
+    num_writes++;
+    if (journaling)
+        journal.push_back({op_kind::cpu, clos, cpu, 0});
+}
+
+void ShadowRDT::set_config(const enum pqos_cdp_config l3_cdp_cfg,
+                           const enum pqos_mba_config mba_cfg)
+{
+}
+
+uint32_t ShadowRDT::get_clos(uint32_t cpu) const
+{
+    auto it = cpu_clos.find(cpu);
+    return it == cpu_clos.end() ? 0 : it->second;
+}
+
+uint64_t ShadowRDT::get_cbm(uint32_t clos, uint32_t socket,
+                            std::string type) const
+{
+    auto it = cbms.find(clos);
+    return it == cbms.end() ? ~(-1ULL << num_ways) : it->second;
+}
+
+uint32_t ShadowRDT::get_max_closids() const
+{
+    return num_closids;
+}
+
+uint64_t ShadowRDT::get_l3_way_size() const
+{
+    return way_size;
+}
+
+int ShadowRDT::set_l3_clos(const unsigned clos, const uint64_t mask,
+                           const unsigned socket, int cdp,
+                           const unsigned scope)
+{
+    // Same restrictions as the hardware: non-empty and contiguous
+    if (clos >= num_closids || mask == 0 || (mask >> num_ways) ||
+        ((mask >> __builtin_ctzll(mask)) & ((mask >> __builtin_ctzll(mask)) +
+                                            1)))
+        throw_with_trace(std::runtime_error(
+            "Invalid mask 0x{:x} for CLOS {}"_format(mask, clos)));
+
+    cbms[clos] = mask;
+    num_writes++;
+    if (journaling)
+        journal.push_back({op_kind::mask, clos, mask, 0});
+    LOGDEB("SHADOW: CLOS {} => 0x{:x}"_format(clos, mask));
+    return 0;
+}
+
+void ShadowRDT::add_task(uint32_t clos, pid_t pid)
+{
+    if (clos >= num_closids)
+        throw_with_trace(std::runtime_error("Invalid CLOS {}"_format(clos)));
+    pid_clos[pid] = clos;
+    num_writes++;
+    if (journaling)
+        journal.push_back({op_kind::pid, clos, (uint64_t)pid, 0});
+}
+
+uint32_t ShadowRDT::get_clos_of_task(pid_t pid) const
+{
+    auto it = pid_clos.find(pid);
+    return it == pid_clos.end() ? 0 : it->second;
+}
+
+bool ShadowRDT::is_l2_supported() const
+{
+    return false;
+}
+
+int ShadowRDT::set_l2_clos(const unsigned clos, const uint64_t mask,
+                           const unsigned l2id, int cdp, const unsigned scope)
+{
+    throw_with_trace(std::runtime_error("L2 CAT is not simulated"));
+}
+
+uint64_t ShadowRDT::get_l2_cbm(uint32_t clos, uint32_t l2id,
+                               std::string type) const
+{
+    return 0;
+}
+
+uint32_t ShadowRDT::get_l2_max_closids() const
+{
+    return 0;
+}
+
+uint32_t ShadowRDT::get_l2id(uint32_t cpu) const
+{
+    return 0;
+}
+
+std::vector<unsigned> ShadowRDT::get_l2ids() const
+{
+    return {};
+}
+
+int ShadowRDT::set_mba_clos(const unsigned clos, const uint64_t mb,
+                            const unsigned socket, int ctrl)
+{
+    set_mb(clos, socket, ctrl, mb);
+    return 0;
+}
+
+// In % mode the hardware only has steps of 10%
+unsigned ShadowRDT::set_mb(uint32_t clos, uint32_t socket, int ctrl,
+                           unsigned mb)
+{
+    if (clos >= num_closids)
+        throw_with_trace(std::runtime_error("Invalid CLOS {}"_format(clos)));
+
+    unsigned actual = ctrl ? mb : std::min(std::max(mb / 10 * 10, 10U), 100U);
+    mbs[clos] = actual;
+    mb_ctrl[clos] = ctrl;
+    num_writes++;
+    if (journaling)
+        journal.push_back({op_kind::mb, clos, mb, ctrl});
+    LOGDEB("SHADOW: MBA CLOS {} => {} {}"_format(clos, actual,
+                                                 ctrl ? "MBps" : "%"));
+    return actual;
+}
+
+uint64_t ShadowRDT::get_mb(uint32_t clos, uint32_t socket)
+{
+    auto it = mbs.find(clos);
+    return it == mbs.end() ? 100 : it->second;
+}
+
+bool ShadowRDT::get_mb_limit(uint32_t clos, uint64_t &mb, int &ctrl) const
+{
+    auto it = mbs.find(clos);
+    if (it == mbs.end())
+        return false;
+
+    mb = it->second;
+    ctrl = mb_ctrl.at(clos);
+    if (ctrl)
+        return mb != std::numeric_limits<uint32_t>::max();
+    return mb < 100;
+}
+
+int ShadowRDT::monitor_setup_pid(pid_t pid)
+{
+    return 0;
+}
+
+int ShadowRDT::monitor_setup_pids(const std::vector<pid_t> &pids)
+{
+    return 0;
+}
+
+int ShadowRDT::monitor_setup_clos(uint32_t clos, const std::vector<pid_t> &pids)
+{
+    return 0;
+}
+
+void ShadowRDT::monitor_get_values_pid(pid_t pid, double *llc_occup,
+                                       double *lmem_bw, double *tmem_bw,
+                                       double *rmem_bw)
+{
+    *llc_occup = *lmem_bw = *tmem_bw = *rmem_bw = 0;
+}
+
+int ShadowRDT::monitor_setup_task_pid(pid_t pid,
+                                      const std::vector<pid_t> &task_pids,
+                                      uint32_t clos)
+{
+    return 0;
+}
+
+int ShadowRDT::monitor_stop_pid(pid_t pid)
+{
+    return 0;
+}
+
+unsigned ShadowRDT::monitor_group_size_pid(pid_t pid) const
+{
+    auto it = group_sizes.find(pid);
+    return it != group_sizes.end() ? it->second : 1;
+}
+
+int ShadowRDT::monitor_setup_core(uint32_t core)
+{
+    return 0;
+}
+
+void ShadowRDT::monitor_get_values_core(uint32_t core, double *llc_occup,
+                                        double *lmem_bw, double *tmem_bw,
+                                        double *rmem_bw)
+{
+    *llc_occup = *lmem_bw = *tmem_bw = *rmem_bw = 0;
+}
+
+int ShadowRDT::monitor_stop_core(uint32_t core)
+{
+    return 0;
+}
+
+void ShadowRDT::monitor_poll()
+{
+}
+
+unsigned ShadowRDT::monitor_num_groups() const
+{
+    return 0;
+}
+
+unsigned ShadowRDT::monitor_max_groups() const
+{
+    return std::numeric_limits<unsigned>::max();
+}
+
+void ShadowRDT::print()
+{
+    for (uint32_t clos = 0; clos < num_closids; clos++) {
+        uint64_t mb = 0;
+        int ctrl = 0;
+        bool limited = get_mb_limit(clos, mb, ctrl);
+        LOGINF("SHADOW: CLOS {}: mask 0x{:x}, MBA {}"_format(
+            clos, get_cbm(clos, 0),
+            limited ? "{} {}"_format(mb, ctrl ? "MBps" : "%")
+                    : std::string("unlimited")));
+    }
+}
+
+void ShadowRDT::sync(IntelRDT &other, const Task::tasklist_t &tasklist,
+                     bool by_pid, bool classes)
+{
+    for (uint32_t clos = 0; classes && clos < num_closids; clos++) {
+        cbms[clos] = other.get_cbm(clos, 0);
+
+        // The MBA mode is not reported back, values over 100 can only be
+        // MBps
+        uint64_t mb = other.get_mb(clos, 0);
+        mbs[clos] = mb;
+        mb_ctrl[clos] = mb > 100;
+    }
+
+    group_sizes.clear();
+    for (const auto &task_ptr : tasklist) {
+        const Task &task = *task_ptr;
+        for (uint32_t i = 0; i < task.cpus.size(); i++) {
+            if (task.pids[i] > 0)
+                group_sizes[task.pids[i]] =
+                    other.monitor_group_size_pid(task.pids[i]);
+            if (by_pid && task.pids[i] > 0)
+                pid_clos[task.pids[i]] =
+                    other.get_clos_of_task(task.pids[i]);
+            else if (!by_pid)
+                cpu_clos[task.cpus[i]] = other.get_clos(task.cpus[i]);
+        }
+    }
+}
+
+void ShadowRDT::set_monitor_group_size(pid_t pid, unsigned size)
+{
+    group_sizes[pid] = size;
+}
+
+void ShadowRDT::set_journaling(bool enable)
+{
+    journaling = enable;
+    journal.clear();
+}
+
+size_t ShadowRDT::replay(IntelRDT &other)
+{
+    for (const auto &op : journal) {
+        switch (op.kind) {
+        case op_kind::mask:
+            other.set_cbm(op.clos, 0, op.value, 0);
+            break;
+        case op_kind::mb:
+            other.set_mb(op.clos, 0, op.ctrl, op.value);
+            break;
+        case op_kind::cpu:
+            other.add_cpu(op.clos, op.value);
+            break;
+        case op_kind::pid:
+            other.add_task(op.clos, (pid_t)op.value);
+            break;
+        }
+    }
+
+    size_t n = journal.size();
+    journal.clear();
+    return n;
+}
+
+uint64_t ShadowRDT::get_num_writes() const
+{
+    return num_writes;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "intel-rdt.hpp"
+#include "task.hpp"
+
+// In-memory IntelRDT. Keeps the CLOS masks, MBA values and associations that
+// the policies set without touching the hardware, so that they can be run
+// against recorded traces or evaluated without side effects.
+class ShadowRDT : public IntelRDT
+{
+    uint32_t num_ways;
+    uint32_t num_closids;
+    uint64_t way_size; // Bytes
+
+    bool initialized = false;
+    std::map<uint32_t, uint64_t> cbms; // CLOS -> L3 mask
+    std::map<uint32_t, uint64_t> mbs;  // CLOS -> MBA value
+    std::map<uint32_t, int> mb_ctrl;   // CLOS -> MBA in MBps (1) or % (0)
+    std::map<uint32_t, uint32_t> cpu_clos;
+    std::map<pid_t, uint32_t> pid_clos;
+    std::map<pid_t, unsigned> group_sizes; // Monitoring groups, copied
+    uint64_t num_writes = 0;
+
+    // Writes recorded to be replayed on the hardware
+    enum class op_kind { mask, mb, cpu, pid };
+    struct op_t {
+        op_kind kind;
+        uint32_t clos;
+        uint64_t value; // Mask, MBA value, cpu or pid
+        int ctrl;
+    };
+    bool journaling = false;
+    std::vector<op_t> journal;
+
+  public:
+    ShadowRDT(uint32_t _num_ways, uint32_t _num_closids, uint64_t _way_size);
+    virtual ~ShadowRDT() = default;
+
+    virtual bool is_initialized() const override;
+    virtual void init() override;
+    virtual void reset() override;
+    virtual void fini() override;
+
+    virtual void set_cbm(uint32_t clos, uint32_t socket, uint64_t cbm,
+                         uint32_t cdp, std::string type = "code") override;
+    virtual void add_cpu(uint32_t clos, uint32_t cpu) override;
+    virtual void set_config(const enum pqos_cdp_config l3_cdp_cfg,
+                            const enum pqos_mba_config mba_cfg) override;
+
+    virtual uint32_t get_clos(uint32_t cpu) const override;
+    virtual uint64_t get_cbm(uint32_t clos, uint32_t socket,
+                             std::string type = "code") const override;
+    virtual uint32_t get_max_closids() const override;
+    virtual uint64_t get_l3_way_size() const override;
+
+    virtual int set_l3_clos(const unsigned clos, const uint64_t mask,
+                            const unsigned socket, int cdp,
+                            const unsigned scope) override;
+    virtual void add_task(uint32_t clos, pid_t pid) override;
+    virtual uint32_t get_clos_of_task(pid_t pid) const override;
+
+    // There is no L2 CAT in the shadow
+    virtual bool is_l2_supported() const override;
+    virtual int set_l2_clos(const unsigned clos, const uint64_t mask,
+                            const unsigned l2id, int cdp,
+                            const unsigned scope) override;
+    virtual uint64_t get_l2_cbm(uint32_t clos, uint32_t l2id,
+                                std::string type = "code") const override;
+    virtual uint32_t get_l2_max_closids() const override;
+    virtual uint32_t get_l2id(uint32_t cpu) const override;
+    virtual std::vector<unsigned> get_l2ids() const override;
+
+    virtual int set_mba_clos(const unsigned clos, const uint64_t mb,
+                             const unsigned socket, int ctrl) override;
+    virtual unsigned set_mb(uint32_t clos, uint32_t socket, int ctrl,
+                            unsigned mb) override;
+    virtual uint64_t get_mb(uint32_t clos, uint32_t socket) override;
+
+    // Monitoring is not simulated, every pid is its own group unless the
+    // sizes of the groups were copied by sync()
+    virtual int monitor_setup_pid(pid_t pid) override;
+    virtual int monitor_setup_pids(const std::vector<pid_t> &pids) override;
+    virtual int monitor_setup_clos(uint32_t clos,
+                                   const std::vector<pid_t> &pids) override;
+    virtual void monitor_get_values_pid(pid_t pid, double *llc_occup,
+                                        double *lmem_bw, double *tmem_bw,
+                                        double *rmem_bw) override;
+    virtual int monitor_setup_task_pid(pid_t pid,
+                                       const std::vector<pid_t> &task_pids,
+                                       uint32_t clos) override;
+    virtual int monitor_stop_pid(pid_t pid) override;
+    virtual unsigned monitor_group_size_pid(pid_t pid) const override;
+    virtual int monitor_setup_core(uint32_t core) override;
+    virtual void monitor_get_values_core(uint32_t core, double *llc_occup,
+                                         double *lmem_bw, double *tmem_bw,
+                                         double *rmem_bw) override;
+    virtual int monitor_stop_core(uint32_t core) override;
+    virtual void monitor_poll() override;
+    virtual unsigned monitor_num_groups() const override;
+    virtual unsigned monitor_max_groups() const override;
+
+    virtual void print() override;
+
+    // Copies the associations of the tasks and the sizes of their monitoring
+    // groups from another IntelRDT, usually the hardware one, and also the
+    // masks and MBA values if 'classes' is set
+    void sync(IntelRDT &other, const Task::tasklist_t &tasklist, bool by_pid,
+              bool classes);
+    // Size of the monitoring group of a pid, e.g. as it was when a trace was
+    // recorded
+    void set_monitor_group_size(pid_t pid, unsigned size);
+    // Records writes from now on, and replays them (once) on another IntelRDT
+    void set_journaling(bool enable);
+    size_t replay(IntelRDT &other);
+
+    // MBA of a CLOS, false if it is not throttled
+    bool get_mb_limit(uint32_t clos, uint64_t &mb, int &ctrl) const;
+    // Hardware writes (masks, MBA and associations) done so far
+    uint64_t get_num_writes() const;
+};
@@ -0,0 +1,632 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// What-if simulator. Replays the interval output of a manager run (the trace)
+// through a partitioning policy: the policy classes, the CLOS allocator and
+// the Stats are the real ones, but the hardware is a ShadowRDT and the
+// counters of every interval are those of the trace adjusted to the ways and
+// memory BW the policy has given to each task.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+#include <fmt/format.h>
+#include <yaml-cpp/yaml.h>
+
+#include "config.hpp"
+#include "log.hpp"
+#include "policy.hpp"
+#include "shadow-rdt.hpp"
+#include "throw-with-trace.hpp"
+
+namespace chr = std::chrono;
+namespace po = boost::program_options;
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+// Derived metrics are recomputed by Stats, they are not counters
+static const vector<string> derived_metrics = {
+    "iostat", "Disk_BW[MBps]", "ipc", "ref-ipc", "mpki-l2", "mpki-l3"};
+
+static const vector<string> inst_events = {"inst_retired.any",
+                                           "instructions"};
+static const vector<string> cycles_events = {
+    "cycles", "cpu_clk_unhalted.ref_tsc", "ref-cycles"};
+static const vector<string> miss_events = {
+    "mem_load_retired.l3_miss", "LLC-load-misses", "longest_lat_cache.miss"};
+
+// Trace read from the interval output of the manager
+struct Trace {
+    vector<string> names; // Counters, in the order of the columns
+
+    struct row_t {
+        uint32_t cpu;
+        vector<double> values;
+    };
+    // Interval -> task label ("<id>_<name>") -> one row per cpu
+    std::map<uint64_t, std::map<string, vector<row_t>>> intervals;
+
+    int index(const vector<string> &candidates) const
+    {
+        for (const auto &c : candidates) {
+            auto it = std::find(names.begin(), names.end(), c);
+            if (it != names.end())
+                return it - names.begin();
+        }
+        return -1;
+    }
+};
+
+static Trace trace_read(const string &path)
+{
+    std::ifstream in(path);
+    if (!in.good())
+        throw_with_trace(
+            std::runtime_error("Could not open the trace '{}'"_format(path)));
+
+    Trace trace;
+    string line;
+    std::getline(in, line);
+    vector<string> header;
+    boost::split(header, line, boost::is_any_of(","));
+
+    // Counters come after the per-cpu columns of VMTask and AppTask
+    auto first = std::find(header.begin(), header.end(), "L2_mask");
+    if (header.size() < 3 || header[0] != "interval" || header[1] != "app" ||
+        first == header.end())
+        throw_with_trace(std::runtime_error(
+            "The trace '{}' is not an interval output of the manager"_format(
+                path)));
+    size_t start = first - header.begin() + 1;
+    if (start < header.size() && header[start] == "compl")
+        start++;
+
+    vector<size_t> columns;
+    for (size_t i = start; i < header.size(); i++) {
+        if (header[i].empty() ||
+            std::find(derived_metrics.begin(), derived_metrics.end(),
+                      header[i]) != derived_metrics.end())
+            continue;
+        trace.names.push_back(header[i]);
+        columns.push_back(i);
+    }
+
+    while (std::getline(in, line)) {
+        vector<string> fields;
+        boost::split(fields, line, boost::is_any_of(","));
+        if (fields.size() < header.size())
+            continue;
+
+        Trace::row_t row;
+        row.cpu = std::stoul(fields[2]);
+        for (const auto &c : columns) {
+            double v = std::strtod(fields[c].c_str(), nullptr);
+            row.values.push_back(std::isfinite(v) ? v : 0);
+        }
+        trace.intervals[std::stoull(fields[0])][fields[1]].push_back(row);
+    }
+
+    if (trace.intervals.empty())
+        throw_with_trace(
+            std::runtime_error("The trace '{}' is empty"_format(path)));
+    if (trace.index(inst_events) < 0 || trace.index(cycles_events) < 0 ||
+        trace.index(miss_events) < 0)
+        throw_with_trace(std::runtime_error(
+            "The trace needs instructions, cycles and LLC misses"));
+
+    LOGINF("Trace '{}': {} intervals, {} counters"_format(
+        path, trace.intervals.size(), trace.names.size()));
+    return trace;
+}
+
+// Task whose counters come from the trace. Only stats and identity are used,
+// the management methods do nothing.
+class SimTask : public Task
+{
+  public:
+    const string label; // Name of the task in the trace
+
+    // Instructions of the trace and of the simulation
+    double inst_rec = 0, inst_sim = 0, cycles = 0;
+    bool primed = false;
+    uint64_t l3_mask = 0;
+
+    SimTask(const string &_label, const string &_name,
+            const vector<uint32_t> &_cpus, bool _batch)
+        : Task(_name, _cpus, 0, "", "", "", 0, _batch, false), label(_label)
+    {
+        for (uint32_t i = 0; i < cpus.size(); i++)
+            pids[i] = 1000000 + id * 32 + i;
+    }
+
+    virtual void reset() override {}
+    virtual void task_pause() override {}
+    virtual void task_resume() override {}
+    virtual void task_kill() override {}
+    virtual void task_get_ready_to_execute(bool) override {}
+    virtual void task_start_to_execute() override {}
+    virtual void task_restart() override {}
+    virtual bool task_exited(bool) const override
+    {
+        return false;
+    }
+    virtual int get_cpu_id(pid_t pid) override
+    {
+        return cpus[pid - pids[0]];
+    }
+    virtual void task_restart_or_set_done(std::shared_ptr<IntelRDT>, Perf &,
+                                          const vector<string> &,
+                                          uint32_t) override
+    {
+    }
+
+    // Same columns as the manager output (L2 is not simulated), so that the
+    // output can be used as a trace again
+    virtual void task_stats_print_headers(std::ostream &out_stream,
+                                          const string &sep = ",") override
+    {
+        out_stream << "interval" << sep << "app" << sep << "CPU" << sep
+                   << "L3_mask" << sep << "L2_mask" << sep;
+        out_stream << stats[0].header_to_string(sep) << std::endl;
+    }
+    virtual void task_stats_print_times_headers(std::ostream &,
+                                                const string & = ",") override
+    {
+    }
+    virtual void task_stats_print_interval(uint64_t interval,
+                                           std::ostream &out_stream, bool,
+                                           const string &sep = ",") override
+    {
+        for (uint32_t i = 0; i < cpus.size(); i++)
+            out_stream << interval << sep << label << sep << cpus[i] << sep
+                       << "0x{:x}"_format(l3_mask) << sep << "0x0" << sep
+                       << stats[i].data_to_string_int(sep) << std::endl;
+    }
+    virtual void task_stats_print_total(uint64_t, std::ostream &,
+                                        const string & = ",") override
+    {
+    }
+    virtual void task_stats_print_times_interval(uint64_t, std::ostream &,
+                                                 bool,
+                                                 const string & = ",") override
+    {
+    }
+};
+
+// How the counters of a task respond to the allocation. MPKI follows the
+// measured miss-rate curve of the task if there is one, or a power law
+// otherwise. Cycles are split into a core part and a memory part (misses
+// times a fixed penalty); only the memory part changes with the misses, and
+// it stretches when the memory BW demanded goes over the MBA limit or the
+// BW of the system.
+struct Model {
+    double alpha = 0.5;
+    double miss_penalty = 150; // Cycles per LLC miss
+    double mem_bw = 20000;     // MBps of the system
+    double way_size = 1.375;   // MB
+    std::map<string, std::map<double, double>> mrcs; // Name -> ways -> MPKI
+
+    double mpki_ratio(const string &name, double w0, double w) const
+    {
+        w0 = std::max(w0, 0.5);
+        w = std::max(w, 0.5);
+
+        auto it = mrcs.find(name);
+        if (it == mrcs.end() || it->second.size() < 2)
+            return std::pow(w0 / w, alpha);
+
+        // Linear interpolation, flat beyond the ends
+        auto at = [&curve = it->second](double x) {
+            auto hi = curve.lower_bound(x);
+            if (hi == curve.begin())
+                return hi->second;
+            if (hi == curve.end())
+                return std::prev(hi)->second;
+            auto lo = std::prev(hi);
+            return lo->second + (hi->second - lo->second) *
+                                    (x - lo->first) / (hi->first - lo->first);
+        };
+        double m0 = at(w0);
+        return m0 > 0 ? at(w) / m0 : 1;
+    }
+};
+
+static std::map<string, std::map<double, double>> mrc_read(const string &path)
+{
+    std::ifstream in(path);
+    if (!in.good())
+        throw_with_trace(
+            std::runtime_error("Could not open the MRC file '{}'"_format(path)));
+
+    auto mrcs = std::map<string, std::map<double, double>>();
+    string line;
+    while (std::getline(in, line)) {
+        vector<string> f;
+        boost::split(f, line, boost::is_any_of(","));
+        if (f.size() < 3 || f[1].empty() || !std::isdigit(f[1][0]))
+            continue; // Header
+        mrcs[f[0]][std::stod(f[1])] = std::stod(f[2]);
+    }
+    return mrcs;
+}
+
+// Ways of the task, counting shared ways in proportion to the tasks that can
+// use them
+static double effective_ways(const SimTask &task,
+                             const std::map<uint32_t, uint64_t> &masks)
+{
+    uint64_t mask = masks.at(task.id);
+    double ways = 0;
+    for (uint32_t w = 0; w < 64; w++) {
+        if (!(mask & (1ULL << w)))
+            continue;
+        uint32_t sharers = 0;
+        for (const auto &m : masks)
+            sharers += (m.second >> w) & 1;
+        ways += 1.0 / sharers;
+    }
+    return ways;
+}
+
+int main(int argc, char *argv[])
+{
+    po::options_description desc("Allowed options");
+    desc.add_options()("help,h", "print usage message")(
+        "config,c", po::value<string>()->required(),
+        "pathname for yaml config file, with the policy and a 'sim' section")(
+        "trace,t", po::value<string>()->required(),
+        "interval output of a manager run")(
+        "output,o", po::value<string>()->default_value(""),
+        "pathname for the simulated interval output")(
+        "repeat", po::value<uint32_t>()->default_value(1),
+        "times the trace is replayed")(
+        "clog-min", po::value<string>()->default_value("war"),
+        "Minimum severity level to log into the console")(
+        "flog-min", po::value<string>()->default_value("inf"),
+        "Minimum severity level to log into the log file")(
+        "log-file", po::value<string>()->default_value("simulator.log"),
+        "file used for the general application log");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            std::cout << desc << std::endl;
+            exit(EXIT_SUCCESS);
+        }
+        po::notify(vm);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl << desc << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    general_log::init(vm["log-file"].as<string>(),
+                      general_log::severity_level(vm["clog-min"].as<string>()),
+                      general_log::severity_level(vm["flog-min"].as<string>()));
+
+    try {
+        // Same config as the manager, but the tasks come from the trace
+        const string config_file = vm["config"].as<string>();
+        YAML::Node config = YAML::LoadFile(config_file);
+        if (config["tasks"])
+            throw_with_trace(std::runtime_error(
+                "The tasks of the simulation come from the trace, remove the "
+                "'tasks' section"));
+        YAML::Node sim = config["sim"];
+
+        CmdOptions options;
+        auto tasklist = tasklist_t();
+        auto coslist = vector<Cos>();
+        auto catpol = std::make_shared<cat::policy::Base>();
+        config_read(config_file, "", options, tasklist, coslist, catpol);
+
+        Model model;
+        if (sim) {
+            if (sim["alpha"])
+                model.alpha = sim["alpha"].as<double>();
+            if (sim["miss_penalty"])
+                model.miss_penalty = sim["miss_penalty"].as<double>();
+            if (sim["mem_bw"])
+                model.mem_bw = sim["mem_bw"].as<double>();
+            if (sim["way_size"])
+                model.way_size = sim["way_size"].as<double>();
+            if (sim["mrc"])
+                model.mrcs = mrc_read(sim["mrc"].as<string>());
+        }
+        uint32_t num_closids = sim && sim["clos"] ? sim["clos"].as<uint32_t>()
+                                                  : 16;
+        auto batch = sim && sim["batch"] ? sim["batch"].as<vector<string>>()
+                                         : vector<string>();
+        auto recorded_ways = sim && sim["recorded_ways"]
+                                 ? sim["recorded_ways"]
+                                       .as<std::map<string, double>>()
+                                 : std::map<string, double>();
+
+        const Trace trace = trace_read(vm["trace"].as<string>());
+        const int i_inst = trace.index(inst_events);
+        const int i_cycles = trace.index(cycles_events);
+        const int i_miss = trace.index(miss_events);
+        const int i_occup = trace.index({"LLC_occup[MB]"});
+        const int i_mbl = trace.index({"MBL[MBps]"});
+        const int i_mbt = trace.index({"MBT[MBps]"});
+
+        // Tasks, in the order of their ids in the trace
+        auto tasks = std::map<string, std::shared_ptr<SimTask>>();
+        for (const auto &interval : trace.intervals) {
+            for (const auto &t : interval.second) {
+                if (tasks.count(t.first))
+                    continue;
+                auto cpus = vector<uint32_t>();
+                for (const auto &row : t.second)
+                    cpus.push_back(row.cpu);
+                string name = t.first.substr(t.first.find('_') + 1);
+                bool is_batch = std::find(batch.begin(), batch.end(), name) !=
+                                batch.end();
+                tasks[t.first] =
+                    std::make_shared<SimTask>(t.first, name, cpus, is_batch);
+                for (uint32_t i = 0; i < cpus.size(); i++)
+                    tasks[t.first]->stats[i].init(trace.names, options.ti);
+            }
+        }
+
+        // Shadow hardware, configured like the manager does
+        auto cat = std::make_shared<ShadowRDT>(
+            cat::max_num_ways, num_closids,
+            (uint64_t)(model.way_size * 1024 * 1024));
+        cat->init();
+        for (const auto &cos : coslist) {
+            cat->set_l3_clos(cos.num, cos.mask, 0, 0, CAT_UPDATE_SCOPE_BOTH);
+            if (cos.mbps != -1)
+                cat->set_mba_clos(cos.num, cos.mbps, 0, 1);
+            for (const auto &cpu : cos.cpus)
+                cat->add_cpu(cos.num, cpu);
+        }
+        catpol->set_cat(cat);
+        if (catpol->get_mrc())
+            catpol->get_mrc()->set_cat(cat, options.perf == "PID");
+        catpol->set_clos_alloc(std::make_shared<ClosAllocator>(
+            cat, options.perf == "PID", cat::max_num_ways, 1, 500,
+            catpol->get_mrc() ? 1 : 0));
+
+        // The RDT values of a trace recorded with an RMID per task are those
+        // of the whole task in every row. The CLOS of the recording are not
+        // in the trace, so the groups of the CLOS cannot be split.
+        if (options.rmid == "task") {
+            for (const auto &t : tasks)
+                for (uint32_t i = 0; i < t.second->cpus.size(); i++)
+                    cat->set_monitor_group_size(t.second->pids[i],
+                                                t.second->cpus.size());
+        } else if (options.rmid == "clos") {
+            LOGWAR("SIM: the RDT values of a trace recorded with an RMID per "
+                   "CLOS are taken as the values of each task");
+        }
+
+        std::ofstream out;
+        if (vm["output"].as<string>() != "") {
+            out.open(vm["output"].as<string>());
+            tasks.begin()->second->task_stats_print_headers(out);
+        }
+
+        const auto start = chr::steady_clock::now();
+        uint64_t sim_interval = 0;
+        for (uint32_t rep = 0; rep < vm["repeat"].as<uint32_t>(); rep++) {
+            for (const auto &interval : trace.intervals) {
+                auto runlist = tasklist_t();
+                auto running = vector<std::shared_ptr<SimTask>>();
+                for (const auto &t : interval.second) {
+                    runlist.push_back(tasks[t.first]);
+                    running.push_back(tasks[t.first]);
+                }
+
+                // Allocation of each running task
+                auto masks = std::map<uint32_t, uint64_t>();
+                auto clos = std::map<uint32_t, uint32_t>();
+                for (const auto &task : running) {
+                    clos[task->id] = options.perf == "PID"
+                                         ? cat->get_clos_of_task(task->pids[0])
+                                         : cat->get_clos(task->cpus[0]);
+                    masks[task->id] = cat->get_cbm(clos[task->id], 0);
+                    task->l3_mask = masks[task->id];
+                }
+
+                // Ways and memory BW demanded with the new allocation
+                struct sim_t {
+                    double ratio, base, mem, cpi, demand;
+                };
+                auto sims = std::map<uint32_t, vector<sim_t>>();
+                auto clos_demand = std::map<uint32_t, double>();
+                double total_demand = 0;
+                for (const auto &task : running) {
+                    const auto &rows = interval.second.at(task->label);
+                    double w = effective_ways(*task, masks);
+                    double w0 = recorded_ways.count(task->name)
+                                    ? recorded_ways[task->name]
+                                    : (double)cat::max_num_ways /
+                                          running.size();
+
+                    for (uint32_t i = 0; i < rows.size(); i++) {
+                        const auto &v = rows[i].values;
+                        double inst = v[i_inst], cycles = v[i_cycles];
+                        sim_t s = {1, 0, 0, 0, 0};
+                        if (inst > 0 && cycles > 0) {
+                            // A task that did not fill its ways does not
+                            // miss less with more of them
+                            double occup_ways =
+                                i_occup >= 0 ? v[i_occup] / model.way_size
+                                             : w0;
+                            double sat = occup_ways < 0.9 * w0
+                                             ? occup_ways
+                                             : std::numeric_limits<
+                                                   double>::infinity();
+                            s.ratio = model.mpki_ratio(task->name,
+                                                       std::min(w0, sat),
+                                                       std::min(w, sat));
+                            double cpi0 = cycles / inst;
+                            double mem0 = std::min(v[i_miss] / inst *
+                                                       model.miss_penalty,
+                                                   0.9 * cpi0);
+                            s.base = cpi0 - mem0;
+                            s.mem = mem0 * s.ratio;
+                            s.cpi = s.base + s.mem;
+                            // Once per monitoring group
+                            unsigned members = std::max(
+                                cat->monitor_group_size_pid(task->pids[i]),
+                                1U);
+                            s.demand = i_mbt >= 0 ? v[i_mbt] * s.ratio *
+                                                        cpi0 / s.cpi /
+                                                        members
+                                                  : 0;
+                        }
+                        clos_demand[clos[task->id]] += s.demand;
+                        total_demand += s.demand;
+                        sims[task->id].push_back(s);
+                    }
+                }
+
+                // Memory BW over the limits stretches the memory cycles
+                double sys_factor = total_demand > model.mem_bw
+                                        ? model.mem_bw / total_demand
+                                        : 1;
+                auto clos_factor = std::map<uint32_t, double>();
+                for (const auto &c : clos_demand) {
+                    uint64_t mb;
+                    int ctrl;
+                    double limit = std::numeric_limits<double>::infinity();
+                    if (cat->get_mb_limit(c.first, mb, ctrl))
+                        limit = ctrl ? mb : mb / 100.0 * model.mem_bw;
+                    clos_factor[c.first] =
+                        std::min(sys_factor,
+                                 c.second > limit ? limit / c.second : 1);
+                }
+
+                // Simulated counters
+                for (const auto &task : running) {
+                    const auto &rows = interval.second.at(task->label);
+                    double f = clos_factor[clos[task->id]];
+                    double w = effective_ways(*task, masks);
+
+                    for (uint32_t i = 0; i < rows.size(); i++) {
+                        const auto &v = rows[i].values;
+                        const auto &s = sims[task->id][i];
+                        double inst = v[i_inst], cycles = v[i_cycles];
+                        double cpi = s.cpi > 0 ? s.base + s.mem / f : 0;
+                        double sim_inst = cpi > 0 ? cycles / cpi : inst;
+                        double scale = inst > 0 ? sim_inst / inst : 1;
+
+                        task->inst_rec += inst;
+                        task->inst_sim += sim_inst;
+                        task->cycles += cycles;
+
+                        counters_t counters;
+                        for (uint32_t c = 0; c < trace.names.size(); c++) {
+                            double value = v[c];
+                            if ((int)c == i_inst)
+                                value = sim_inst;
+                            else if ((int)c == i_miss)
+                                value = v[c] * scale * s.ratio;
+                            else if ((int)c == i_occup)
+                                value = std::min(v[c] * s.ratio,
+                                                 w * model.way_size);
+                            if ((int)c == i_mbt || (int)c == i_mbl)
+                                value = v[c] * scale * s.ratio *
+                                        options.ti; // Stats divides by ti
+                            counters.insert(Counter(c, trace.names[c], value,
+                                                    "", true, 1, 1));
+                        }
+
+                        // The first accumulation of Stats only sets the
+                        // reference values, as it happens with perf
+                        if (!task->primed)
+                            task->stats[i].accum(counters, options.ti);
+                        task->stats[i].accum(counters, options.ti);
+                    }
+                    task->primed = true;
+
+                    if (out.is_open())
+                        task->task_stats_print_interval(sim_interval, out,
+                                                        false);
+                }
+
+                if (catpol->get_mrc())
+                    catpol->get_mrc()->update(sim_interval, runlist);
+                catpol->apply(sim_interval, options.ti, options.ti, runlist);
+                sim_interval++;
+            }
+        }
+        double elapsed = chr::duration<double>(chr::steady_clock::now() -
+                                               start).count();
+
+        // Report: speedup of every task against the trace, throughput and
+        // fairness (Jain's index of the speedups)
+        double sum_s = 0, sum_s2 = 0, min_s = 1e300, max_s = 0;
+        double total_rec = 0, total_sim = 0;
+        size_t n = 0;
+        std::cout << "task,ipc_recorded,ipc_simulated,speedup" << std::endl;
+        for (const auto &t : tasks) {
+            const auto &task = *t.second;
+            if (task.inst_rec <= 0 || task.cycles <= 0)
+                continue;
+            double s = task.inst_sim / task.inst_rec;
+            std::cout << "{},{:.4f},{:.4f},{:.4f}"_format(
+                             task.label, task.inst_rec / task.cycles,
+                             task.inst_sim / task.cycles, s)
+                      << std::endl;
+            sum_s += s;
+            sum_s2 += s * s;
+            min_s = std::min(min_s, s);
+            max_s = std::max(max_s, s);
+            total_rec += task.inst_rec;
+            total_sim += task.inst_sim;
+            n++;
+        }
+        if (n == 0)
+            throw_with_trace(std::runtime_error("No task has run"));
+        std::cout << std::endl
+                  << "throughput_speedup,{:.4f}"_format(total_sim / total_rec)
+                  << std::endl
+                  << "weighted_speedup,{:.4f}"_format(sum_s / n) << std::endl
+                  << "fairness_jain,{:.4f}"_format(sum_s * sum_s /
+                                                  (n * sum_s2))
+                  << std::endl
+                  << "min_speedup,{:.4f}"_format(min_s) << std::endl
+                  << "unfairness,{:.4f}"_format(max_s / min_s) << std::endl
+                  << "hw_writes,{}"_format(cat->get_num_writes()) << std::endl
+                  << "intervals,{}"_format(sim_interval) << std::endl
+                  << "time_faster_than_real,{:.0f}"_format(
+                         sim_interval * options.ti / std::max(elapsed, 1e-9))
+                  << std::endl;
+    } catch (const YAML::ParserException &e) {
+        LOGFAT("Error in config file in line: {} col: {} pos: {}: {}"_format(
+            e.mark.line, e.mark.column, e.mark.pos, e.msg));
+    } catch (const std::exception &e) {
+        const auto st = boost::get_error_info<traced>(e);
+        if (st)
+            LOGFAT(e.what() << std::endl << *st);
+        else
+            LOGFAT(e.what());
+    }
+
+    return EXIT_SUCCESS;
+}
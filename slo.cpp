@@ -0,0 +1,225 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "slo.hpp"
+#include "throw-with-trace.hpp"
+
+namespace fs = boost::filesystem;
+using fmt::literals::operator""_format;
+
+bool slo_parse_report(const std::string &line, LatencyReport &report)
+{
+    std::istringstream ss(line);
+    auto values = std::vector<double>();
+    double v;
+    while (ss >> v)
+        values.push_back(v);
+    if (!ss.eof() || values.size() < 3 || values.size() > 4)
+        return false;
+
+    // The timestamp, if any, is not used
+    size_t first = values.size() - 3;
+    for (size_t i = first; i < values.size(); i++)
+        if (values[i] < 0 || !std::isfinite(values[i]))
+            return false;
+
+    report.p95 = values[first];
+    report.p99 = values[first + 1];
+    report.qps = values[first + 2];
+    return true;
+}
+
+double slo_latency(const VMTask &vm)
+{
+    return vm.slo_percentile == 95 ? vm.lat_p95 : vm.lat_p99;
+}
+
+SloMonitor::~SloMonitor()
+{
+    if (fd >= 0)
+        ::close(fd);
+}
+
+void SloMonitor::listen(const std::string &addr, uint16_t port)
+{
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    if (inet_pton(AF_INET, addr.c_str(), &sa.sin_addr) != 1)
+        throw_with_trace(std::runtime_error(
+            "Invalid address '{}' for the latency reports"_format(addr)));
+
+    fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw_with_trace(std::runtime_error(
+            "Could not create the latency socket: {}"_format(strerror(errno))));
+    if (::bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        int err = errno;
+        ::close(fd);
+        fd = -1;
+        throw_with_trace(std::runtime_error(
+            "Could not bind the latency socket to {}:{}: {}"_format(
+                addr, port, strerror(err))));
+    }
+    LOGINF("SLO: receiving latency reports on {}:{}"_format(addr, port));
+}
+
+// Last valid report of each domain among the datagrams queued
+std::map<std::string, LatencyReport> SloMonitor::receive()
+{
+    auto result = std::map<std::string, LatencyReport>();
+    if (fd < 0)
+        return result;
+
+    char buf[1024];
+    ssize_t n;
+    while ((n = ::recv(fd, buf, sizeof(buf) - 1, 0)) >= 0) {
+        buf[n] = '\0';
+        std::istringstream ss(buf);
+        std::string line;
+        while (std::getline(ss, line)) {
+            std::string domain;
+            std::istringstream ls(line);
+            LatencyReport report;
+            if (!(ls >> domain))
+                continue;
+            std::string rest;
+            std::getline(ls, rest);
+            if (slo_parse_report(rest, report)) {
+                result[domain] = report;
+            } else {
+                num_invalid++;
+                LOGDEB("SLO: invalid report '{}'"_format(line));
+            }
+        }
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+        LOGWAR("SLO: error receiving latency reports: {}"_format(
+            strerror(errno)));
+    return result;
+}
+
+// Last complete line appended to the latency file since the previous call
+bool SloMonitor::read_file(VMTask &vm, LatencyReport &report)
+{
+    boost::system::error_code ec;
+    uintmax_t size = fs::file_size(vm.latency_file, ec);
+    if (ec)
+        return false;
+
+    // The client started a new file
+    file_t &f = files[vm.id];
+    if (size < f.offset) {
+        f.offset = 0;
+        f.partial.clear();
+    }
+    if (size == f.offset)
+        return false;
+
+    std::ifstream in(vm.latency_file);
+    in.seekg(f.offset);
+    std::string data(size - f.offset, '\0');
+    in.read(&data[0], data.size());
+    data.resize(in.gcount());
+    f.offset += data.size();
+    data = f.partial + data;
+
+    size_t end = data.rfind('\n');
+    if (end == std::string::npos) {
+        f.partial = data;
+        return false;
+    }
+    f.partial = data.substr(end + 1);
+
+    // Newest valid line
+    bool found = false;
+    std::istringstream ss(data.substr(0, end));
+    std::string line;
+    while (std::getline(ss, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        LatencyReport r;
+        if (slo_parse_report(line, r)) {
+            report = r;
+            found = true;
+        } else {
+            num_invalid++;
+            LOGDEB("SLO: invalid line '{}' in {}"_format(line,
+                                                        vm.latency_file));
+        }
+    }
+    return found;
+}
+
+void SloMonitor::poll(uint64_t interval, const Task::tasklist_t &tasklist)
+{
+    auto received = receive();
+
+    for (const auto &task_ptr : tasklist) {
+        auto vm = dynamic_cast<VMTask *>(task_ptr.get());
+        if (!vm)
+            continue;
+
+        LatencyReport report;
+        bool found = false;
+        auto it = received.find(vm->domain_name);
+        if (it != received.end()) {
+            report = it->second;
+            found = true;
+        }
+        if (!vm->latency_file.empty() && read_file(*vm, report))
+            found = true;
+        if (!found)
+            continue;
+
+        vm->lat_p95 = report.p95;
+        vm->lat_p99 = report.p99;
+        vm->lat_qps = report.qps;
+        vm->lat_interval = interval;
+        num_reports++;
+
+        LOGDEB("SLO: VM {} p95 {:.0f} us, p99 {:.0f} us, {:.0f} QPS"_format(
+            vm->name, report.p95, report.p99, report.qps));
+    }
+}
+
+uint64_t SloMonitor::get_num_reports() const
+{
+    return num_reports;
+}
+
+SloMonitor &slo_monitor()
+{
+    static SloMonitor monitor;
+    return monitor;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2023 Universitat Politècnica de València
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "task.hpp"
+#include "vm-task.hpp"
+
+// Tail latency and throughput of a client-server VM in one interval of its
+// client
+struct LatencyReport {
+    double p95 = 0; // us
+    double p99 = 0; // us
+    double qps = 0;
+};
+
+// Receives the reports of the clients of the client-server VMs. A client can
+// append a line '[timestamp] <p95 us> <p99 us> <qps>' per interval to the
+// latency file of its VM, or send datagrams '<domain> <p95 us> <p99 us>
+// <qps>' to a UDP port of the host. Every interval poll() stores the last
+// report of each VM in it (lat_p95, lat_p99 and lat_qps), from where it goes
+// to the stats of the VM and to the SLO policy.
+class SloMonitor
+{
+    struct file_t {
+        uintmax_t offset = 0;
+        std::string partial; // Incomplete last line
+    };
+    std::map<uint32_t, file_t> files; // Task id -> read state of its file
+    int fd = -1;
+    uint64_t num_reports = 0;
+    uint64_t num_invalid = 0;
+
+    bool read_file(VMTask &vm, LatencyReport &report);
+    std::map<std::string, LatencyReport> receive();
+
+  public:
+    SloMonitor() = default;
+    SloMonitor(const SloMonitor &) = delete;
+    SloMonitor &operator=(const SloMonitor &) = delete;
+    ~SloMonitor();
+
+    // Receives the datagrams sent to the given address and port
+    void listen(const std::string &addr, uint16_t port);
+    void poll(uint64_t interval, const Task::tasklist_t &tasklist);
+
+    uint64_t get_num_reports() const;
+};
+
+// Parses a report, with the fields in the order above, false if invalid
+bool slo_parse_report(const std::string &line, LatencyReport &report);
+// Latency of the VM in the percentile of its SLO
+double slo_latency(const VMTask &vm);
+
+// Monitor shared by the whole manager
+SloMonitor &slo_monitor();
@@ -476,6 +476,20 @@ double Stats::last(const std::string &name) const
     return acc::last(events.at(name));
 }
 
+bool Stats::has(const std::string &name) const
+{
+    return events.count(name) > 0;
+}
+
+bool Stats::is_snapshot(const std::string &name) const
+{
+    if (name == "MBL[MBps]" || name == "MBR[MBps]" || name == "MBT[MBps]")
+        return true;
+    const auto &cbak_name_idx = cbak.get<by_name>();
+    auto it = cbak_name_idx.find(name);
+    return it != cbak_name_idx.end() && it->snapshot;
+}
+
 void Stats::reset_counters()
 {
     clast = counters_t();
@@ -81,6 +81,11 @@ class Stats
     double sum(const std::string &name) const;
     // Last accumulated value into the counter
     double last(const std::string &name) const;
+    // True if the counter or derived metric is being accumulated
+    bool has(const std::string &name) const;
+    // True if the values of the counter are snapshots or rates, whose total
+    // is their mean rather than their sum
+    bool is_snapshot(const std::string &name) const;
 
     std::string header_to_string(const std::string &sep) const;
     std::string data_to_string_int(const std::string &sep) const;
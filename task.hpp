@@ -78,6 +78,19 @@ class Task
 
     std::map<uint32_t, float> total_cpu_util; //Total CPU utilization of each assigned cpu
 	std::map<std::pair<std::string,uint32_t>, float> total_time_util; //Total TIME utilization of each assigned cpu
+    std::map<uint32_t, uint64_t> l2_mask; // L2 CAT mask of each assigned cpu
+
+    // Allocation requested in the config, mapped to a CLOS by the allocator
+    uint32_t req_ways = 0;
+    int req_mbps = -1;
+    double req_cpu_quota = 0; // Cores of CFS bandwidth, 0 unlimited
+
+    // CFS bandwidth in cores (0 unlimited), and periods and time throttled
+    // in the last interval (see CpuQuota)
+    double cpu_quota = 0;
+    uint64_t cpu_nr_periods = 0;
+    uint64_t cpu_nr_throttled = 0;
+    uint64_t cpu_throttled_us = 0;
 
     Task(const std::string &_name, const std::vector<uint32_t> &_cpus,
          uint32_t _initial_clos, const std::string &_out,
@@ -107,9 +120,11 @@ class Task
 
     // If the limit has been reached, kill the application.
     // If the limit of restarts has not been reached, restart the application. If the limit of restarts was reached, mark the application as done.
+    // The restarted application is mapped to the CLOS given.
     virtual void
     task_restart_or_set_done(std::shared_ptr<IntelRDT> cat, Perf &perf,
-                             const std::vector<std::string> &events) = 0;
+                             const std::vector<std::string> &events,
+                             uint32_t clos) = 0;
 
     // Stats printing to CSV file
     virtual void task_stats_print_headers(std::ostream &out,const std::string &sep = ",") = 0;
@@ -14,6 +14,7 @@
    limitations under the License.
 */
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <queue>
@@ -206,23 +207,29 @@ void VMTask::set_VM_num_cpus()
     LOGINF("***** SET_VM_NUM_CPUS *****");
 
     // Set the number of vcpus of the VM
-    std::string command = "virsh setvcpus " + domain_name + " " +
-                          std::to_string(cpus.size()) + " --live";
-    LOGINF(
-        "--- Setting the number of vcpus of the VM >>>>>>> {}"_format(command));
-    int ret = system(command.c_str());
-    if (ret) {
+    unsigned int n = cpus.size();
+    LOGINF("--- Setting the number of vcpus of the VM {} to {}"_format(
+        domain_name, n));
+    if (virDomainSetVcpusFlags(dom, n, VIR_DOMAIN_AFFECT_LIVE) == -1)
         throw_with_trace(std::runtime_error(
-            "Error when setting the number of vcpus of the VM. Command issued: {}"_format(
-                command)));
-    }
-    // Activate (make them online) the added cpus
+            "Error when setting the number of vcpus of the VM {} to {}"_format(
+                domain_name, n)));
+
+    // Activate (make them online) the added cpus with the guest agent, or
+    // through ssh if the guest has no agent
+    online_vcpus = n;
+    if (n == 1 ||
+        virDomainSetGuestVcpus(dom, "1-{}"_format(n - 1).c_str(), 1, 0) == 0)
+        return;
+    LOGWAR("The guest agent of {} did not bring its vcpus online, using "
+           "ssh"_format(domain_name));
     for (uint32_t n_cpu = 1; n_cpu < cpus.size(); ++n_cpu) {
-        command = "ssh -T " + std::string(VM_USER) + "@" + domain_ip +
-                  " 'sudo bash -c \"echo 1 > /sys/devices/system/cpu/cpu" +
-                  std::to_string(n_cpu) + "/online\"'";
+        std::string command =
+            "ssh -T " + std::string(VM_USER) + "@" + domain_ip +
+            " 'sudo bash -c \"echo 1 > /sys/devices/system/cpu/cpu" +
+            std::to_string(n_cpu) + "/online\"'";
         LOGINF(">>>>> {}"_format(command));
-        ret = system(command.c_str());
+        int ret = system(command.c_str());
         if (ret)
             throw_with_trace(std::runtime_error(
                 "Error when setting the number of vcpus of the VM. Command issued: {}"_format(
@@ -568,7 +575,8 @@ void VMTask::task_restart()
 }
 
 void VMTask::task_restart_or_set_done(std::shared_ptr<IntelRDT> cat, Perf &perf,
-                                      const std::vector<std::string> &events)
+                                      const std::vector<std::string> &events,
+                                      uint32_t clos)
 {
     LOGINF("task_restart_or_set_done {}"_format(domain_name));
 
@@ -650,7 +658,8 @@ void VMTask::task_stats_print_interval(uint64_t interval,
         out_stream << id << "_" << name << sep << cpuID << sep
                    << getTemperatureCPU(cpuID) << sep
                    << VMTask::vm_cpu_util.at(cpuID) << sep
-                   << VMTask::total_cpu_util.at(cpuID) << sep;
+                   << VMTask::total_cpu_util.at(cpuID) << sep
+                   << "0x{:x}"_format(l2_mask[cpus[i]]) << sep;
 
         out_stream << stats[i].data_to_string_int(sep);
         out_stream << std::endl;
@@ -668,7 +677,8 @@ void VMTask::task_stats_print_total(uint64_t interval, std::ostream &out_stream,
         out_stream << id << "_" << name << sep << *it << sep
                    << getTemperatureCPU(*it) << sep
                    << VMTask::vm_cpu_util.at(*it) << sep
-                   << VMTask::total_cpu_util.at(*it) << sep;
+                   << VMTask::total_cpu_util.at(*it) << sep
+                   << "0x{:x}"_format(l2_mask[*it]) << sep;
 
         out_stream << stats[num_cpu].data_to_string_total(sep);
         out_stream << std::endl;
@@ -686,6 +696,7 @@ void VMTask::task_stats_print_headers(std::ostream &out_stream,
     out_stream << "Temperature" << sep;
     out_stream << "VM_CPU%" << sep;
     out_stream << "total_CPU%" << sep;
+    out_stream << "L2_mask" << sep;
     out_stream << stats[0].header_to_string(sep);
     out_stream << std::endl;
 }
@@ -992,6 +1003,109 @@ void VMTask::task_set_cpu_affinity()
     }
 }
 
+// Pin one VCPU of the SERVER VM to a single core
+void VMTask::task_pin_vcpu(uint32_t vcpu, uint32_t cpu)
+{
+    int maplen = VIR_CPU_MAPLEN(cpu + 1);
+    std::vector<unsigned char> cpumap(maplen, 0);
+    VIR_USE_CPU(cpumap.data(), cpu);
+
+    if (virDomainPinVcpu(dom, vcpu, cpumap.data(), maplen) == -1)
+        throw_with_trace(std::runtime_error(
+            "ERROR! Could not pin VCPU {} of domain {} to CPU {}."_format(
+                vcpu, domain_name, cpu)));
+}
+
+// Let a VCPU run on any of the given cores
+void VMTask::task_pin_vcpu(uint32_t vcpu, const std::vector<uint32_t> &pin_cpus)
+{
+    uint32_t max_cpu = *std::max_element(pin_cpus.begin(), pin_cpus.end());
+    int maplen = VIR_CPU_MAPLEN(max_cpu + 1);
+    std::vector<unsigned char> cpumap(maplen, 0);
+    for (auto cpu : pin_cpus)
+        VIR_USE_CPU(cpumap.data(), cpu);
+
+    if (virDomainPinVcpu(dom, vcpu, cpumap.data(), maplen) == -1)
+        throw_with_trace(std::runtime_error(
+            "ERROR! Could not pin VCPU {} of domain {} to {} CPUs."_format(
+                vcpu, domain_name, pin_cpus.size())));
+}
+
+// Let every VCPU of the SERVER VM run on any of the given cores
+void VMTask::task_pin_vcpus(const std::vector<uint32_t> &pin_cpus)
+{
+    uint32_t max_cpu = *std::max_element(pin_cpus.begin(), pin_cpus.end());
+    int maplen = VIR_CPU_MAPLEN(max_cpu + 1);
+    std::vector<unsigned char> cpumap(maplen, 0);
+    for (auto cpu : pin_cpus)
+        VIR_USE_CPU(cpumap.data(), cpu);
+
+    for (uint32_t vcpu = 0; vcpu < cpus.size(); vcpu++)
+        if (virDomainPinVcpu(dom, vcpu, cpumap.data(), maplen) == -1)
+            throw_with_trace(std::runtime_error(
+                "ERROR! Could not pin VCPU {} of domain {} to {} CPUs."_format(
+                    vcpu, domain_name, pin_cpus.size())));
+}
+
+// Bring online or offline the vCPUs of the guest through its agent, so that
+// the first n are online. The threads of the vCPUs offline are kept (idle),
+// and so are their pinning and counters.
+void VMTask::task_set_online_vcpus(uint32_t n)
+{
+    uint32_t total = cpus.size();
+    n = std::min(std::max(n, 1U), total);
+    uint32_t current = online_vcpus ? online_vcpus : total;
+    if (n == current)
+        return;
+
+    int online = n > current;
+    uint32_t first = std::min(n, current);
+    uint32_t last = std::max(n, current) - 1;
+    std::string cpumap = first == last ? std::to_string(first)
+                                       : "{}-{}"_format(first, last);
+    if (virDomainSetGuestVcpus(dom, cpumap.c_str(), online, 0) == -1)
+        throw_with_trace(std::runtime_error(
+            "ERROR! Could not set VCPUs {} of domain {} {}."_format(
+                cpumap, domain_name, online ? "online" : "offline")));
+    online_vcpus = n;
+}
+
+// Set the CFS bandwidth of each vCPU of the VM, in us every period (us). A
+// negative quota removes the limit.
+void VMTask::task_set_vcpu_quota(long long quota, unsigned long long period)
+{
+    virTypedParameterPtr sched = nullptr;
+    int nsched = 0;
+    int maxsched = 0;
+    if (virTypedParamsAddULLong(&sched, &nsched, &maxsched,
+                                VIR_DOMAIN_SCHEDULER_VCPU_PERIOD,
+                                period) == -1 ||
+        virTypedParamsAddLLong(&sched, &nsched, &maxsched,
+                               VIR_DOMAIN_SCHEDULER_VCPU_QUOTA, quota) == -1) {
+        virTypedParamsFree(sched, nsched);
+        throw_with_trace(std::runtime_error(
+            "ERROR! Could not build the scheduler parameters of domain {}."_format(
+                domain_name)));
+    }
+
+    int ret = virDomainSetSchedulerParametersFlags(dom, sched, nsched,
+                                                   VIR_DOMAIN_AFFECT_LIVE);
+    virTypedParamsFree(sched, nsched);
+    if (ret == -1)
+        throw_with_trace(std::runtime_error(
+            "ERROR! Could not set the VCPU quota of domain {} to {} us every {} us."_format(
+                domain_name, quota, period)));
+}
+
+// Resize the balloon of the VM, in KB
+void VMTask::task_set_memory(unsigned long kb)
+{
+    if (virDomainSetMemoryFlags(dom, kb, VIR_DOMAIN_AFFECT_LIVE) == -1)
+        throw_with_trace(std::runtime_error(
+            "ERROR! Could not set the memory of domain {} to {} KB."_format(
+                domain_name, kb)));
+}
+
 // Set the affinity of the CLIENT VM from a vector of cores
 // For now, it maps all VCPUs to the entire vector of cores
 void VMTask::task_set_cpu_affinity_client()
@@ -32,6 +32,7 @@
 #define DISK_UTILS_H
 #include "disk-utils.hpp"
 #endif
+#include "memory.hpp"
 
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/framework/accumulator_base.hpp>
@@ -92,6 +93,31 @@ class VMTask : public Task
     double ovs_bwtx;
     double ovs_bwrx;
 
+    // Policers of the vhost port: packets/s dropped and fraction of the
+    // packets that conform, to the VM (tx) and from it (rx)
+    double ovs_tx_drops = 0;
+    double ovs_rx_drops = 0;
+    double ovs_tx_conformance = 1;
+    double ovs_rx_conformance = 1;
+    std::map<std::string, double> ovs_qos_counters; // Last raw counters
+
+    // Tail latency SLO of the server (us, 0 if none) on the p95 or p99
+    // latency, and last report of its client (see SloMonitor)
+    double slo = 0;
+    uint32_t slo_percentile = 99;
+    std::string latency_file;
+    double lat_p95 = 0; // us
+    double lat_p99 = 0; // us
+    double lat_qps = 0;
+    uint64_t lat_interval = 0; // Interval of the last report
+
+    // vCPUs online in the guest, the first ones (0 means all of them)
+    uint32_t online_vcpus = 0;
+
+    // Memory and balloon of the guest in the last interval (see
+    // MemoryMonitor)
+    VmMemory mem;
+
     std::string args;             // Args for the server application
     std::string client_args;      // Args for the client application
     std::string arguments;        // Args for the server application
@@ -127,7 +153,7 @@ class VMTask : public Task
         accum_t;
 
     // VM category and its accumulators that gather stats and categorize the workload
-    vm_categories vm_cat;
+    vm_categories vm_cat = vm_cat_invalid;
     accum_t acc_cpu;
     accum_t acc_mean_cpu;
     accum_t acc_gips;
@@ -255,7 +281,8 @@ class VMTask : public Task
 
     void
     task_restart_or_set_done(std::shared_ptr<IntelRDT> cat, Perf &perf,
-                             const std::vector<std::string> &events) override;
+                             const std::vector<std::string> &events,
+                             uint32_t clos) override;
     // Stats
     void task_stats_print_headers(std::ostream &out_stream,
                                   const std::string &sep = ",") override;
@@ -279,6 +306,12 @@ class VMTask : public Task
     void task_load_ceph_snapshot();
     void task_set_cpu_affinity();
     void task_set_cpu_affinity_client();
+    void task_pin_vcpu(uint32_t vcpu, uint32_t cpu);
+    void task_pin_vcpu(uint32_t vcpu, const std::vector<uint32_t> &pin_cpus);
+    void task_pin_vcpus(const std::vector<uint32_t> &pin_cpus);
+    void task_set_online_vcpus(uint32_t n);
+    void task_set_vcpu_quota(long long quota, unsigned long long period);
+    void task_set_memory(unsigned long kb);
     std::string domain_state_to_str(unsigned char state);
     void task_get_pid(bool monitor_only);
     void set_VM_num_cpus();